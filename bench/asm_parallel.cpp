@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "../src/program.h"
+#include "../src/assembler/lexer.h"
+#include "../src/assembler/assembler.h"
+#include "generate.h"
+using namespace std;
+
+
+/*  Parallel assembler benchmark.
+ *
+ *  Assembles one large generated source sequentially and then in parallel with
+ *  growing number of threads.
+ *  Reports best time and speedup over the sequential assembler for every number of threads, and
+ *  checks that the parallel output is byte-identical to the sequential one.
+ */
+
+
+double assemble(const lexer::Source& source, const string& path, unsigned jobs, Program& program) {
+    auto start = chrono::steady_clock::now();
+
+    if (jobs == 0) {
+        assembler::Scan scanned = assembler::scan(source.data(), source.size(), path);
+        program.reserve(scanned.bytes);
+        assembler::assemble(program, scanned, path);
+    } else {
+        assembler::assembleParallel(program, source.data(), source.size(), path, jobs);
+    }
+    program.calculateBranches();
+
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+double best(const lexer::Source& source, const string& path, unsigned jobs, int repetitions, Program& program) {
+    double t = 0;
+    for (int r = 0; r < repetitions; ++r) {
+        Program attempt;
+        double d = assemble(source, path, jobs, attempt);
+        if (r == 0 or d < t) { t = d; }
+        if (r == 0) { program.append(attempt); }
+    }
+    return t;
+}
+
+
+int main(int argc, char* argv[]) {
+    int instructions = (argc > 1 ? atoi(argv[1]) : 1000000);
+    unsigned max_jobs = (argc > 2 ? atoi(argv[2]) : 16);
+    int repetitions = (argc > 3 ? atoi(argv[3]) : 3);
+    string path = "/tmp/wudoo_bench_asm_parallel.asm";
+
+    generate(path, instructions / INSTRUCTIONS_PER_BLOCK);
+    lexer::Source source(path);
+
+    Program sequential;
+    double base = best(source, path, 0, repetitions, sequential);
+
+    cout << "threads\tbest_ms\tspeedup\tidentical" << endl;
+    cout << "seq\t" << base << "\t1\tyes" << endl;
+    for (unsigned jobs = 1; jobs <= max_jobs; jobs *= 2) {
+        Program parallel;
+        double t = best(source, path, jobs, repetitions, parallel);
+        bool identical = (parallel.size() == sequential.size() and memcmp(parallel.data(), sequential.data(), sequential.size()) == 0);
+        cout << jobs << '\t' << t << '\t' << (base / t) << '\t' << (identical ? "yes" : "NO") << endl;
+    }
+    remove(path.c_str());
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/program.h"
+#include "../src/assembler/lexer.h"
+#include "../src/assembler/assembler.h"
+#include "generate.h"
+using namespace std;
+
+
+/*  Assembler scaling benchmark.
+ *
+ *  Generates sources with growing number of instructions, writes them to a file and
+ *  measures how long it takes to read, scan, assemble and backpatch them.
+ *  If assembly is linear, time per instruction stays flat as the size grows.
+ *
+ *  Every generated block contains a forward and a backward branch, and a forward jump (see generate.h), so
+ *  the number of branches to backpatch grows with the size of the program.
+ */
+
+
+double assemble(const string& path) {
+    auto start = chrono::steady_clock::now();
+
+    lexer::Source source(path);
+    assembler::Scan scanned = assembler::scan(source.data(), source.size(), path);
+    Program program(scanned.bytes);
+    assembler::assemble(program, scanned, path);
+    program.calculateBranches();
+
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count();
+}
+
+
+int main(int argc, char* argv[]) {
+    int max_instructions = (argc > 1 ? atoi(argv[1]) : 1000000);
+    int repetitions = (argc > 2 ? atoi(argv[2]) : 3);
+    string path = "/tmp/wudoo_bench_asm_scaling.asm";
+
+    cout << "instructions\tbest_ms\tns_per_instruction" << endl;
+    for (int instructions = max_instructions/16; instructions <= max_instructions; instructions *= 2) {
+        int blocks = instructions / INSTRUCTIONS_PER_BLOCK;
+        generate(path, blocks);
+
+        double best = 0;
+        for (int r = 0; r < repetitions; ++r) {
+            double t = assemble(path);
+            if (r == 0 or t < best) { best = t; }
+        }
+
+        int total = blocks*INSTRUCTIONS_PER_BLOCK + 2;
+        cout << total << '\t' << (best / 1e6) << '\t' << (best / total) << endl;
+    }
+    remove(path.c_str());
+
+    return 0;
+}
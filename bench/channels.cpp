@@ -0,0 +1,119 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/program.h"
+#include "../src/assembler/assembler.h"
+#include "../src/cpu/image.h"
+#include "../src/cpu/cpu.h"
+#include "../src/cpu/scheduler.h"
+#include "../src/support/ringbuffer.h"
+#include "generate.h"
+using namespace std;
+
+
+/*  Channel benchmark.
+ *
+ *  Runs a pipeline of VM processes: a producer sends numbers to `stages` workers through one channel,
+ *  workers increment them and send them through another channel to the consumer (the first process).
+ *  Producer ends the stream with one zero for every worker, and every worker passes its zero on.
+ *  Reports messages per second (a message is counted once, although it passes through two channels)
+ *  for growing numbers of workers of the scheduler.
+ *
+ *  Throughput of the ring buffer itself (producer threads pushing, one thread popping) is reported first.
+ */
+
+
+string pipeline(int messages, int stages, int capacity) {
+    ostringstream source;
+    source << ".name: 1 setup\n.name: 2 input\n.name: 3 output\n.name: 4 handle\n.name: 5 value\n";
+    source << ".name: 6 counter\n.name: 7 limit\n.name: 8 more\n.name: 9 stopped\n";
+
+    source << "chan input " << capacity << "\n" << "chan output " << capacity << "\n";
+    source << "istore counter 0\n" << "istore limit " << stages << "\n";
+    source << ".mark: spawning\n" << "chan setup 2\n" << "spawn setup :worker\n";
+    source << "copy input handle\n" << "send setup handle\n" << "copy output handle\n" << "send setup handle\n";
+    source << "iinc counter\n" << "ilt counter limit more\n" << "branch more :spawning :spawned\n";
+    source << ".mark: spawned\n" << "spawn input :producer\n" << "istore stopped 0\n";
+    source << ".mark: receiving\n" << "recv output value\n" << "branch value :receiving :stop\n";
+    source << ".mark: stop\n" << "iinc stopped\n" << "ilt stopped limit more\n" << "branch more :receiving :end\n";
+    source << ".mark: end\n" << "halt\n";
+
+    source << ".mark: worker\n" << "recv setup input\n" << "recv setup output\n";
+    source << ".mark: working\n" << "recv input value\n" << "branch value :work :finish\n";
+    source << ".mark: work\n" << "iinc value\n" << "send output value\n" << "jump :working\n";
+    source << ".mark: finish\n" << "send output value\n" << "halt\n";
+
+    source << ".mark: producer\n" << "istore counter 1\n" << "istore limit " << messages << "\n";
+    source << ".mark: producing\n" << "copy counter value\n" << "send input value\n";
+    source << "iinc counter\n" << "ilte counter limit more\n" << "branch more :producing :produced\n";
+    source << ".mark: produced\n" << "istore counter 0\n" << "istore limit " << stages << "\n";
+    source << ".mark: stopping\n" << "istore value 0\n" << "send input value\n";
+    source << "iinc counter\n" << "ilt counter limit more\n" << "branch more :stopping :stopped\n";
+    source << ".mark: stopped\n" << "halt\n";
+    return source.str();
+}
+
+double seconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+double queue(int messages, unsigned producers, int capacity) {
+    /*  Messages per second passed through a ring buffer by `producers` threads to a single consumer.
+     */
+    RingBuffer<long> buffer(capacity);
+    auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (unsigned p = 0; p < producers; ++p) {
+        threads.push_back(thread([&buffer, messages, producers] {
+            for (int i = 0; i < messages / int(producers); ++i) {
+                while (not buffer.push(i)) { this_thread::yield(); }
+            }
+        }));
+    }
+    long value;
+    for (int i = 0; i < (messages / int(producers)) * int(producers); ++i) {
+        while (not buffer.pop(value)) { this_thread::yield(); }
+    }
+    for (thread& t : threads) { t.join(); }
+    return messages / seconds(start);
+}
+
+
+int main(int argc, char* argv[]) {
+    int messages = (argc > 1 ? atoi(argv[1]) : 200000);
+    int stages = (argc > 2 ? atoi(argv[2]) : 4);
+    int capacity = (argc > 3 ? atoi(argv[3]) : 64);
+    unsigned max_workers = (argc > 4 ? atoi(argv[4]) : thread::hardware_concurrency());
+    if (max_workers == 0) { max_workers = 1; }
+
+    cout << "ring buffer: messages: " << (messages * 10) << ", capacity: " << capacity << endl;
+    cout << "producers\tmessages_per_s" << endl;
+    for (unsigned producers = 1; producers <= 4; producers *= 2) {
+        cout << producers << '\t' << queue(messages * 10, producers, capacity) << endl;
+    }
+    cout << endl;
+
+    cout << "pipeline: messages: " << messages << ", stages: " << stages << ", capacity: " << capacity << endl;
+    cout << "workers\tms\tmessages_per_s\tslices\tsteals" << endl;
+    CodeImagePtr program = image(pipeline(messages, stages, capacity));
+    for (unsigned workers = 1; workers <= max_workers; workers *= 2) {
+        ostringstream discarded;
+        Scheduler scheduler(program, workers, discarded);
+        auto start = chrono::steady_clock::now();
+        int code = scheduler.run();
+        double t = seconds(start);
+        if (code != 0 or discarded.str().size()) {
+            cout << "pipeline failed: " << discarded.str() << endl;
+            return 1;
+        }
+
+        SchedulerStats stats = scheduler.stats();
+        cout << workers << '\t' << (t * 1000) << '\t' << (messages / t) << '\t' << stats.slices << '\t' << stats.steals << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/program.h"
+#include "../src/assembler/assembler.h"
+#include "../src/types/integer.h"
+#include "../src/cpu/image.h"
+#include "../src/cpu/cpu.h"
+#include "generate.h"
+using namespace std;
+
+
+/*  CPU cloning benchmark.
+ *
+ *  Runs a program which fills most of the registers with values (every one of them takes `work` iterations of
+ *  a loop to compute) and yields; after the yield it reads an input from register 1, combines it with a value
+ *  from the table, modifies another value of the table, and halts with the result as its exit code.
+ *  Every variant is a different input.
+ *
+ *  Variants are run as clones of one parent which ran the program up to the yield once, and
+ *  the first `scratch` of them also from scratch (a new CPU runs the whole program with the input put in before
+ *  it starts); results of clones are checked against them.
+ *  Reports latency of clone(), memory taken by a clone that is kept alive (measured by counting
+ *  allocations), and time per variant for both ways of running them.
+ */
+
+
+static size_t allocated = 0;
+
+void* operator new(size_t size) {
+    /*  Counts bytes on the heap; size of every block is kept in front of it.
+     */
+    size_t* block = (size_t*)malloc(size + 2*sizeof(size_t));
+    if (not block) { throw bad_alloc(); }
+    block[0] = size;
+    allocated += size;
+    return block + 2;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (not pointer) { return; }
+    size_t* block = (size_t*)pointer - 2;
+    allocated -= block[0];
+    free(block);
+}
+
+
+string program(int work) {
+    ostringstream source;
+    source << ".name: 1 input\n.name: 2 slot\n.name: 3 end\n.name: 4 value\n.name: 5 counter\n";
+    source << ".name: 6 limit\n.name: 7 more\n.name: 8 result\n";
+
+    source << "istore slot 10\n" << "istore end " << DEFAULT_REGISTER_SIZE << "\n";
+    source << ".mark: fill\n" << "istore value 0\n" << "istore counter 0\n" << "istore limit " << work << "\n";
+    source << ".mark: compute\n" << "iadd value counter value\n" << "iinc counter\n";
+    source << "ilt counter limit more\n" << "branch more :compute :computed\n";
+    source << ".mark: computed\n" << "copy value @slot\n" << "iinc slot\n";
+    source << "ilt slot end more\n" << "branch more :fill :filled\n";
+    source << ".mark: filled\n" << "yield\n";
+
+    source << "iadd input 100 result\n" << "iinc 200\n" << "iadd result 200 result\n";
+    source << "move result 0\n" << "halt\n";
+    return source.str();
+}
+
+double seconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int finish(CPU& cpu) {
+    /*  Runs a CPU until the program halts (it yields once, when the table is ready).
+     */
+    while (cpu.resume() == CPU::YIELDED) {}
+    return cpu.exitcode();
+}
+
+
+int main(int argc, char* argv[]) {
+    int variants = (argc > 1 ? atoi(argv[1]) : 10000);
+    int work = (argc > 2 ? atoi(argv[2]) : 20);
+    int samples = min(variants, (argc > 3 ? atoi(argv[3]) : 500));
+
+    CodeImagePtr code = image(program(work));
+    ostringstream discarded;
+
+    vector<int> expected(samples);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < samples; ++i) {
+        CPU cpu;
+        cpu.load(code).put(1, new Integer(i));
+        cpu.out.rdbuf(discarded.rdbuf());
+        expected[i] = finish(cpu);
+    }
+    double scratch = seconds(start);
+
+    CPU parent;
+    parent.load(code);
+    parent.out.rdbuf(discarded.rdbuf());
+    start = chrono::steady_clock::now();
+    if (parent.resume() != CPU::YIELDED) {
+        cout << "parent did not yield: " << discarded.str() << endl;
+        return 1;
+    }
+    double warmup = seconds(start);
+
+    // clones are kept alive to measure their latency and memory, and run afterwards
+    vector<CPU*> clones(variants);
+    size_t before = allocated;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < variants; ++i) { clones[i] = parent.clone(); }
+    double cloning = seconds(start);
+    size_t memory = allocated - before;
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < variants; ++i) {
+        clones[i]->put(1, new Integer(i));
+        int code = finish(*clones[i]);
+        if (i < samples and code != expected[i]) {
+            cout << "clone " << i << " computed a different result than a CPU running from scratch" << endl;
+            return 1;
+        }
+    }
+    double running = seconds(start);
+    size_t modified = allocated - before;
+    for (CPU* clone : clones) { delete clone; }
+
+    // memory of a CPU which ran a variant from scratch, for comparison with a clone
+    size_t own = allocated;
+    {
+        CPU* cpu = new CPU();
+        cpu->load(code).put(1, new Integer(0));
+        cpu->out.rdbuf(discarded.rdbuf());
+        finish(*cpu);
+        own = allocated - own;
+        delete cpu;
+    }
+
+    cout << "variants: " << variants << ", work: " << work << ", warm-up: " << (warmup * 1000) << " ms" << endl;
+    cout << "clone_ns\tclone_bytes\tclone_bytes_after_run\tscratch_bytes\tscratch_us\tclone_and_run_us\tspeedup" << endl;
+    cout << (cloning * 1e9 / variants) << '\t' << (memory / variants) << '\t' << (modified / variants) << '\t' << own << '\t';
+    cout << (scratch * 1e6 / samples) << '\t' << ((cloning + running) * 1e6 / variants) << '\t';
+    cout << ((scratch / samples) / ((cloning + running) / variants)) << endl;
+
+    return 0;
+}
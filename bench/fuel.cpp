@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/program.h"
+#include "../src/assembler/assembler.h"
+#include "../src/cpu/image.h"
+#include "../src/cpu/cpu.h"
+#include "generate.h"
+using namespace std;
+
+
+/*  Fuel metering benchmark.
+ *
+ *  Runs loops with bodies of different lengths without a limit of instructions and
+ *  with a limit high enough for them to finish, and reports overhead of metering.
+ *  Instructions are paid for a basic block at a time, so the overhead is largest for the shortest blocks.
+ *  Every measurement is the median of `repeats` runs.
+ */
+
+
+string loop(int iterations, int body) {
+    ostringstream source;
+    source << "istore 1 0\n" << "istore 2 " << iterations << "\n" << "istore 4 0\n";
+    source << ".mark: loop\n";
+    for (int i = 0; i < body; ++i) { source << "iinc 4\n"; }
+    source << "iinc 1\n" << "ilt 1 2 3\n" << "branch 3 :loop :end\n";
+    source << ".mark: end\n" << "halt\n";
+    return source.str();
+}
+
+double measure(const CodeImagePtr& program, uint64_t limit, int repeats) {
+    vector<double> times;
+    for (int r = 0; r < repeats; ++r) {
+        CPU cpu;
+        cpu.load(program).limit(limit);
+        auto start = chrono::steady_clock::now();
+        if (cpu.run() != 0) {
+            cout << "run failed" << endl;
+            exit(1);
+        }
+        times.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+
+int main(int argc, char* argv[]) {
+    int iterations = (argc > 1 ? atoi(argv[1]) : 1000000);
+    int repeats = (argc > 2 ? atoi(argv[2]) : 5);
+
+    cout << "iterations: " << iterations << ", repeats: " << repeats << endl;
+    cout << "block\tinstructions\tunmetered_ms\tmetered_ms\tns_per_instruction\toverhead_percent" << endl;
+    for (int body : {0, 4, 16}) {
+        CodeImagePtr program = image(loop(iterations, body));
+        uint64_t instructions = 3 + uint64_t(iterations) * (body + 3) + 1;
+
+        double unmetered = measure(program, 0, repeats);
+        double metered = measure(program, instructions, repeats);
+        cout << (body + 3) << '\t' << instructions << '\t' << unmetered << '\t' << metered << '\t';
+        cout << (unmetered * 1e6 / instructions) << '\t' << ((metered - unmetered) * 100 / unmetered) << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef WUDOO_BENCH_GENERATE_H
+#define WUDOO_BENCH_GENERATE_H
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include "../src/program.h"
+#include "../src/assembler/assembler.h"
+#include "../src/cpu/image.h"
+
+
+/*  Generator of large assembler sources used by assembler benchmarks, and
+ *  assembling of sources held in memory shared by all benchmarks.
+ *
+ *  Source is made of blocks of INSTRUCTIONS_PER_BLOCK instructions.
+ *  Every block contains a forward and a backward branch, and a forward jump.
+ */
+
+
+const int INSTRUCTIONS_PER_BLOCK = 8;
+
+
+inline void generate(const std::string& path, int blocks) {
+    std::ofstream out(path);
+    out << "; generated by bench/generate.h\n";
+    out << ".name: 1 counter\n";
+    out << ".name: 4 condition\n";
+    for (int b = 0; b < blocks; ++b) {
+        out << ".mark: block" << b << '\n';
+        out << "istore counter " << b << '\n';
+        out << "istore 2 7\n";
+        out << "iadd counter 2 3\n";
+        out << "ilt counter 2 condition\n";
+        out << "branch condition :block" << (b+1) << " :block" << b << '\n';
+        out << "print 3\n";
+        out << "jump :block" << (b+2) << '\n';
+        out << "pass\n";
+    }
+    out << ".mark: block" << blocks << '\n';
+    out << "pass\n";
+    out << ".mark: block" << (blocks+1) << '\n';
+    out << "halt\n";
+}
+
+inline CodeImagePtr image(const std::string& source) {
+    /*  Assembles source held in memory into an image that adopts the bytecode (nothing is copied).
+     */
+    assembler::Scan scanned = assembler::scan(source.data(), source.size(), "<bench>");
+    Program program(scanned.bytes);
+    assembler::assemble(program, scanned, "<bench>");
+    program.calculateBranches();
+    uint32_t size = program.size();
+    return CodeImage::adopt(program.release(), size, 0);
+}
+
+
+#endif
@@ -0,0 +1,81 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../src/program.h"
+#include "../src/assembler/assembler.h"
+#include "../src/cpu/image.h"
+#include "../src/cpu/cpu.h"
+#include "../src/cpu/scheduler.h"
+#include "generate.h"
+using namespace std;
+
+
+/*  Scheduler benchmark.
+ *
+ *  Runs a program which spawns many processes, each of them running a short loop, and
+ *  a program running the same loops one after another in a single CPU.
+ *  Difference between their times is the cost of scheduling: creating processes and
+ *  switching between them (a process is preempted after `budget` instructions).
+ *  Reports speedup and the overhead per context switch for growing numbers of workers
+ *  (overhead is computed from time of all workers, so it is exact only when they are all busy).
+ */
+
+
+string processes(int n, int iterations) {
+    ostringstream source;
+    source << "istore 1 0\n" << "istore 2 " << n << '\n';
+    source << ".mark: spawning\n" << "spawn 1 :work\n" << "iinc 1\n" << "ilt 1 2 3\n" << "branch 3 :spawning :end\n";
+    source << ".mark: end\n" << "halt\n";
+    source << ".mark: work\n" << "istore 4 0\n" << "istore 5 " << iterations << '\n';
+    source << ".mark: loop\n" << "iinc 4\n" << "ilt 4 5 6\n" << "branch 6 :loop :done\n";
+    source << ".mark: done\n" << "halt\n";
+    return source.str();
+}
+
+string sequential(int n, int iterations) {
+    ostringstream source;
+    source << "istore 1 0\n" << "istore 2 " << n << '\n';
+    source << ".mark: outer\n" << "istore 4 0\n" << "istore 5 " << iterations << '\n';
+    source << ".mark: loop\n" << "iinc 4\n" << "ilt 4 5 6\n" << "branch 6 :loop :next\n";
+    source << ".mark: next\n" << "iinc 1\n" << "ilt 1 2 3\n" << "branch 3 :outer :end\n";
+    source << ".mark: end\n" << "halt\n";
+    return source.str();
+}
+
+double milliseconds(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char* argv[]) {
+    int n = (argc > 1 ? atoi(argv[1]) : 100000);
+    int iterations = (argc > 2 ? atoi(argv[2]) : 100);
+    uint64_t budget = (argc > 3 ? atoi(argv[3]) : 50);
+    unsigned max_workers = (argc > 4 ? atoi(argv[4]) : thread::hardware_concurrency());
+
+    auto start = chrono::steady_clock::now();
+    CPU cpu;
+    cpu.load(image(sequential(n, iterations))).run();
+    double base = milliseconds(start);
+
+    cout << "processes: " << n << ", loop iterations: " << iterations << ", budget: " << budget << endl;
+    cout << "workers\tms\tspeedup\tslices\tsteals\toverhead_ns_per_switch" << endl;
+    cout << "seq\t" << base << "\t1\t-\t-\t-" << endl;
+
+    CodeImagePtr spawning = image(processes(n, iterations));
+    for (unsigned workers = 1; workers <= max_workers; workers *= 2) {
+        ostringstream discarded;
+        Scheduler scheduler(spawning, workers, discarded, budget);
+        start = chrono::steady_clock::now();
+        scheduler.run();
+        double t = milliseconds(start);
+
+        SchedulerStats stats = scheduler.stats();
+        cout << workers << '\t' << t << '\t' << (base / t) << '\t' << stats.slices << '\t' << stats.steals << '\t';
+        cout << ((t*workers - base) * 1e6 / stats.slices) << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "../src/program.h"
+#include "../src/assembler/assembler.h"
+#include "../src/cpu/image.h"
+#include "../src/cpu/cpu.h"
+#include "generate.h"
+using namespace std;
+
+
+/*  Benchmark suite (`make bench`).
+ *
+ *  Opcode benchmarks run a loop whose body is BODY copies of a single instruction
+ *  (the loop itself adds three instructions per iteration), macro benchmarks run scaled-up versions of
+ *  sample programs, and assembler benchmarks assemble generated sources (see generate.h) from memory.
+ *  Every benchmark is run `warmup` times without being measured, and then `repetitions` times;
+ *  the median and the 99th percentile (nearest rank) of nanoseconds per executed VM instruction
+ *  (per assembled instruction for the assembler) are reported, and written as JSON.
+ *
+ *  Output of programs is discarded, so printing does not measure the terminal.
+ */
+
+
+const int BODY = 32;
+
+
+struct Benchmark {
+    string name;
+    string group;
+    string source;
+};
+
+struct Result {
+    string name;
+    string group;
+    uint64_t instructions;
+    double median;
+    double p99;
+};
+
+
+class Discard: public streambuf {
+    protected:
+        int overflow(int c) { return c; }
+};
+
+
+string loop(int iterations, const string& setup, const string& body) {
+    ostringstream source;
+    source << "istore 1 0\n" << "istore 2 " << iterations << "\n" << "ilt 1 2 3\n" << setup;
+    source << ".mark: loop\n" << body;
+    source << "iinc 1\n" << "ilt 1 2 3\n" << "branch 3 :loop :end\n";
+    source << ".mark: end\n" << "halt\n";
+    return source.str();
+}
+
+string repeat(const string& instruction) {
+    string body;
+    for (int i = 0; i < BODY; ++i) { body += instruction + "\n"; }
+    return body;
+}
+
+vector<Benchmark> opcodes(int iterations) {
+    string branches;
+    for (int i = 0; i < BODY; ++i) {
+        branches += "branch 3 :next" + to_string(i) + " :next" + to_string(i) + "\n.mark: next" + to_string(i) + "\n";
+    }
+    return {
+        { "istore", "opcode", loop(iterations, "", repeat("istore 4 42")) },
+        { "iadd", "opcode", loop(iterations, "istore 5 2\nistore 6 3\n", repeat("iadd 5 6 7")) },
+        { "branch", "opcode", loop(iterations, "", branches) },
+        { "copy", "opcode", loop(iterations, "istore 5 2\n", repeat("copy 5 7")) },
+        // register 8 holds the index of the register iadd reads, i.e. `@8` is register 5
+        { "iadd-ref", "opcode", loop(iterations, "istore 5 2\nistore 6 3\nistore 8 5\n", repeat("iadd @8 6 7")) },
+    };
+}
+
+vector<Benchmark> programs(int scale) {
+    ostringstream looping, power_of, modulo;
+
+    // sample/asm/looping.asm counting to `scale` instead of 10
+    looping << "istore 1 0\n" << "istore 2 " << scale << "\n";
+    looping << ".mark: loop\n" << "ilt 1 2 3\n" << "not 3\n" << "branch 3 :final_print\n";
+    looping << "print 1\n" << "iinc 1\n" << "jump :loop\n";
+    looping << ".mark: final_print\n" << "print 1\n" << "halt\n";
+
+    // sample/asm/power_of.asm raising 1 (so the result does not overflow) to the power of `scale`
+    power_of << "istore 1 1\n" << "istore 2 " << scale << "\n" << "istore 3 0\n";
+    power_of << "ieq 2 3 4\n" << "not 4\n" << "branch 4 :algorithm\n" << "istore 6 1\n" << "jump :final_print\n";
+    power_of << ".mark: algorithm\n" << "istore 5 1\n" << "istore 6 @1\n";
+    power_of << ".mark: loop\n" << "ilt 5 2 4\n" << "branch 4 12 :final_print\n";
+    power_of << "imul 1 6 6\n" << "pass\n" << "iinc 5\n" << "jump :loop\n";
+    power_of << ".mark: final_print\n" << "print 6\n" << "halt\n";
+
+    // sample/asm/int/modulo.asm computed `scale` times
+    modulo << "istore 7 0\n" << "istore 8 " << scale << "\n";
+    modulo << ".mark: again\n";
+    modulo << "istore 1 166737\n" << "istore 2 176\n" << "istore 3 @1\n";
+    modulo << "ilt 1 2 4\n" << "branch 4 :final :compute\n";
+    modulo << ".mark: compute\n" << "idiv 1 2\n" << "imul 1 2\n" << "isub 3 1\n";
+    modulo << ".mark: final\n" << "iinc 7\n" << "ilt 7 8 9\n" << "branch 9 :again :done\n";
+    modulo << ".mark: done\n" << "print 3\n" << "halt\n";
+
+    return {
+        { "looping", "program", looping.str() },
+        { "power_of", "program", power_of.str() },
+        { "modulo", "program", modulo.str() },
+    };
+}
+
+Result summarise(const Benchmark& benchmark, uint64_t instructions, vector<double> per_instruction) {
+    sort(per_instruction.begin(), per_instruction.end());
+    size_t n = per_instruction.size();
+    size_t rank = (99 * n + 99) / 100;
+    return Result{benchmark.name, benchmark.group, instructions, per_instruction[n / 2], per_instruction[rank - 1]};
+}
+
+Result execute(const Benchmark& benchmark, int warmup, int repetitions) {
+    CodeImagePtr program = image(benchmark.source);
+    Discard discard;
+    uint64_t instructions = 0;
+    vector<double> times;
+    for (int r = 0; r < warmup + repetitions; ++r) {
+        CPU cpu;
+        cpu.out.rdbuf(&discard);
+        cpu.load(program);
+        auto start = chrono::steady_clock::now();
+        if (cpu.run() != 0) {
+            cout << "fatal: " << benchmark.name << " failed" << endl;
+            exit(1);
+        }
+        double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        instructions = cpu.instructions();
+        if (r >= warmup) { times.push_back(elapsed / instructions); }
+    }
+    return summarise(benchmark, instructions, times);
+}
+
+Result assembly(const Benchmark& benchmark, int warmup, int repetitions) {
+    uint64_t instructions = 0;
+    vector<double> times;
+    for (int r = 0; r < warmup + repetitions; ++r) {
+        auto start = chrono::steady_clock::now();
+        assembler::Scan scanned = assembler::scan(benchmark.source.data(), benchmark.source.size(), "<bench>");
+        Program program(scanned.bytes);
+        assembler::assemble(program, scanned, "<bench>");
+        program.calculateBranches();
+        double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        instructions = program.instructionCount();
+        if (r >= warmup) { times.push_back(elapsed / instructions); }
+    }
+    return summarise(benchmark, instructions, times);
+}
+
+string source(int blocks) {
+    string path = "/tmp/wudoo_bench_suite.asm";
+    generate(path, blocks);
+    ifstream in(path);
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    remove(path.c_str());
+    return text;
+}
+
+void json(ostream& out, const vector<Result>& results, int warmup, int repetitions) {
+    out << "{\n";
+    out << "    \"warmup\": " << warmup << ",\n";
+    out << "    \"repetitions\": " << repetitions << ",\n";
+    out << "    \"unit\": \"ns per instruction\",\n";
+    out << "    \"benchmarks\": [";
+    for (unsigned i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        out << (i ? ",\n" : "\n");
+        out << "        {\"name\": \"" << result.name << "\", \"group\": \"" << result.group << "\", \"instructions\": " << result.instructions;
+        out << fixed << setprecision(2) << ", \"median\": " << result.median << ", \"p99\": " << result.p99 << '}';
+        out.unsetf(ios::floatfield);
+    }
+    out << "\n    ]\n";
+    out << "}\n";
+}
+
+
+int main(int argc, char* argv[]) {
+    string path = (argc > 1 ? argv[1] : "bench.json");
+    int repetitions = (argc > 2 ? atoi(argv[2]) : 20);
+    int warmup = (argc > 3 ? atoi(argv[3]) : 3);
+    if (repetitions < 1 or warmup < 0) {
+        cout << "usage: " << argv[0] << " [<json file> [<repetitions> [<warmup>]]]" << endl;
+        return 1;
+    }
+
+    vector<Benchmark> benchmarks = opcodes(5000);
+    for (const Benchmark& benchmark : programs(50000)) { benchmarks.push_back(benchmark); }
+    vector<Benchmark> sources;
+    for (int blocks : {1000, 10000}) {
+        sources.push_back(Benchmark{"assemble-" + to_string(blocks * INSTRUCTIONS_PER_BLOCK + 2), "assembler", source(blocks)});
+    }
+
+    cout << "warmup: " << warmup << ", repetitions: " << repetitions << endl;
+    cout << "benchmark\tgroup\tinstructions\tmedian_ns\tp99_ns" << endl;
+    vector<Result> results;
+    for (const Benchmark& benchmark : benchmarks) { results.push_back(execute(benchmark, warmup, repetitions)); }
+    for (const Benchmark& benchmark : sources) { results.push_back(assembly(benchmark, warmup, repetitions)); }
+    for (const Result& result : results) {
+        cout << result.name << '\t' << result.group << '\t' << result.instructions << '\t';
+        cout << fixed << setprecision(2) << result.median << '\t' << result.p99 << endl;
+        cout.unsetf(ios::floatfield);
+    }
+
+    ofstream out(path);
+    if (!out) {
+        cout << "fatal: could not write " << path << endl;
+        return 1;
+    }
+    json(out, results, warmup, repetitions);
+    cout << "results written to " << path << endl;
+
+    return 0;
+}
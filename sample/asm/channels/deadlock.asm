@@ -0,0 +1,13 @@
+; This script spawns a process which waits for a message that is never sent.
+; Both processes end up waiting on channels, so the scheduler reports a deadlock.
+.name: 1 channel
+.name: 2 value
+
+chan channel 1
+spawn channel :waiting
+recv channel value
+halt
+
+.mark: waiting
+recv channel value
+halt
@@ -0,0 +1,63 @@
+; This script runs a pipeline of three processes connected by channels:
+; a producer sends numbers from 1 to 5 to a worker, which sends their squares to the first process.
+; Zero marks the end of the stream.
+.name: 1 setup
+.name: 2 numbers
+.name: 3 squares
+.name: 4 handle
+.name: 5 value
+.name: 6 number
+.name: 7 limit
+.name: 8 more
+
+chan setup 2
+chan numbers 2
+chan squares 2
+spawn setup :worker
+spawn numbers :producer
+
+; channels are sent to the worker as copies, so the first process keeps its own handles
+copy numbers handle
+send setup handle
+copy squares handle
+send setup handle
+
+.mark: receiving
+recv squares value
+branch value :print :end
+.mark: print
+print value
+jump :receiving
+
+.mark: end
+halt
+
+
+.mark: worker
+recv setup numbers
+recv setup squares
+.mark: working
+recv numbers value
+branch value :square :finish
+.mark: square
+imul value value value
+send squares value
+jump :working
+.mark: finish
+send squares value
+halt
+
+
+.mark: producer
+istore number 1
+istore limit 5
+.mark: producing
+copy number value
+send numbers value
+iinc number
+ilte number limit more
+branch more :producing :produced
+.mark: produced
+istore value 0
+send numbers value
+halt
@@ -0,0 +1,17 @@
+; This script uses a channel within a single process.
+; Objects sent to a channel are moved out of their registers, and
+; `tryrecv` reports whether anything was received instead of waiting for it.
+.name: 1 channel
+.name: 2 value
+.name: 3 received
+
+chan channel 2
+istore value 42
+send channel value
+tryrecv channel value received
+print received
+print value
+tryrecv channel value received
+print received
+print value
+halt
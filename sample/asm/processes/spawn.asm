@@ -0,0 +1,24 @@
+; This script starts a process for every number from 1 to 4.
+; Every process gets its number in register 1 and prints its square.
+.name: 1 number
+.name: 2 limit
+.name: 3 more
+.name: 4 square
+
+istore number 1
+istore limit 4
+
+.mark: loop
+spawn number :square
+iinc number
+ilte number limit more
+branch more :loop :end
+
+.mark: end
+halt
+
+; code of spawned processes
+.mark: square
+imul number number square
+print square
+halt
@@ -0,0 +1,25 @@
+; Two processes take turns printing their numbers:
+; each of them yields after every number so the other one can run.
+.name: 1 start
+.name: 2 counter
+.name: 3 limit
+.name: 4 more
+
+istore start 10
+spawn start :count
+istore start 20
+jump :count
+
+.mark: count
+istore counter 0
+istore limit 3
+.mark: loop
+iadd start counter 5
+print 5
+yield
+iinc counter
+ilt counter limit more
+branch more :loop :end
+
+.mark: end
+halt
@@ -0,0 +1,26 @@
+; This script builds its state (sum of numbers from 1 to 1000, and a reference to it) and
+; yields before using it.
+; Run with `--snapshot <file>` it stops at the `yield` and saves its state, and
+; run with `--restore <file>` it continues from there without computing the sum again.
+.name: 1 sum
+.name: 2 counter
+.name: 3 limit
+.name: 4 more
+.name: 5 total
+
+istore sum 0
+istore counter 1
+istore limit 1000
+.mark: loop
+iadd sum counter
+iinc counter
+ilte counter limit more
+branch more :loop :initialised
+.mark: initialised
+ref sum total
+yield
+
+print sum
+iinc total
+print sum
+halt
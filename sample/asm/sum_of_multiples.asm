@@ -0,0 +1,32 @@
+; purpose of this program is to compute sum of first ten multiples of a number,
+; each increased by a bonus (loop optimisations of `-O` have plenty to do here)
+
+.name: 1 counter
+.name: 2 limit
+.name: 3 number
+.name: 5 sum
+.name: 6 multiple
+.name: 7 bonus
+
+istore counter 0
+istore limit 10
+istore number 7
+istore sum 0
+
+.mark: loop
+ilt counter limit 4
+branch 4 :body :final_print
+
+.mark: body
+; multiple of the number is computed from the counter
+imul counter number multiple
+iadd sum multiple sum
+; bonus does not change between iterations
+istore bonus 100
+iadd sum bonus sum
+iinc counter
+jump :loop
+
+.mark: final_print
+print sum
+halt
@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <climits>
+#include <deque>
+#include <vector>
+#include "../cpu/cpu.h"
+#include "assembler.h"
+#include "analysis.h"
+using namespace std;
+
+
+namespace assembler {
+    bool normaliseTargets(vector<Operation>& operations) {
+        /*  Rewrites negative jump targets (counted from the end of the program) as plain indexes.
+         *  Returns false if any target is out of bounds - such programs are not optimised
+         *  so the error is reported exactly as without optimisation.
+         */
+        int n = operations.size();
+        for (int i = 0; i < n; ++i) {
+            Operation& op = operations[i];
+            unsigned count = (op.opcode == JUMP ? 1 : op.opcode == BRANCH ? 2 : 0);
+            for (unsigned t = 0; t < count; ++t) {
+                int target = (op.targets[t] >= 0 ? op.targets[t] : n + op.targets[t]);
+                if (target < 0 or target >= n) { return false; }
+                op.targets[t] = target;
+            }
+        }
+        return true;
+    }
+
+    ControlFlowGraph buildControlFlowGraph(const vector<Operation>& operations) {
+        /** Split operations into basic blocks and connect them with edges.
+         *
+         *  Jump targets must be valid, non-negative instruction indexes.
+         */
+        ControlFlowGraph graph;
+        int n = operations.size();
+
+        vector<bool> leader(n+1, false);
+        leader[0] = true;
+        for (int i = 0; i < n; ++i) {
+            const Operation& op = operations[i];
+            if (op.opcode == JUMP) { leader[op.targets[0]] = true; }
+            if (op.opcode == BRANCH) { leader[op.targets[0]] = leader[op.targets[1]] = true; }
+            if (transfers(op.opcode)) { leader[i+1] = true; }
+        }
+
+        graph.block_of.resize(n);
+        for (int i = 0; i < n; ++i) {
+            if (leader[i]) {
+                Block block;
+                block.first = block.last = i;
+                graph.blocks.push_back(block);
+            }
+            graph.blocks.back().last = i;
+            graph.block_of[i] = graph.blocks.size() - 1;
+        }
+
+        for (unsigned b = 0; b < graph.blocks.size(); ++b) {
+            Block& block = graph.blocks[b];
+            const Operation& op = operations[block.last];
+            if (op.opcode == JUMP) {
+                block.successors.push_back(graph.block_of[op.targets[0]]);
+            } else if (op.opcode == BRANCH) {
+                block.successors.push_back(graph.block_of[op.targets[0]]);
+                if (op.targets[1] != op.targets[0]) { block.successors.push_back(graph.block_of[op.targets[1]]); }
+            } else if (op.opcode != HALT and block.last+1 < n) {
+                block.successors.push_back(b+1);
+            }
+            for (unsigned s = 0; s < block.successors.size(); ++s) {
+                graph.blocks[block.successors[s]].predecessors.push_back(b);
+            }
+        }
+        return graph;
+    }
+
+
+    bool Dominators::dominates(int a, int b) const {
+        /*  Walks the dominator tree up from b.
+         */
+        while (b != -1) {
+            if (a == b) { return true; }
+            int up = idom[b];
+            if (up == b) { break; }
+            b = up;
+        }
+        return false;
+    }
+
+    Dominators findDominators(const ControlFlowGraph& graph) {
+        /** Compute immediate dominators.
+         *
+         *  This is the iterative algorithm by Cooper, Harvey and Kennedy ("A Simple, Fast Dominance Algorithm") which
+         *  intersects dominators of predecessors visited in reverse postorder until nothing changes.
+         *  Entry block is its own immediate dominator.
+         */
+        int n = graph.blocks.size();
+        Dominators dominators;
+        dominators.idom.assign(n, -1);
+
+        // postorder numbering with an explicit stack, programs may have a lot of blocks
+        vector<int> order;
+        vector<int> number(n, -1);
+        vector<unsigned> next(n, 0);
+        vector<bool> seen(n, false);
+        vector<int> stack(1, 0);
+        seen[0] = true;
+        while (stack.size()) {
+            int b = stack.back();
+            const vector<int>& successors = graph.blocks[b].successors;
+            if (next[b] < successors.size()) {
+                int s = successors[next[b]++];
+                if (not seen[s]) {
+                    seen[s] = true;
+                    stack.push_back(s);
+                }
+            } else {
+                number[b] = order.size();
+                order.push_back(b);
+                stack.pop_back();
+            }
+        }
+
+        vector<int>& idom = dominators.idom;
+        idom[0] = 0;
+        auto intersect = [&idom, &number] (int a, int b) {
+            while (a != b) {
+                while (number[a] < number[b]) { a = idom[a]; }
+                while (number[b] < number[a]) { b = idom[b]; }
+            }
+            return a;
+        };
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int i = order.size()-1; i >= 0; --i) {
+                int b = order[i];
+                if (b == 0) { continue; }
+                int dom = -1;
+                for (int p : graph.blocks[b].predecessors) {
+                    if (idom[p] == -1) { continue; }
+                    dom = (dom == -1 ? p : intersect(p, dom));
+                }
+                if (dom != idom[b]) {
+                    idom[b] = dom;
+                    changed = true;
+                }
+            }
+        }
+        return dominators;
+    }
+
+
+    bool Loop::contains(int block) const {
+        return binary_search(blocks.begin(), blocks.end(), block);
+    }
+
+    vector<Loop> findLoops(const ControlFlowGraph& graph, const Dominators& dominators) {
+        /** Find natural loops of a program.
+         *
+         *  Body of a loop consists of its header and all blocks which can reach a latch
+         *  without going through the header.
+         *  Loops are returned ordered by size, so inner loops come before loops enclosing them.
+         */
+        int n = graph.blocks.size();
+        vector<vector<int> > latches(n);
+        for (int b = 0; b < n; ++b) {
+            if (dominators.idom[b] == -1) { continue; }
+            for (int s : graph.blocks[b].successors) {
+                if (dominators.dominates(s, b)) { latches[s].push_back(b); }
+            }
+        }
+
+        vector<Loop> loops;
+        vector<int> mark(n, -1);
+        for (int h = 0; h < n; ++h) {
+            if (latches[h].empty()) { continue; }
+            Loop loop;
+            loop.header = h;
+            loop.latches = latches[h];
+
+            mark[h] = h;
+            loop.blocks.push_back(h);
+            vector<int> stack;
+            for (int l : latches[h]) {
+                if (mark[l] != h) {
+                    mark[l] = h;
+                    loop.blocks.push_back(l);
+                    stack.push_back(l);
+                }
+            }
+            while (stack.size()) {
+                int b = stack.back();
+                stack.pop_back();
+                for (int p : graph.blocks[b].predecessors) {
+                    if (mark[p] != h and dominators.idom[p] != -1) {
+                        mark[p] = h;
+                        loop.blocks.push_back(p);
+                        stack.push_back(p);
+                    }
+                }
+            }
+            sort(loop.blocks.begin(), loop.blocks.end());
+            loops.push_back(loop);
+        }
+
+        stable_sort(loops.begin(), loops.end(), [] (const Loop& a, const Loop& b) { return a.blocks.size() < b.blocks.size(); });
+        return loops;
+    }
+
+
+    Effects effects(const Operation& op) {
+        Effects e;
+        e.use_count = 0;
+        e.def_count = 0;
+        e.opaque = false;
+
+        const int_op* ops = op.operands;
+        for (unsigned i = 0; i < 3; ++i) {
+            if (isref(ops[i]) and not (op.opcode == ISTORE and i == 1)) { e.opaque = true; }
+        }
+        if (get<0>(op.byte_operand)) { e.opaque = true; }
+
+        switch (op.opcode) {
+            case ISTORE:
+                if (isref(ops[1])) { e.uses[e.use_count++] = regof(ops[1]); }
+                e.defs[e.def_count++] = regof(ops[0]);
+                break;
+            case IADD: case ISUB: case IMUL: case IDIV:
+            case ILT: case ILTE: case IGT: case IGTE: case IEQ:
+            case AND: case OR:
+                e.uses[e.use_count++] = regof(ops[0]);
+                e.uses[e.use_count++] = regof(ops[1]);
+                e.defs[e.def_count++] = regof(ops[2]);
+                break;
+            case IINC: case IDEC: case NOT:
+                e.uses[e.use_count++] = regof(ops[0]);
+                e.defs[e.def_count++] = regof(ops[0]);
+                break;
+            case BSTORE:
+                e.defs[e.def_count++] = regof(ops[0]);
+                break;
+            case MOVE:
+                // source register is emptied, so it is written too
+                e.uses[e.use_count++] = regof(ops[0]);
+                e.defs[e.def_count++] = regof(ops[1]);
+                e.defs[e.def_count++] = regof(ops[0]);
+                break;
+            case COPY:
+                e.uses[e.use_count++] = regof(ops[0]);
+                e.defs[e.def_count++] = regof(ops[1]);
+                break;
+            case SWAP:
+                e.uses[e.use_count++] = regof(ops[0]);
+                e.uses[e.use_count++] = regof(ops[1]);
+                e.defs[e.def_count++] = regof(ops[0]);
+                e.defs[e.def_count++] = regof(ops[1]);
+                break;
+            case PRINT: case ECHO: case BRANCH:
+                e.uses[e.use_count++] = regof(ops[0]);
+                break;
+            case RET:
+                e.uses[e.use_count++] = regof(ops[0]);
+                e.defs[e.def_count++] = 0;
+                break;
+            case JUMP: case PASS: case HALT: case YIELD:
+                break;
+            default:
+                e.opaque = true;
+        }
+
+        // accesses out of register bounds fail at run time, such operations are left alone
+        for (unsigned i = 0; i < e.use_count; ++i) {
+            if (e.uses[i] < 0 or e.uses[i] >= DEFAULT_REGISTER_SIZE) { e.opaque = true; }
+        }
+        for (unsigned i = 0; i < e.def_count; ++i) {
+            if (e.defs[i] < 0 or e.defs[i] >= DEFAULT_REGISTER_SIZE) { e.opaque = true; }
+        }
+        if (e.opaque) { e.use_count = e.def_count = 0; }
+        return e;
+    }
+
+    vector<Effects> effects(const vector<Operation>& operations) {
+        vector<Effects> fx(operations.size());
+        for (unsigned i = 0; i < operations.size(); ++i) { fx[i] = effects(operations[i]); }
+        return fx;
+    }
+
+
+    Registers numberRegisters(const vector<Effects>& fx) {
+        Registers regs;
+        regs.dense.assign(DEFAULT_REGISTER_SIZE, -1);
+        for (unsigned i = 0; i < fx.size(); ++i) {
+            const Effects& e = fx[i];
+            for (unsigned j = 0; j < e.use_count + e.def_count; ++j) {
+                int r = (j < e.use_count ? e.uses[j] : e.defs[j - e.use_count]);
+                if (regs.dense[r] == -1) {
+                    regs.dense[r] = regs.real.size();
+                    regs.real.push_back(r);
+                }
+            }
+        }
+        return regs;
+    }
+
+
+    int fold(OPCODE opcode, int a, int b) {
+        // arithmetic wraps around like it does on the CPU
+        switch (opcode) {
+            case IADD: return int((unsigned)a + (unsigned)b);
+            case ISUB: return int((unsigned)a - (unsigned)b);
+            case IMUL: return int((unsigned)a * (unsigned)b);
+            case IDIV: return a / b;
+            case ILT: return (a < b);
+            case ILTE: return (a <= b);
+            case IGT: return (a > b);
+            case IGTE: return (a >= b);
+            case IEQ: return (a == b);
+            default: return 0;
+        }
+    }
+
+    bool foldable(OPCODE opcode, const Value& a, const Value& b) {
+        if (not (a.constant(INTEGER_TYPE) and b.constant(INTEGER_TYPE))) { return false; }
+        if (opcode == IDIV) { return (b.value != 0 and not (a.value == INT_MIN and b.value == -1)); }
+        return true;
+    }
+
+    bool infallible(const Operation& op, const Effects& e, const State& state, const Registers& regs) {
+        /** Checks if an operation writing a single register can not fail at run time
+         *  (by reading an empty register, or dividing by zero).
+         *
+         *  Only such operations may be removed or moved by the optimiser as
+         *  it must not remove (or introduce) failures.
+         */
+        if (e.opaque or e.def_count != 1) { return false; }
+
+        auto value = [&state, &regs] (const int_op& o) -> const Value& { return state[regs.dense[regof(o)]]; };
+        const int_op* ops = op.operands;
+        switch (op.opcode) {
+            case ISTORE:
+                return (not isref(ops[1]) or value(ops[1]).integer());
+            case BSTORE:
+                return true;
+            case IADD: case ISUB: case IMUL:
+            case ILT: case ILTE: case IGT: case IGTE: case IEQ:
+                return (value(ops[0]).integer() and value(ops[1]).integer());
+            case IDIV:
+                return (value(ops[0]).integer() and value(ops[1]).constant(INTEGER_TYPE) and value(ops[1]).value != 0 and value(ops[1]).value != -1);
+            case AND: case OR:
+                return (value(ops[0]).present() and value(ops[1]).present());
+            case NOT: case COPY:
+                return value(ops[0]).present();
+            case IINC: case IDEC: case RET:
+                return value(ops[0]).integer();
+            default:
+                return false;
+        }
+    }
+
+
+    Value meet(const Value& a, const Value& b) {
+        if (a.kind == UNREACHED) { return b; }
+        if (b.kind == UNREACHED) { return a; }
+
+        Value v;
+        if (a.kind == CONSTANT and b.kind == CONSTANT and a.type == b.type and a.value == b.value) {
+            v.kind = CONSTANT;
+            v.value = a.value;
+        } else if (a.present() and b.present()) {
+            v.kind = DEFINED;
+        } else {
+            v.kind = UNKNOWN;
+        }
+        v.type = (a.type == b.type ? a.type : ANY_TYPE);
+        v.copy = (a.copy == b.copy ? a.copy : -1);
+        return v;
+    }
+
+    void assign(State& state, int reg, Value value) {
+        /*  Writes a value to a register.
+         *  Registers which were copies of the overwritten value are no longer copies.
+         */
+        for (unsigned i = 0; i < state.size(); ++i) {
+            if (state[i].copy == reg) { state[i].copy = -1; }
+        }
+        if (value.copy == reg) { value.copy = -1; }
+        state[reg] = value;
+    }
+
+
+    bool Dataflow::reached(int block) const {
+        return reachable[block];
+    }
+
+    void Dataflow::transfer(const Operation& op, const Effects& e, State& state) const {
+        /** Applies effects of a single operation to the state.
+         */
+        if (e.opaque) {
+            for (unsigned i = 0; i < state.size(); ++i) { state[i] = Value(UNKNOWN); }
+            return;
+        }
+
+        auto dense = [this] (const int_op& o) { return regs.dense[regof(o)]; };
+
+        // a register that was read without failure is not empty
+        // (second operands of `and` and `or` are not always read, `move` and `swap` do not read values at all)
+        unsigned read = ((op.opcode == AND or op.opcode == OR) ? 1 : e.use_count);
+        if (op.opcode == MOVE or op.opcode == SWAP) { read = 0; }
+        for (unsigned i = 0; i < read; ++i) {
+            Value& v = state[regs.dense[e.uses[i]]];
+            if (v.kind == UNKNOWN) { v.kind = DEFINED; }
+        }
+
+        const int_op* ops = op.operands;
+        Value result;
+        switch (op.opcode) {
+            case ISTORE:
+                if (isref(ops[1])) {
+                    int src = dense(ops[1]);
+                    const Value& s = state[src];
+                    result = (s.integer() ? s : Value(DEFINED, INTEGER_TYPE));
+                    result.copy = (s.integer() ? (s.copy >= 0 ? s.copy : src) : -1);
+                } else {
+                    result = Value(CONSTANT, INTEGER_TYPE, regof(ops[1]));
+                }
+                assign(state, dense(ops[0]), result);
+                break;
+            case IADD: case ISUB: case IMUL: case IDIV:
+            case ILT: case ILTE: case IGT: case IGTE: case IEQ: {
+                const Value& a = state[dense(ops[0])];
+                const Value& b = state[dense(ops[1])];
+                ValueType type = ((op.opcode >= ILT) ? BOOLEAN_TYPE : INTEGER_TYPE);
+                result = (foldable(op.opcode, a, b) ? Value(CONSTANT, type, fold(op.opcode, a.value, b.value)) : Value(DEFINED, type));
+                assign(state, dense(ops[2]), result);
+                break;
+            }
+            case AND: case OR: {
+                const Value& a = state[dense(ops[0])];
+                const Value& b = state[dense(ops[1])];
+                if (a.kind == CONSTANT and b.kind == CONSTANT) {
+                    bool r = (op.opcode == AND ? (a.value and b.value) : (a.value or b.value));
+                    result = Value(CONSTANT, BOOLEAN_TYPE, r);
+                } else {
+                    result = Value(DEFINED, BOOLEAN_TYPE);
+                }
+                assign(state, dense(ops[2]), result);
+                break;
+            }
+            case NOT: {
+                const Value& a = state[dense(ops[0])];
+                result = (a.kind == CONSTANT ? Value(CONSTANT, BOOLEAN_TYPE, not a.value) : Value(DEFINED, BOOLEAN_TYPE));
+                assign(state, dense(ops[0]), result);
+                break;
+            }
+            case IINC: case IDEC: {
+                const Value& a = state[dense(ops[0])];
+                int delta = (op.opcode == IINC ? 1 : -1);
+                result = (a.constant(INTEGER_TYPE) ? Value(CONSTANT, INTEGER_TYPE, int((unsigned)a.value + delta)) : Value(DEFINED, a.type));
+                assign(state, dense(ops[0]), result);
+                break;
+            }
+            case BSTORE:
+                assign(state, dense(ops[0]), Value(CONSTANT, BYTE_TYPE, (char)get<1>(op.byte_operand)));
+                break;
+            case MOVE: {
+                int a = dense(ops[0]), b = dense(ops[1]);
+                result = state[a];
+                assign(state, a, Value(UNKNOWN));
+                if (a != b) { assign(state, b, result); }
+                break;
+            }
+            case COPY: {
+                int a = dense(ops[0]);
+                result = state[a];
+                result.copy = (result.copy >= 0 ? result.copy : a);
+                assign(state, dense(ops[1]), result);
+                break;
+            }
+            case SWAP: {
+                int a = dense(ops[0]), b = dense(ops[1]);
+                Value tmp = state[a];
+                state[a] = state[b];
+                state[b] = tmp;
+                for (unsigned i = 0; i < state.size(); ++i) {
+                    if (state[i].copy == a) { state[i].copy = b; }
+                    else if (state[i].copy == b) { state[i].copy = a; }
+                }
+                if (state[a].copy == a) { state[a].copy = -1; }
+                if (state[b].copy == b) { state[b].copy = -1; }
+                break;
+            }
+            case RET: {
+                int a = dense(ops[0]);
+                const Value& s = state[a];
+                result = (s.integer() ? s : Value(DEFINED, INTEGER_TYPE));
+                result.copy = (s.integer() ? (s.copy >= 0 ? s.copy : a) : -1);
+                assign(state, regs.dense[0], result);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    void Dataflow::run() {
+        /** Computes entry states of all blocks with a worklist algorithm.
+         *  Registers are empty when a program starts, so at the entry nothing is known about them.
+         */
+        entry.assign(graph.blocks.size(), State(regs.size()));
+        reachable.assign(graph.blocks.size(), false);
+        vector<bool> queued(graph.blocks.size(), false);
+
+        entry[0].assign(regs.size(), Value(UNKNOWN));
+        reachable[0] = queued[0] = true;
+        deque<int> worklist(1, 0);
+
+        while (worklist.size()) {
+            int b = worklist.front();
+            worklist.pop_front();
+            queued[b] = false;
+
+            const Block& block = graph.blocks[b];
+            State state = entry[b];
+            for (int i = block.first; i <= block.last; ++i) { transfer(operations[i], fx[i], state); }
+
+            for (int s : block.successors) {
+                bool changed = false;
+                if (not reachable[s]) {
+                    entry[s] = state;
+                    reachable[s] = changed = true;
+                } else {
+                    for (unsigned r = 0; r < state.size(); ++r) {
+                        Value v = meet(entry[s][r], state[r]);
+                        if (v != entry[s][r]) {
+                            entry[s][r] = v;
+                            changed = true;
+                        }
+                    }
+                }
+                if (changed and not queued[s]) {
+                    queued[s] = true;
+                    worklist.push_back(s);
+                }
+            }
+        }
+    }
+
+
+    vector<bool> Liveness::exit(int block) const {
+        /** Registers live at the exit of a block.
+         */
+        vector<bool> live(regs.size(), false);
+        for (int s : graph.blocks[block].successors) {
+            for (unsigned r = 0; r < regs.size(); ++r) { if (entry[s][r]) { live[r] = true; } }
+        }
+        return live;
+    }
+
+    void Liveness::step(int index, vector<bool>& live) const {
+        /** Turns registers live after an operation into registers live before it.
+         */
+        const Effects& e = fx[index];
+        if (e.opaque) {
+            live.assign(regs.size(), true);
+            return;
+        }
+        if (operations[index].opcode == HALT and regs.dense[0] >= 0) { live[regs.dense[0]] = true; }
+        for (unsigned d = 0; d < e.def_count; ++d) { live[regs.dense[e.defs[d]]] = false; }
+        for (unsigned u = 0; u < e.use_count; ++u) { live[regs.dense[e.uses[u]]] = true; }
+    }
+
+    void Liveness::run() {
+        /** Computes registers live at block entries, going backwards until nothing changes.
+         */
+        entry.assign(graph.blocks.size(), vector<bool>(regs.size(), false));
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int b = graph.blocks.size()-1; b >= 0; --b) {
+                const Block& block = graph.blocks[b];
+                vector<bool> live = exit(b);
+                for (int i = block.last; i >= block.first; --i) { step(i, live); }
+                if (live != entry[b]) {
+                    entry[b] = live;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
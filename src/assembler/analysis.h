@@ -0,0 +1,212 @@
+#ifndef WUDOO_ASSEMBLER_ANALYSIS_H
+#define WUDOO_ASSEMBLER_ANALYSIS_H
+
+#pragma once
+
+#include <vector>
+#include "assembler.h"
+
+
+namespace assembler {
+    inline bool isref(const int_op& op) { return std::get<0>(op); }
+    inline int regof(const int_op& op) { return std::get<1>(op); }
+
+    inline bool transfers(OPCODE opcode) {
+        return (opcode == JUMP or opcode == BRANCH or opcode == HALT);
+    }
+
+
+    bool normaliseTargets(std::vector<Operation>& operations);
+
+
+    /** Basic block of a program.
+     *
+     *  Block is a run of operations [first, last] which is entered only at its first operation and
+     *  left only after its last one.
+     *  Successors and predecessors are indexes of blocks.
+     *  Block without successors ends the program (it halts or falls off the end of bytecode).
+     */
+    struct Block {
+        int first;
+        int last;
+
+        std::vector<int> successors;
+        std::vector<int> predecessors;
+    };
+
+    /** Control flow graph of a program.
+     *
+     *  Blocks begin at the first operation, at every jump or branch target, and
+     *  after every operation that transfers control (jump, branch, halt).
+     *  First block is the entry of the program.
+     */
+    struct ControlFlowGraph {
+        std::vector<Block> blocks;
+
+        // operation index -> index of the block containing the operation
+        std::vector<int> block_of;
+    };
+
+    ControlFlowGraph buildControlFlowGraph(const std::vector<Operation>& operations);
+
+
+    /** Dominator tree of a control flow graph.
+     *
+     *  Block A dominates block B if every path from the entry to B goes through A.
+     *  Blocks unreachable from the entry have no immediate dominator (-1).
+     */
+    struct Dominators {
+        std::vector<int> idom;
+
+        bool dominates(int a, int b) const;
+    };
+
+    Dominators findDominators(const ControlFlowGraph& graph);
+
+
+    /** Natural loop.
+     *
+     *  Loop is found from its back-edges (edges from a block to a block dominating it).
+     *  All back-edges to the same header form a single loop.
+     *  Blocks are sorted, latches are blocks with back-edges to the header.
+     */
+    struct Loop {
+        int header;
+        std::vector<int> blocks;
+        std::vector<int> latches;
+
+        bool contains(int block) const;
+    };
+
+    std::vector<Loop> findLoops(const ControlFlowGraph& graph, const Dominators& dominators);
+
+
+    /** Registers read and written by an operation.
+     *
+     *  Operations with `@` operands choose their registers at run time (and so do
+     *  operations the optimiser does not know) so they are opaque - they are assumed to read and
+     *  write every register.
+     *  The only exception is `istore <reg> @<src>` which simply reads the value of <src>.
+     */
+    struct Effects {
+        int uses[3];
+        unsigned use_count;
+
+        int defs[2];
+        unsigned def_count;
+
+        bool opaque;
+    };
+
+    Effects effects(const Operation& op);
+    std::vector<Effects> effects(const std::vector<Operation>& operations);
+
+
+    /** Dense numbering of registers used by a program.
+     *  Analyses keep information only about registers that are actually used.
+     */
+    struct Registers {
+        std::vector<int> dense;     // register index -> dense index (or -1)
+        std::vector<int> real;      // dense index -> register index
+
+        unsigned size() const { return real.size(); }
+    };
+
+    Registers numberRegisters(const std::vector<Effects>& fx);
+
+
+    /** Values of registers tracked by dataflow analysis.
+     *
+     *  Value is either a known constant of a known type, or an unknown value that is known
+     *  to be present in the register (reading the register will not fail), or a completely
+     *  unknown value (the register may be empty).
+     *  A value may also be known to be a copy of another register, i.e.
+     *  equal to the value that register holds.
+     */
+    enum ValueKind : unsigned char {
+        UNREACHED,
+        CONSTANT,
+        DEFINED,
+        UNKNOWN,
+    };
+
+    enum ValueType : unsigned char {
+        ANY_TYPE,
+        INTEGER_TYPE,
+        BOOLEAN_TYPE,
+        BYTE_TYPE,
+    };
+
+    struct Value {
+        ValueKind kind;
+        ValueType type;
+        int value;
+        int copy;   // dense index of register this value is a copy of (or -1)
+
+        bool present() const { return (kind == CONSTANT or kind == DEFINED); }
+        bool integer() const { return (present() and type == INTEGER_TYPE); }
+        bool constant(ValueType t) const { return (kind == CONSTANT and type == t); }
+
+        bool operator==(const Value& that) const {
+            return (kind == that.kind and type == that.type and value == that.value and copy == that.copy);
+        }
+        bool operator!=(const Value& that) const { return not (*this == that); }
+
+        Value(ValueKind k = UNREACHED, ValueType t = ANY_TYPE, int v = 0): kind(k), type(t), value(v), copy(-1) {}
+    };
+
+    typedef std::vector<Value> State;
+
+    int fold(OPCODE opcode, int a, int b);
+    bool foldable(OPCODE opcode, const Value& a, const Value& b);
+
+    bool infallible(const Operation& op, const Effects& e, const State& state, const Registers& regs);
+
+
+    class Dataflow {
+        /** Forward analysis of register values over the control flow graph of a program.
+         *
+         *  After run() every reachable block has its entry state computed.
+         *  States inside a block are obtained by applying transfer() to the operations of the block.
+         */
+        const std::vector<Operation>& operations;
+        const std::vector<Effects>& fx;
+        const Registers& regs;
+
+        std::vector<bool> reachable;
+
+        public:
+            const ControlFlowGraph& graph;
+            std::vector<State> entry;
+
+            bool reached(int block) const;
+            void transfer(const Operation& op, const Effects& e, State& state) const;
+            void run();
+
+            Dataflow(const std::vector<Operation>& o, const std::vector<Effects>& e, const Registers& r, const ControlFlowGraph& g): operations(o), fx(e), regs(r), graph(g) {}
+    };
+
+    class Liveness {
+        /** Backward analysis of live registers, i.e. registers whose values may still be read.
+         *
+         *  At `halt` register 0 is live (it holds exit code of the program).
+         *  Opaque operations may read any register.
+         */
+        const std::vector<Operation>& operations;
+        const std::vector<Effects>& fx;
+        const Registers& regs;
+
+        public:
+            const ControlFlowGraph& graph;
+            std::vector<std::vector<bool> > entry;
+
+            std::vector<bool> exit(int block) const;
+            void step(int index, std::vector<bool>& live) const;
+            void run();
+
+            Liveness(const std::vector<Operation>& o, const std::vector<Effects>& e, const Registers& r, const ControlFlowGraph& g): operations(o), fx(e), regs(r), graph(g) {}
+    };
+}
+
+
+#endif
@@ -0,0 +1,498 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
+#include "../bytecode/maps.h"
+#include "../program.h"
+#include "../debuginfo.h"
+#include "lexer.h"
+#include "assembler.h"
+#include "optimiser.h"
+using namespace std;
+using lexer::Token;
+
+
+struct Mnemonic {
+    OPCODE opcode;
+    unsigned size;
+};
+
+typedef unordered_map<Token, Mnemonic, lexer::TokenHash, lexer::TokenEqual> MnemonicTable;
+
+MnemonicTable buildMnemonics() {
+    /*  Builds a table of instruction mnemonics.
+     *  It is keyed by tokens pointing to names stored in OP_NAMES so
+     *  looking a mnemonic up does not allocate.
+     */
+    MnemonicTable table;
+    for (auto& op : OP_NAMES) {
+        Mnemonic m;
+        m.opcode = op.first;
+        m.size = OP_SIZES.at(op.second);
+        table[Token(op.second.c_str(), op.second.size())] = m;
+    }
+    return table;
+}
+
+const MnemonicTable& mnemonics() {
+    // initialisation of function-local statics is thread-safe
+    static const MnemonicTable table = buildMnemonics();
+    return table;
+}
+
+
+string located(const string& filename, const Token& token, const string& message) {
+    /*  Prefixes an error message with location of the token which caused it.
+     */
+    ostringstream oss;
+    oss << filename << ':' << token.line << ':' << token.column << ": " << message;
+    return oss.str();
+}
+
+
+int resolvejump(const Token& jmp, const assembler::TokenMap& marks, const string& filename) {
+    /*  This function is used to resolve jumps in `jump`, `branch` and `spawn` instructions.
+     *
+     *  Jump can be written either as an instruction index, or as a marker name
+     *  preceded by a colon.
+     */
+    int addr = 0;
+    if (jmp.empty()) {
+        throw located(filename, jmp, "missing jump target");
+    }
+    if (!lexer::toint(jmp, addr)) {
+        Token mark = jmp.sub(1);
+        auto found = marks.find(mark);
+        if (found == marks.end()) {
+            throw located(filename, jmp, ("jump to unrecognised marker: " + mark.str()));
+        }
+        addr = found->second;
+    }
+    return addr;
+}
+
+int_op getint_op(const Token& reg, const assembler::TokenMap& names, const string& filename) {
+    /*  This function is used to resolve integer operands when a register is accessed, e.g.
+     *  in `istore` instruction or in `branch` in condition operand.
+     *
+     *  Operand may be a register index or a name declared with `.name:`, and
+     *  either of them may be preceded by `@` to take the register index from another register.
+     */
+    if (reg.empty()) {
+        throw located(filename, reg, "missing operand");
+    }
+
+    bool ref = (reg[0] == '@');
+    Token operand = (ref ? reg.sub(1) : reg);
+
+    int num = 0;
+    if (lexer::isnum(operand)) {
+        /*  Basic case - the register is accessed as real index, everything is nice and simple.
+         */
+        if (!lexer::toint(operand, num)) {
+            throw located(filename, reg, ("integer operand out of range: " + reg.str()));
+        }
+    } else {
+        /*  Case is no longer basic - it seems that a register is being accessed by name.
+         *  Names must be checked to see if the one used was declared.
+         */
+        auto found = names.find(operand);
+        if (found == names.end()) {
+            // Jinkies! This name was not declared.
+            throw located(filename, reg, ("undeclared name: " + operand.str()));
+        }
+        num = found->second;
+    }
+    return int_op(ref, num);
+}
+
+byte_op getbyte_op(const Token& reg, const assembler::TokenMap& names, const string& filename) {
+    bool ref;
+    int num;
+    tie(ref, num) = getint_op(reg, names, filename);
+    return byte_op(ref, (byte)(char)num);
+}
+
+
+/*  This is a mapping of instructions to their assembly functions.
+ *  Used in the assembly() function.
+ *
+ *  It is suitable for all instructions which use three, simple register-index operands.
+ *  Similar mappings for instructions with two and one such operands follow.
+ *
+ *  BE WARNED!
+ *  These mappings *seriously* reduce the amount of code repetition
+ *  in the assembler but are kinda black voodoo magic...
+ *
+ *  NOTE TO FUTURE SELF:
+ *  If you feel comfortable with taking pointers of member functions and calling such things - go on.
+ *  Otherwise, it may be better to leave this alone until your have refreshed your memory.
+ *  Here is isocpp.org's FAQ about pointers to members (2015-01-17): https://isocpp.org/wiki/faq/pointers-to-members
+ */
+typedef Program& (Program::*ThreeIntopAssemblerFunction)(int_op, int_op, int_op);
+const map<OPCODE, ThreeIntopAssemblerFunction> THREE_INTOP_ASM_FUNCTIONS = {
+    { IADD, &Program::iadd },
+    { ISUB, &Program::isub },
+    { IMUL, &Program::imul },
+    { IDIV, &Program::idiv },
+    { ILT, &Program::ilt },
+    { ILTE, &Program::ilte },
+    { IGT, &Program::igt },
+    { IGTE, &Program::igte },
+    { IEQ, &Program::ieq },
+
+    { AND, &Program::logand },
+    { OR, &Program::logor },
+};
+
+typedef Program& (Program::*TwoIntopAssemblerFunction)(int_op, int_op);
+const map<OPCODE, TwoIntopAssemblerFunction> TWO_INTOP_ASM_FUNCTIONS = {
+    { ISTORE, &Program::istore },
+    { MOVE, &Program::move },
+    { COPY, &Program::copy },
+    { REF, &Program::ref },
+    { SWAP, &Program::swap },
+
+    { CHAN, &Program::chan },
+    { SEND, &Program::send },
+    { RECV, &Program::recv },
+};
+
+typedef Program& (Program::*OneIntopAssemblerFunction)(int_op);
+const map<OPCODE, OneIntopAssemblerFunction> ONE_INTOP_ASM_FUNCTIONS = {
+    { IINC, &Program::iinc },
+    { IDEC, &Program::idec },
+    { NOT, &Program::lognot },
+    { RET, &Program::ret },
+    { PRINT, &Program::print },
+    { ECHO, &Program::echo },
+};
+
+
+namespace assembler {
+    Scan scan(const char* data, size_t size, const string& filename, bool debug, unsigned first_line) {
+        /** Scan source once and gather everything that is needed to encode it.
+         *
+         *  In this single pass the scanner:
+         *
+         *      * skips empty lines and comments (this is done by the lexer),
+         *      * recognises instructions and counts bytes required to hold the program,
+         *      * gathers "marks", i.e. `.mark: <name>` directives which may be used by
+         *        `jump` and `branch` instructions,
+         *      * gathers "names", i.e. `.name: <register> <name>` directives which may be used
+         *        as substitutes for register indexes,
+         *
+         *  Marks are stored as instruction indexes.
+         *  When referring to a mark in code, you should use: `jump :<name>`.
+         *  The colon before name of the marker is placed here to make it possible to use numeric markers
+         *  which would otherwise be treated as instruction indexes.
+         *
+         *  Names are global to the file - a name may be used before its `.name:` directive appears.
+         *  Example name instruction: `.name: 1 base`.
+         *  This allows to access first register with name `base` instead of its index.
+         */
+        Scan scanned;
+        const MnemonicTable& table = mnemonics();
+
+        lexer::Lexer lex(data, size, first_line);
+        lexer::Line line;
+
+        // a rough guess of one instruction per 16 bytes of source avoids most reallocations
+        scanned.instructions.reserve(size / 16);
+
+        /*  Directives may be written with or without a space after the colon
+         *  (`.mark: foo` and `.mark:foo`) so their operands are collected
+         *  regardless of where the first token ends.
+         */
+        Token operands[lexer::MAX_LINE_TOKENS];
+        unsigned count;
+
+        if (debug) { cout << "scanning:" << '\n'; }
+        while (lex.next(line)) {
+            Token first = line.tokens[0];
+
+            bool mark = first.startswith(".mark:");
+            bool name = first.startswith(".name:");
+            if (mark or name) {
+                count = 0;
+                if (first.length > 6) { operands[count++] = first.sub(6); }
+                for (unsigned i = 1; i < line.count; ++i) { operands[count++] = line.tokens[i]; }
+
+                if (mark) {
+                    if (count < 1) { throw located(filename, first, "missing name in .mark instruction"); }
+                    if (debug) { cout << " *  marker: `" << operands[0] << "` -> " << scanned.instructions.size() << endl; }
+                    scanned.marks[operands[0]] = scanned.instructions.size();
+                } else {
+                    int reg;
+                    if (count < 2) { throw located(filename, first, "missing operands in .name instruction"); }
+                    if (!lexer::toint(operands[0], reg)) {
+                        throw located(filename, operands[0], "invalid register index in .name instruction");
+                    }
+                    if (debug) { cout << " *  name: `" << operands[1] << "` -> " << reg << endl; }
+                    scanned.names[operands[1]] = reg;
+                }
+                continue;
+            }
+
+            auto found = table.find(first);
+            if (found == table.end()) {
+                throw located(filename, first, ("unrecognised instruction: `" + first.str() + '`'));
+            }
+
+            Instruction instruction;
+            instruction.opcode = found->second.opcode;
+            instruction.line = line;
+            scanned.instructions.push_back(instruction);
+            scanned.bytes += found->second.size;
+        }
+        if (debug) { cout << endl; }
+
+        return scanned;
+    }
+
+    Operation decode(const Instruction& instruction, int index, const TokenMap& marks, const TokenMap& names, const string& filename) {
+        /** Decode a scanned instruction into an operation.
+         *
+         *  Register operands are resolved (names are looked up) and so are jump targets (marks are looked up), so
+         *  every error in operands is reported here.
+         *
+         *  :params:
+         *
+         *  instruction     - instruction found by the scanning pass
+         *  index           - index of the instruction in the whole program
+         *  marks, names    - marks and names to resolve operands with
+         */
+        const lexer::Line& line = instruction.line;
+        OPCODE opcode = instruction.opcode;
+
+        Operation operation;
+        operation.opcode = opcode;
+        operation.line = line.number;
+
+        /*  Operands missing from the line are empty tokens.
+         *  Empty tokens carry location of the mnemonic so errors about them point to the right line.
+         */
+        Token ops[3];
+        for (unsigned i = 0; i < 3; ++i) {
+            ops[i] = (i+1 < line.count ? line.tokens[i+1] : Token(line.tokens[0].begin, 0, line.number, line.tokens[0].column));
+        }
+
+        if (THREE_INTOP_ASM_FUNCTIONS.count(opcode)) {
+            /*  If the third operand is omitted, the first one is used in its place, e.g.
+             *  `iadd 1 2` is the same as `iadd 1 2 1`.
+             */
+            Token regr = (ops[2].empty() ? ops[0] : ops[2]);
+
+            operation.operands[0] = getint_op(ops[0], names, filename);
+            operation.operands[1] = getint_op(ops[1], names, filename);
+            operation.operands[2] = getint_op(regr, names, filename);
+        } else if (TWO_INTOP_ASM_FUNCTIONS.count(opcode)) {
+            operation.operands[0] = getint_op(ops[0], names, filename);
+            operation.operands[1] = getint_op(ops[1], names, filename);
+        } else if (ONE_INTOP_ASM_FUNCTIONS.count(opcode)) {
+            operation.operands[0] = getint_op(ops[0], names, filename);
+        } else if (opcode == BSTORE) {
+            operation.operands[0] = getint_op(ops[0], names, filename);
+            operation.byte_operand = getbyte_op(ops[1], names, filename);
+        } else if (opcode == BRANCH) {
+            /*  If branch is given three operands, it means its full, three-operands form is being used.
+             *  Otherwise, it is short, two-operands form instruction and assembler should fill third operand accordingly.
+             *
+             *  In case of short-form `branch` instruction:
+             *
+             *      * first operand is index of the register to check,
+             *      * second operand is the address to which to jump if register is true,
+             *      * third operand is assumed to be the *next instruction*, i.e. instruction after the branch instruction,
+             *
+             *  In full (with three operands) form of `branch` instruction:
+             *
+             *      * third operands is the address to which to jump if register is false,
+             */
+            operation.targets[0] = resolvejump(ops[1], marks, filename);
+            operation.targets[1] = (ops[2].empty() ? index+1 : resolvejump(ops[2], marks, filename));
+            operation.operands[0] = getint_op(ops[0], names, filename);
+        } else if (opcode == JUMP) {
+            /*  Jump instruction can be written in two forms:
+             *
+             *      * `jump <index>`
+             *      * `jump :<marker>`
+             *
+             *  Assembler must distinguish between these two forms, and so it does.
+             *  If the jump is numeric it is an index, otherwise
+             *  it is considered a marker jump.
+             *
+             *  If it is a marker jump, assembler will look the marker up in a map and
+             *  if it is not found throw an exception about unrecognised marker being used.
+             */
+            operation.targets[0] = resolvejump(ops[0], marks, filename);
+        } else if (opcode == SPAWN) {
+            /*  `spawn <register> <instruction>` starts a new process at given instruction (index or `:<marker>`).
+             *  Value of the register is copied to the new process.
+             */
+            operation.operands[0] = getint_op(ops[0], names, filename);
+            operation.targets[0] = resolvejump(ops[1], marks, filename);
+        } else if (opcode == TRYRECV) {
+            /*  `tryrecv <channel> <register> <flag>` - unlike in arithmetic instructions the third operand
+             *  can not default to the first one (it would overwrite the channel), so all three are required.
+             */
+            operation.operands[0] = getint_op(ops[0], names, filename);
+            operation.operands[1] = getint_op(ops[1], names, filename);
+            operation.operands[2] = getint_op(ops[2], names, filename);
+        } else if (opcode == PASS or opcode == HALT or opcode == YIELD) {
+            // no operands
+        } else {
+            /*  Instruction is known to the scanning pass (it has a size) but
+             *  Bytecode Programming API can not produce it yet.
+             *  Silently skipping it would shift every instruction after it so it is an error.
+             */
+            throw located(filename, line.tokens[0], ("instruction not supported by assembler: `" + line.tokens[0].str() + '`'));
+        }
+        return operation;
+    }
+
+    void emit(Program& program, const Operation& operation) {
+        /** Emit a decoded operation into bytecode, using
+         *  Bytecode Programming API.
+         *
+         *  Jump and branch targets are passed to the program as instruction indexes and
+         *  are translated to bytecode offsets by Program::calculateBranches().
+         */
+        OPCODE opcode = operation.opcode;
+        const int_op* ops = operation.operands;
+
+        if (THREE_INTOP_ASM_FUNCTIONS.count(opcode)) {
+            // feed operands into Bytecode Programming API
+            (program.*THREE_INTOP_ASM_FUNCTIONS.at(opcode))(ops[0], ops[1], ops[2]);
+        } else if (TWO_INTOP_ASM_FUNCTIONS.count(opcode)) {
+            (program.*TWO_INTOP_ASM_FUNCTIONS.at(opcode))(ops[0], ops[1]);
+        } else if (ONE_INTOP_ASM_FUNCTIONS.count(opcode)) {
+            (program.*ONE_INTOP_ASM_FUNCTIONS.at(opcode))(ops[0]);
+        } else if (opcode == BSTORE) {
+            program.bstore(ops[0], operation.byte_operand);
+        } else if (opcode == BRANCH) {
+            program.branch(ops[0], operation.targets[0], operation.targets[1]);
+        } else if (opcode == JUMP) {
+            program.jump(operation.targets[0]);
+        } else if (opcode == SPAWN) {
+            program.spawn(ops[0], operation.targets[0]);
+        } else if (opcode == YIELD) {
+            program.yield();
+        } else if (opcode == TRYRECV) {
+            program.tryrecv(ops[0], ops[1], ops[2]);
+        } else if (opcode == PASS) {
+            program.pass();
+        } else if (opcode == HALT) {
+            program.halt();
+        } else {
+            throw "instruction not supported by assembler";
+        }
+    }
+
+    void encode(Program& program, const vector<Instruction>& instructions, const TokenMap& marks, const TokenMap& names, int first_instruction, const string& filename, bool debug) {
+        /** Encode instructions into bytecode.
+         *
+         *  :params:
+         *
+         *  program             - program object which will be used for assembling
+         *  instructions        - instructions found by the scanning pass
+         *  marks, names        - marks and names to resolve operands with
+         *  first_instruction   - index of the first instruction in the whole program
+         *                        (non-zero when a part of a program is encoded)
+         */
+        if (debug) { cout << "assembling:" << '\n'; }
+
+        for (unsigned i = 0; i < instructions.size(); ++i) {
+            /*  This is main assembly loop.
+             *  It iterates over scanned instructions, decodes them and
+             *  emits the bytecode.
+             */
+            int instruction = first_instruction + i;
+            if (debug) { cout << " *  assemble: " << filename << ':' << instructions[i].line.number << ":+" << instruction << ": " << instructions[i].line.tokens[0] << '\n'; }
+            emit(program, decode(instructions[i], instruction, marks, names, filename));
+        }
+        if (debug) { cout << endl; }
+    }
+
+    void assemble(Program& program, const Scan& scanned, const string& filename, bool debug, bool optimised, const Profile* profile, DebugInfo* info) {
+        /** Assemble the scanned instructions into bytecode.
+         *
+         *  When optimised assembly is requested, the whole program is decoded first and
+         *  passed through the optimiser before any bytecode is emitted.
+         *  When a branch profile is given, the decoded program is first laid out according to it.
+         *  When `info` is given, it is filled with debug information of the assembled program.
+         */
+        vector<unsigned> scanned_lines;
+        if (info) {
+            scanned_lines.reserve(scanned.instructions.size());
+            for (const Instruction& instruction : scanned.instructions) { scanned_lines.push_back(instruction.line.number); }
+        }
+
+        if (not optimised and not profile) {
+            encode(program, scanned.instructions, scanned.marks, scanned.names, 0, filename, debug);
+            if (info) { describe(*info, program, scanned_lines, scanned_lines, scanned.marks, scanned.names, filename); }
+            return;
+        }
+
+        vector<Operation> operations;
+        operations.reserve(scanned.instructions.size());
+        for (unsigned i = 0; i < scanned.instructions.size(); ++i) {
+            operations.push_back(decode(scanned.instructions[i], i, scanned.marks, scanned.names, filename));
+        }
+
+        if (profile) { layout(operations, *profile, debug); }
+        if (optimised) { optimise(operations, scanned.names, debug); }
+
+        if (debug) { cout << "assembling:" << '\n'; }
+        for (unsigned i = 0; i < operations.size(); ++i) {
+            if (debug) { cout << " *  assemble: " << filename << ':' << operations[i].line << ":+" << i << ": " << OP_NAMES.at(operations[i].opcode) << '\n'; }
+            emit(program, operations[i]);
+        }
+        if (debug) { cout << endl; }
+
+        if (info) {
+            vector<unsigned> lines;
+            lines.reserve(operations.size());
+            for (const Operation& operation : operations) { lines.push_back(operation.line); }
+            describe(*info, program, lines, scanned_lines, scanned.marks, scanned.names, filename);
+        }
+    }
+
+    void describe(DebugInfo& info, Program& program, const vector<unsigned>& lines, const vector<unsigned>& scanned_lines, const TokenMap& marks, const TokenMap& names, const string& filename) {
+        /** Instructions described by `lines` are the last ones in the program.
+         *
+         *  Marks refer to scanned instructions, which the optimiser may have moved or removed, so
+         *  a mark is placed at the first emitted instruction coming from its line (or the nearest line after it).
+         *  Marks after the last instruction do not point at any code and are left out.
+         */
+        vector<int> offsets = program.instructionOffsets();
+        if (offsets.size() < lines.size()) { throw "cannot describe program: more lines than instructions"; }
+        unsigned first = offsets.size() - lines.size();
+
+        info.file = filename;
+        info.lines.clear();
+        info.marks.clear();
+        info.names.clear();
+
+        map<unsigned, uint32_t> line_offsets;
+        info.lines.reserve(lines.size());
+        for (unsigned i = 0; i < lines.size(); ++i) {
+            uint32_t offset = offsets[first + i];
+            info.lines.push_back(DebugInfo::Line{offset, lines[i]});
+            line_offsets.insert(make_pair(lines[i], offset));
+        }
+
+        for (auto& mark : marks) {
+            if (mark.second < 0 or unsigned(mark.second) >= scanned_lines.size()) { continue; }
+            auto found = line_offsets.lower_bound(scanned_lines[mark.second]);
+            if (found == line_offsets.end()) { continue; }
+            info.marks.push_back(make_pair(found->second, mark.first.str()));
+        }
+        sort(info.marks.begin(), info.marks.end());
+
+        for (auto& name : names) { info.names.push_back(make_pair(name.second, name.first.str())); }
+        sort(info.names.begin(), info.names.end());
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef WUDOO_ASSEMBLER_ASSEMBLER_H
+#define WUDOO_ASSEMBLER_ASSEMBLER_H
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "../bytecode/opcodes.h"
+#include "../program.h"
+#include "../debuginfo.h"
+#include "lexer.h"
+
+
+namespace assembler {
+    typedef std::unordered_map<lexer::Token, int, lexer::TokenHash, lexer::TokenEqual> TokenMap;
+
+    /** Instruction line found by the scanning pass.
+     *
+     *  First token of the line is the mnemonic, the rest are operands.
+     *  Tokens point into the source buffer, so it must be kept alive until
+     *  the instructions are assembled.
+     */
+    struct Instruction {
+        OPCODE opcode;
+        lexer::Line line;
+    };
+
+    /** Result of the scanning pass over source.
+     *
+     *  Scanning is done once and gathers everything the encoding pass needs to
+     *  emit bytecode without looking at the source again:
+     *
+     *      * instruction lines (with comments, empty lines and assembler directives removed),
+     *      * markers and names,
+     *      * size of the program in bytes,
+     */
+    struct Scan {
+        std::vector<Instruction> instructions;
+
+        TokenMap marks;
+        TokenMap names;
+
+        int bytes;
+
+        Scan(): bytes(0) {}
+    };
+
+    /** Instruction with its operands resolved.
+     *
+     *  Names are replaced with register indexes and marks with instruction indexes, so
+     *  an operation no longer depends on the source it was decoded from.
+     *  This is the form in which the optimiser works on a program.
+     */
+    struct Operation {
+        OPCODE opcode;
+
+        // register operands, unused ones are zero
+        int_op operands[3];
+
+        // second operand of `bstore`
+        byte_op byte_operand;
+
+        // target of `jump`, or true and false targets of `branch` (instruction indexes)
+        int targets[2];
+
+        // source line the operation was decoded from
+        unsigned line;
+
+        Operation(): opcode(PASS), byte_operand(false, 0), line(0) {
+            for (unsigned i = 0; i < 3; ++i) { operands[i] = int_op(false, 0); }
+            targets[0] = targets[1] = 0;
+        }
+    };
+
+    /** Branch profile collected by running a program (`wudoo-run --branch-profile <file>`).
+     *
+     *  Bytecode offsets of executed jumps and branches are mapped to the number of times their
+     *  targets were taken (for jumps only the first counter is used).
+     *  Offsets refer to the program assembled without optimisations.
+     */
+    struct ProfileEntry {
+        bool conditional;
+        uint64_t taken[2];
+    };
+
+    struct Profile {
+        int bytes;
+        std::map<int, ProfileEntry> entries;
+
+        Profile(): bytes(0) {}
+    };
+
+    Profile loadProfile(const std::string& path);
+    void layout(std::vector<Operation>& operations, const Profile& profile, bool debug = false);
+
+    Scan scan(const char* data, size_t size, const std::string& filename, bool debug = false, unsigned first_line = 1);
+
+    Operation decode(const Instruction& instruction, int index, const TokenMap& marks, const TokenMap& names, const std::string& filename);
+    void emit(Program& program, const Operation& operation);
+
+    void encode(Program& program, const std::vector<Instruction>& instructions, const TokenMap& marks, const TokenMap& names, int first_instruction, const std::string& filename, bool debug = false);
+    void assemble(Program& program, const Scan& scanned, const std::string& filename, bool debug = false, bool optimised = false, const Profile* profile = 0, DebugInfo* info = 0);
+
+    void assembleParallel(Program& program, const char* data, size_t size, const std::string& filename, unsigned jobs, DebugInfo* info = 0);
+
+    /** Fill debug information of a program that has just been assembled.
+     *
+     *  `lines` are source lines of the instructions as they were emitted (i.e. after optimisation and layout), and
+     *  `scanned_lines` source lines of scanned instructions, which the indexes in `marks` refer to.
+     */
+    void describe(DebugInfo& info, Program& program, const std::vector<unsigned>& lines, const std::vector<unsigned>& scanned_lines, const TokenMap& marks, const TokenMap& names, const std::string& filename);
+}
+
+
+#endif
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../bytecode/maps.h"
+#include "../program.h"
+#include "assembler.h"
+#include "analysis.h"
+using namespace std;
+using namespace assembler;
+
+
+Profile assembler::loadProfile(const string& path) {
+    /** Read branch profile written by `wudoo-run --branch-profile`.
+     *  Throws on malformed profiles.
+     */
+    ifstream in(path);
+    if (!in) { throw ("branch profile could not be opened: " + path); }
+
+    Profile profile;
+    string line;
+    getline(in, line);
+    if (line != "wudoo branch profile") { throw ("not a branch profile: " + path); }
+
+    unsigned number = 1;
+    while (getline(in, line)) {
+        ++number;
+        if (line.empty()) { continue; }
+
+        istringstream fields(line);
+        string kind;
+        int offset = 0;
+        ProfileEntry entry;
+        entry.taken[0] = entry.taken[1] = 0;
+        fields >> kind;
+        if (kind == "bytes") {
+            fields >> profile.bytes;
+        } else if (kind == "jump" or kind == "branch") {
+            entry.conditional = (kind == "branch");
+            fields >> offset >> entry.taken[0];
+            if (entry.conditional) { fields >> entry.taken[1]; }
+            profile.entries[offset] = entry;
+        } else {
+            fields.setstate(ios::failbit);
+        }
+        if (fields.fail()) { throw (path + ":" + to_string(number) + ": malformed branch profile line"); }
+    }
+    return profile;
+}
+
+
+struct Chain {
+    /*  Blocks that are laid out one after another.
+     */
+    vector<int> blocks;
+    uint64_t hottest;
+    bool pinned_last;
+
+    Chain(): hottest(0), pinned_last(false) {}
+};
+
+struct Edge {
+    int from;
+    int to;
+    uint64_t weight;
+};
+
+
+void assembler::layout(vector<Operation>& operations, const Profile& profile, bool debug) {
+    /** Profile-guided layout of basic blocks.
+     *
+     *  Jumps and branches in the profile are matched with operations by their offsets in
+     *  the program assembled without optimisations, and
+     *  give execution counts of control flow edges.
+     *
+     *  Blocks are then joined into chains, hottest edges first:
+     *
+     *      * first by edges that cost a jump unless the target directly follows (jumps and fall-through),
+     *        so the hot ones become fall-through,
+     *      * then by branch edges, so hot targets of branches follow them
+     *        (a branch always names both targets, so this only changes which way it is "flipped" in the image),
+     *
+     *  Chain with the entry block is laid out first, then other chains from the hottest, and
+     *  blocks never executed go at the end of the image.
+     *  Jumps are added where a block no longer falls through to its successor, and
+     *  removed where a jump target now directly follows.
+     *
+     *  Throws if the profile does not match the program.
+     */
+    int n = operations.size();
+    if (n == 0) { return; }
+    for (const Operation& op : operations) {
+        // processes are not profiled and their entry points are not tracked by the layout
+        if (op.opcode == SPAWN) {
+            if (debug) { cout << "layout: skipped (program spawns processes)" << endl << endl; }
+            return;
+        }
+    }
+
+    // offsets of operations in the program assembled without optimisations
+    vector<int> offsets(n+1);
+    {
+        Program scratch;
+        for (int i = 0; i < n; ++i) {
+            offsets[i] = scratch.size();
+            emit(scratch, operations[i]);
+        }
+        offsets[n] = scratch.size();
+    }
+    if (profile.bytes != offsets[n]) {
+        throw string("branch profile does not match the program (was it collected for this program assembled without -O?)");
+    }
+
+    vector<const ProfileEntry*> counts(n, 0);
+    {
+        int i = 0;
+        for (auto entry : profile.entries) {
+            while (i < n and offsets[i] < entry.first) { ++i; }
+            bool matches = (i < n and offsets[i] == entry.first and
+                            operations[i].opcode == (entry.second.conditional ? BRANCH : JUMP));
+            if (not matches) {
+                throw ("branch profile does not match the program: no " + string(entry.second.conditional ? "branch" : "jump") +
+                       " at offset " + to_string(entry.first));
+            }
+            counts[i] = &profile.entries.at(entry.first);
+        }
+    }
+
+    if (not normaliseTargets(operations)) {
+        if (debug) { cout << "layout: skipped (jump targets out of bounds)" << endl << endl; }
+        return;
+    }
+
+    ControlFlowGraph graph = buildControlFlowGraph(operations);
+    unsigned B = graph.blocks.size();
+
+    // weights of edges leaving every block
+    auto weights = [&operations, &graph, &counts] (int b, const vector<uint64_t>& frequency) {
+        const Block& block = graph.blocks[b];
+        const Operation& last = operations[block.last];
+        vector<Edge> edges;
+        if (last.opcode == BRANCH) {
+            for (unsigned t = 0; t < 2; ++t) {
+                Edge e = { b, graph.block_of[last.targets[t]], (counts[block.last] ? counts[block.last]->taken[t] : 0) };
+                edges.push_back(e);
+            }
+        } else if (last.opcode == JUMP) {
+            Edge e = { b, graph.block_of[last.targets[0]], (counts[block.last] ? counts[block.last]->taken[0] : 0) };
+            edges.push_back(e);
+        } else if (last.opcode != HALT and block.last+1 < int(operations.size())) {
+            Edge e = { b, int(b+1), frequency[b] };
+            edges.push_back(e);
+        }
+        return edges;
+    };
+
+    // execution counts of blocks: known for blocks ending with jumps and branches, and
+    // computed from incoming edges for the others (fall-through edges only lead forward)
+    vector<uint64_t> frequency(B, 0);
+    for (unsigned b = 0; b < B; ++b) {
+        const Block& block = graph.blocks[b];
+        const ProfileEntry* c = counts[block.last];
+        if (c) { frequency[b] = c->taken[0] + c->taken[1]; }
+    }
+    for (unsigned b = 0; b < B; ++b) {
+        const Block& block = graph.blocks[b];
+        OPCODE opcode = operations[block.last].opcode;
+        if (opcode == JUMP or opcode == BRANCH) { continue; }
+        uint64_t incoming = (b == 0 ? 1 : 0);
+        for (int p : block.predecessors) {
+            for (const Edge& e : weights(p, frequency)) { if (e.to == int(b)) { incoming += e.weight; } }
+        }
+        frequency[b] = incoming;
+    }
+
+    vector<Edge> jump_edges, branch_edges;
+    uint64_t jumps_before = 0;
+    for (unsigned b = 0; b < B; ++b) {
+        OPCODE opcode = operations[graph.blocks[b].last].opcode;
+        for (const Edge& e : weights(b, frequency)) {
+            (opcode == BRANCH ? branch_edges : jump_edges).push_back(e);
+            if (opcode == JUMP) { jumps_before += e.weight; }
+        }
+    }
+    auto hotter = [] (const Edge& a, const Edge& b) { return a.weight > b.weight; };
+    stable_sort(jump_edges.begin(), jump_edges.end(), hotter);
+    stable_sort(branch_edges.begin(), branch_edges.end(), hotter);
+
+    // a block falling off the end of the program must stay at the end
+    int falls_off = -1;
+    {
+        const Operation& last = operations[n-1];
+        if (not transfers(last.opcode)) { falls_off = graph.block_of[n-1]; }
+    }
+
+    vector<Chain> chains(B);
+    vector<int> chain_of(B);
+    for (unsigned b = 0; b < B; ++b) {
+        chains[b].blocks.push_back(b);
+        chain_of[b] = b;
+    }
+    auto join = [&chains, &chain_of, falls_off] (const Edge& e) {
+        if (e.weight == 0 or e.to == 0 or e.to == falls_off) { return; }
+        int a = chain_of[e.from], b = chain_of[e.to];
+        if (a == b or chains[a].blocks.back() != e.from or chains[b].blocks.front() != e.to) { return; }
+        for (int block : chains[b].blocks) {
+            chains[a].blocks.push_back(block);
+            chain_of[block] = a;
+        }
+        chains[b].blocks.clear();
+    };
+    for (const Edge& e : jump_edges) { join(e); }
+    for (const Edge& e : branch_edges) { join(e); }
+
+    vector<Chain*> order;
+    for (Chain& chain : chains) {
+        if (chain.blocks.empty()) { continue; }
+        for (int b : chain.blocks) {
+            chain.hottest = max(chain.hottest, frequency[b]);
+            if (b == falls_off) { chain.pinned_last = true; }
+        }
+        if (chain.blocks.front() != 0) { order.push_back(&chain); }
+    }
+    stable_sort(order.begin(), order.end(), [] (const Chain* a, const Chain* b) {
+        if (a->pinned_last != b->pinned_last) { return b->pinned_last; }
+        return a->hottest > b->hottest;
+    });
+    order.insert(order.begin(), &chains[chain_of[0]]);
+
+    vector<int> placed;
+    for (const Chain* chain : order) { placed.insert(placed.end(), chain->blocks.begin(), chain->blocks.end()); }
+
+    // emit blocks in their new order; targets are block indexes until the end
+    vector<Operation> result;
+    vector<int> label(B);
+    uint64_t jumps_after = 0;
+    unsigned added = 0, removed = 0, moved = 0, cold = 0;
+    for (unsigned k = 0; k < placed.size(); ++k) {
+        int b = placed[k];
+        int next = (k+1 < placed.size() ? placed[k+1] : -1);
+        const Block& block = graph.blocks[b];
+        label[b] = result.size();
+        if (b != int(k)) { ++moved; }
+        if (frequency[b] == 0) { ++cold; }
+
+        for (int i = block.first; i <= block.last; ++i) {
+            Operation op = operations[i];
+            if (op.opcode == JUMP) {
+                op.targets[0] = graph.block_of[op.targets[0]];
+                if (i == block.last and op.targets[0] == next) {
+                    ++removed;
+                    continue;
+                }
+                jumps_after += (counts[i] ? counts[i]->taken[0] : 0);
+            } else if (op.opcode == BRANCH) {
+                op.targets[0] = graph.block_of[op.targets[0]];
+                op.targets[1] = graph.block_of[op.targets[1]];
+            }
+            result.push_back(op);
+        }
+
+        const Operation& last = operations[block.last];
+        if (not transfers(last.opcode) and b != falls_off and b+1 != next) {
+            Operation jump;
+            jump.opcode = JUMP;
+            jump.targets[0] = b+1;
+            jump.line = last.line;
+            result.push_back(jump);
+            jumps_after += frequency[b];
+            ++added;
+        }
+    }
+
+    for (Operation& op : result) {
+        if (op.opcode == JUMP) { op.targets[0] = label[op.targets[0]]; }
+        if (op.opcode == BRANCH) {
+            op.targets[0] = label[op.targets[0]];
+            op.targets[1] = label[op.targets[1]];
+        }
+    }
+    operations.swap(result);
+
+    if (debug) {
+        cout << "layout:" << '\n';
+        cout << " *  blocks: " << B << " (" << moved << " moved, " << cold << " never executed)" << '\n';
+        cout << " *  jumps: " << removed << " removed, " << added << " added" << '\n';
+        cout << " *  executed jumps (according to profile): " << jumps_before << " -> " << jumps_after << '\n';
+        cout << endl;
+    }
+}
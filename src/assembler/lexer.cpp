@@ -0,0 +1,180 @@
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "lexer.h"
+using namespace std;
+
+
+namespace lexer {
+    inline bool iswhitespace(char c) {
+        return (c == ' ' or c == '\t' or c == '\v' or c == '\r' or c == '\n');
+    }
+
+
+    Token Token::sub(unsigned b) const {
+        /*  Returns the part of the token starting at b-th character.
+         */
+        if (b > length) { b = length; }
+        return Token(begin+b, length-b, line, column+b);
+    }
+
+    bool Token::is(const char* s) const {
+        /*  Returns true if token is equal to s.
+         */
+        return (strlen(s) == length and memcmp(begin, s, length) == 0);
+    }
+
+    bool Token::startswith(const char* s) const {
+        /*  Returns true if token starts with s.
+         */
+        unsigned n = strlen(s);
+        return (n <= length and memcmp(begin, s, n) == 0);
+    }
+
+    string Token::str() const {
+        /*  Returns a copy of the token.
+         *  This allocates so it should only be used when reporting errors and debugging.
+         */
+        return string(begin, length);
+    }
+
+    ostream& operator<<(ostream& out, const Token& token) {
+        return out.write(token.begin, token.length);
+    }
+
+
+    size_t TokenHash::operator()(const Token& token) const {
+        /*  FNV-1a hash of token characters.
+         */
+        size_t h = 2166136261u;
+        for (unsigned i = 0; i < token.length; ++i) {
+            h ^= (unsigned char)token.begin[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    bool TokenEqual::operator()(const Token& a, const Token& b) const {
+        return (a.length == b.length and memcmp(a.begin, b.begin, a.length) == 0);
+    }
+
+
+    bool isnum(const Token& token) {
+        /*  Returns true if token is a (possibly negative) decimal number.
+         *  Regex equivalent: `^-?[0-9]+$`
+         */
+        unsigned start = (token.length and token.begin[0] == '-' ? 1 : 0);
+        if (start == token.length) { return false; }
+        for (unsigned i = start; i < token.length; ++i) {
+            if (token.begin[i] < '0' or token.begin[i] > '9') { return false; }
+        }
+        return true;
+    }
+
+    bool toint(const Token& token, int& out) {
+        /*  Parses token as a decimal integer.
+         *  Returns false (instead of throwing) if the token is not a number or
+         *  does not fit in an int.
+         */
+        if (!isnum(token)) { return false; }
+
+        bool negative = (token.begin[0] == '-');
+        long long n = 0;
+        for (unsigned i = (negative ? 1 : 0); i < token.length; ++i) {
+            n = n*10 + (token.begin[i] - '0');
+            if (n > (long long)INT_MAX + 1) { return false; }
+        }
+        if (negative) { n = -n; }
+        if (n > INT_MAX or n < INT_MIN) { return false; }
+
+        out = int(n);
+        return true;
+    }
+
+
+    Source::Source(const string& path): buffer(0), bytes(0), mapped(false), owned(false) {
+        /*  Opens a file and maps it into memory.
+         *  If the file can not be mapped (e.g. it is a pipe) it is read into a buffer instead.
+         */
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw "file could not be opened";
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 and S_ISREG(st.st_mode)) {
+            bytes = st.st_size;
+            if (bytes == 0) {
+                close(fd);
+                return;
+            }
+            void* addr = mmap(0, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                madvise(addr, bytes, MADV_SEQUENTIAL);
+                buffer = (const char*)addr;
+                mapped = true;
+                close(fd);
+                return;
+            }
+        }
+
+        size_t capacity = 4096;
+        char* tmp = new char[capacity];
+        bytes = 0;
+        ssize_t n;
+        while ((n = read(fd, tmp+bytes, capacity-bytes)) > 0) {
+            bytes += n;
+            if (bytes == capacity) {
+                char* grown = new char[capacity*2];
+                memcpy(grown, tmp, bytes);
+                delete[] tmp;
+                tmp = grown;
+                capacity *= 2;
+            }
+        }
+        close(fd);
+        buffer = tmp;
+        owned = true;
+    }
+
+    Source::~Source() {
+        if (mapped) {
+            munmap((void*)buffer, bytes);
+        } else if (owned) {
+            delete[] buffer;
+        }
+    }
+
+
+    bool Lexer::next(Line& out) {
+        /*  Lexes next non-empty, non-comment line into out.
+         *  Returns false when there are no more lines.
+         */
+        while (ptr < end) {
+            const char* eol = (const char*)memchr(ptr, '\n', end-ptr);
+            if (eol == 0) { eol = end; }
+
+            const char* line_begin = ptr;
+            unsigned number = line++;
+            ptr = (eol < end ? eol+1 : end);
+
+            const char* p = line_begin;
+            while (p < eol and iswhitespace(*p)) { ++p; }
+            if (p == eol or *p == ';') { continue; }
+
+            out.count = 0;
+            out.number = number;
+            while (p < eol and out.count < MAX_LINE_TOKENS) {
+                const char* token_begin = p;
+                while (p < eol and !iswhitespace(*p)) { ++p; }
+                out.tokens[out.count++] = Token(token_begin, p-token_begin, number, (token_begin-line_begin)+1);
+                while (p < eol and iswhitespace(*p)) { ++p; }
+            }
+            return true;
+        }
+        return false;
+    }
+}
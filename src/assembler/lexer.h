@@ -0,0 +1,108 @@
+#ifndef WUDOO_ASSEMBLER_LEXER_H
+#define WUDOO_ASSEMBLER_LEXER_H
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+
+namespace lexer {
+    /** Token is a view into source buffer.
+     *
+     *  It does not own any memory - it only points to characters in the buffer, so
+     *  creating, copying and comparing tokens never allocates.
+     *  Tokens must not outlive the buffer they were lexed from.
+     */
+    struct Token {
+        const char* begin;
+        unsigned length;
+        unsigned line;
+        unsigned column;
+
+        bool empty() const { return length == 0; }
+        char operator[](unsigned i) const { return begin[i]; }
+
+        Token sub(unsigned b) const;
+        bool is(const char* s) const;
+        bool startswith(const char* s) const;
+        std::string str() const;
+
+        Token(): begin(0), length(0), line(0), column(0) {}
+        Token(const char* b, unsigned l, unsigned ln = 0, unsigned col = 0): begin(b), length(l), line(ln), column(col) {}
+    };
+
+    std::ostream& operator<<(std::ostream&, const Token&);
+
+    struct TokenHash {
+        size_t operator()(const Token&) const;
+    };
+    struct TokenEqual {
+        bool operator()(const Token&, const Token&) const;
+    };
+
+
+    bool isnum(const Token&);
+    bool toint(const Token&, int&);
+
+
+    /** Line is a fixed-size group of tokens.
+     *
+     *  Wudoo asm lines have at most four meaningful tokens (mnemonic and up to three operands)
+     *  so they are kept inline, without allocating.
+     *  Any further tokens on a line are ignored, just as they always were.
+     */
+    const unsigned MAX_LINE_TOKENS = 4;
+
+    struct Line {
+        Token tokens[MAX_LINE_TOKENS];
+        unsigned count;
+        unsigned number;
+
+        Line(): count(0), number(0) {}
+    };
+
+
+    /** Source is a read-only buffer holding the code to lex.
+     *
+     *  Files are mmap'd when possible (and read into memory otherwise).
+     *  Source can also wrap a buffer that is already in memory, without copying it.
+     */
+    class Source {
+        const char* buffer;
+        size_t bytes;
+        bool mapped;
+        bool owned;
+
+        public:
+            const char* data() const { return buffer; }
+            size_t size() const { return bytes; }
+
+            Source(const char* data, size_t size): buffer(data), bytes(size), mapped(false), owned(false) {}
+            Source(const std::string& path);
+            Source(const Source&) = delete;
+            Source& operator=(const Source&) = delete;
+            ~Source();
+    };
+
+
+    /** Lexer splits a buffer into lines of tokens.
+     *
+     *  Empty lines and comment lines (beginning with `;`) are skipped.
+     *  Line and column numbers are counted from 1.
+     */
+    class Lexer {
+        const char* ptr;
+        const char* end;
+        unsigned line;
+
+        public:
+            bool next(Line&);
+
+            Lexer(const char* data, size_t size, unsigned first_line = 1): ptr(data), end(data+size), line(first_line) {}
+    };
+}
+
+
+#endif
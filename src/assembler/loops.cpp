@@ -0,0 +1,362 @@
+#include <iostream>
+#include <vector>
+#include "assembler.h"
+#include "analysis.h"
+#include "optimiser.h"
+using namespace std;
+using namespace assembler;
+
+
+/*  Headers longer than this are not duplicated by loop rotation.
+ */
+const int MAX_ROTATED_HEADER = 8;
+
+
+struct LoopStats {
+    int header;
+    unsigned line;
+    unsigned blocks;
+    unsigned instructions;
+
+    unsigned hoisted;
+    unsigned reduced;
+    bool rotated;
+
+    LoopStats(): header(0), line(0), blocks(0), instructions(0), hoisted(0), reduced(0), rotated(false) {}
+};
+
+
+/*  Changes to a program collected while loops are transformed.
+ *  Operations may be modified in place (as long as their number does not change), and
+ *  in addition to that:
+ *
+ *      * code may be inserted before a loop header (a preheader): it is entered from outside the loop, while
+ *        jumps from inside the loop skip it,
+ *      * an operation may be replaced by a sequence of operations,
+ */
+struct Edits {
+    vector<vector<Operation> > preheaders;
+    vector<const Loop*> preheader_loops;
+
+    vector<vector<Operation> > replacements;
+    vector<bool> replaced;
+
+    Edits(unsigned n): preheaders(n), preheader_loops(n, 0), replacements(n), replaced(n, false) {}
+};
+
+void rebuild(vector<Operation>& operations, const Edits& edits, const ControlFlowGraph& graph) {
+    /*  Applies collected edits and renumbers jump targets.
+     */
+    int n = operations.size();
+    vector<Operation> result;
+    vector<int> source;     // index of the original operation every new operation comes from (-1 for preheaders)
+    vector<int> start(n+1), body(n+1);
+
+    for (int i = 0; i < n; ++i) {
+        start[i] = result.size();
+        for (const Operation& op : edits.preheaders[i]) {
+            result.push_back(op);
+            source.push_back(-1);
+        }
+        body[i] = result.size();
+        if (edits.replaced[i]) {
+            for (const Operation& op : edits.replacements[i]) {
+                result.push_back(op);
+                source.push_back(i);
+            }
+        } else {
+            result.push_back(operations[i]);
+            source.push_back(i);
+        }
+    }
+    start[n] = body[n] = result.size();
+
+    for (unsigned j = 0; j < result.size(); ++j) {
+        Operation& op = result[j];
+        unsigned count = (op.opcode == JUMP ? 1 : op.opcode == BRANCH ? 2 : 0);
+        for (unsigned t = 0; t < count; ++t) {
+            int target = op.targets[t];
+            const Loop* loop = edits.preheader_loops[target];
+            bool inside = (loop and source[j] >= 0 and loop->contains(graph.block_of[source[j]]));
+            op.targets[t] = (inside ? body[target] : start[target]);
+        }
+    }
+    operations.swap(result);
+}
+
+
+class LoopOptimiser {
+    /*  Transformations of a single loop.
+     */
+    vector<Operation>& operations;
+    const vector<Effects>& fx;
+    const Registers& regs;
+    const ControlFlowGraph& graph;
+    const Dominators& dominators;
+    const Dataflow* flow;
+    const Liveness* liveness;
+    const vector<int>& innermost;
+
+    const Loop& loop;
+    int index;
+    Edits& edits;
+
+    // number of definitions of every register inside the loop
+    vector<unsigned> defs;
+    bool opaque;
+
+    int dense(const int_op& op) const { return regs.dense[regof(op)]; }
+
+    bool invariant(int dense_reg) const { return (defs[dense_reg] == 0); }
+
+    bool onceEveryIteration(int block) const {
+        /*  Blocks executed exactly once in every iteration of a loop with a single latch
+         *  dominate the latch and are not part of an inner loop.
+         */
+        return (loop.latches.size() == 1 and innermost[block] == index and dominators.dominates(block, loop.latches[0]));
+    }
+
+    bool hasPreheader() const {
+        /*  Code inserted before the header is entered by falling through from the preceding block, so
+         *  that block must not be part of the loop.
+         */
+        int first = graph.blocks[loop.header].first;
+        if (first == 0) { return true; }
+        int previous = graph.block_of[first-1];
+        return (transfers(operations[first-1].opcode) or not loop.contains(previous));
+    }
+
+    void addToPreheader(const Operation& op) {
+        int first = graph.blocks[loop.header].first;
+        edits.preheaders[first].push_back(op);
+        edits.preheader_loops[first] = &loop;
+    }
+
+    Operation make(OPCODE opcode, int a, int b, int r, unsigned line) const {
+        Operation op;
+        op.opcode = opcode;
+        op.operands[0] = int_op(false, a);
+        op.operands[1] = int_op(false, b);
+        op.operands[2] = int_op(false, r);
+        op.line = line;
+        return op;
+    }
+
+    public:
+
+    unsigned hoistInvariants() {
+        /*  Loop-invariant code motion.
+         *
+         *  An operation is moved to the preheader if:
+         *
+         *      * its operands are not written inside the loop,
+         *      * it is the only operation writing its register inside the loop,
+         *      * value of the register from before the loop is never read (the register is not live at the header),
+         *      * it can not fail (it will be executed even if the loop would exit before reaching it),
+         *
+         *  Moved operations are replaced by `pass` which is removed later.
+         */
+        if (opaque or not flow or not hasPreheader()) { return 0; }
+        const State& state = flow->entry[loop.header];
+        const vector<bool>& live = liveness->entry[loop.header];
+
+        unsigned hoisted = 0;
+        for (int b : loop.blocks) {
+            const Block& block = graph.blocks[b];
+            for (int i = block.first; i <= block.last; ++i) {
+                Operation& op = operations[i];
+                const Effects& e = fx[i];
+                switch (op.opcode) {
+                    case ISTORE: case BSTORE: case COPY:
+                    case IADD: case ISUB: case IMUL: case IDIV:
+                    case ILT: case ILTE: case IGT: case IGTE: case IEQ:
+                    case AND: case OR:
+                        break;
+                    default:
+                        continue;
+                }
+                if (e.def_count != 1) { continue; }
+                int r = regs.dense[e.defs[0]];
+                bool operands_invariant = true;
+                for (unsigned u = 0; u < e.use_count; ++u) {
+                    if (not invariant(regs.dense[e.uses[u]])) { operands_invariant = false; }
+                }
+                if (not operands_invariant or defs[r] != 1 or live[r] or not infallible(op, e, state, regs)) { continue; }
+
+                addToPreheader(op);
+                unsigned line = op.line;
+                op = Operation();
+                op.line = line;
+                ++hoisted;
+            }
+        }
+        return hoisted;
+    }
+
+    unsigned reduceStrength() {
+        /*  Strength reduction of `imul` by an induction variable.
+         *
+         *  Induction variable is a register written in the loop only by `iinc` (or `idec`) executed
+         *  once every iteration.
+         *  Multiplication of it by a loop-invariant register k, also executed once every iteration, is replaced by
+         *  adding (or subtracting) k to its previous result.
+         *  The first result is prepared in the preheader.
+         */
+        if (opaque or not flow or loop.latches.size() != 1 or not hasPreheader()) { return 0; }
+        const State& state = flow->entry[loop.header];
+        const vector<bool>& live = liveness->entry[loop.header];
+
+        // induction variables: dense register -> index of operation updating it
+        vector<int> updates(regs.size(), -1);
+        for (int b : loop.blocks) {
+            const Block& block = graph.blocks[b];
+            for (int i = block.first; i <= block.last; ++i) {
+                const Operation& op = operations[i];
+                if ((op.opcode == IINC or op.opcode == IDEC) and defs[dense(op.operands[0])] == 1 and onceEveryIteration(b)) {
+                    updates[dense(op.operands[0])] = i;
+                }
+            }
+        }
+
+        unsigned reduced = 0;
+        for (int b : loop.blocks) {
+            const Block& block = graph.blocks[b];
+            if (not onceEveryIteration(b)) { continue; }
+            for (int i = block.first; i <= block.last; ++i) {
+                Operation& op = operations[i];
+                if (op.opcode != IMUL or fx[i].opaque) { continue; }
+
+                int a = dense(op.operands[0]), k = dense(op.operands[1]), r = dense(op.operands[2]);
+                if (updates[a] == -1) { std::swap(a, k); }
+                if (updates[a] == -1 or not invariant(k) or a == k or r == a or r == k) { continue; }
+                if (defs[r] != 1 or live[r] or not state[a].integer() or not state[k].integer()) { continue; }
+
+                int update = updates[a];
+                int update_block = graph.block_of[update];
+                bool before_update = (update_block == b ? i < update : dominators.dominates(b, update_block));
+                bool increasing = (operations[update].opcode == IINC);
+
+                int ra = regs.real[a], rk = regs.real[k], rr = regs.real[r];
+                addToPreheader(make(IMUL, ra, rk, rr, op.line));
+                if (before_update) { addToPreheader(make((increasing ? ISUB : IADD), rr, rk, rr, op.line)); }
+                op = make((increasing ? IADD : ISUB), rr, rk, rr, op.line);
+                ++reduced;
+            }
+        }
+        return reduced;
+    }
+
+    bool rotate() {
+        /*  Loop rotation.
+         *
+         *  A loop whose header ends with the exit test (a branch) and whose single latch jumps back to the header
+         *  gets a copy of the header in place of that jump.
+         *  Counter update at the end of the body and the exit test then follow each other, and
+         *  one jump per iteration is saved.
+         *  The original header is only executed once, when the loop is entered.
+         */
+        if (loop.latches.size() != 1) { return false; }
+        const Block& header = graph.blocks[loop.header];
+        const Block& latch = graph.blocks[loop.latches[0]];
+        if (latch.first == header.first) { return false; }
+        if (operations[header.last].opcode != BRANCH or header.last - header.first + 1 > MAX_ROTATED_HEADER) { return false; }
+        if (operations[latch.last].opcode != JUMP or operations[latch.last].targets[0] != header.first) { return false; }
+
+        vector<Operation> copy(operations.begin() + header.first, operations.begin() + header.last + 1);
+        edits.replacements[latch.last] = copy;
+        edits.replaced[latch.last] = true;
+        return true;
+    }
+
+    LoopOptimiser(vector<Operation>& o, const vector<Effects>& e, const Registers& r, const ControlFlowGraph& g, const Dominators& d,
+                  const Dataflow* f, const Liveness* l, const vector<int>& inner, const Loop& lp, int i, Edits& ed):
+        operations(o), fx(e), regs(r), graph(g), dominators(d), flow(f), liveness(l), innermost(inner), loop(lp), index(i), edits(ed), defs(r.size(), 0), opaque(false) {
+        for (int b : loop.blocks) {
+            const Block& block = graph.blocks[b];
+            for (int i = block.first; i <= block.last; ++i) {
+                if (fx[i].opaque) { opaque = true; }
+                for (unsigned d = 0; d < fx[i].def_count; ++d) { ++defs[regs.dense[fx[i].defs[d]]]; }
+            }
+        }
+    }
+};
+
+
+unsigned assembler::optimiseLoops(vector<Operation>& operations, bool dataflow, bool debug) {
+    /** Find natural loops and transform them with:
+     *
+     *      * loop-invariant code motion,
+     *      * strength reduction of multiplications by induction variables,
+     *      * loop rotation (which puts the exit test right after the counter update),
+     *
+     *  Loops are transformed starting with inner ones.
+     *  Loops overlapping a loop transformed before are left for the next round, as
+     *  analyses they would use are no longer accurate.
+     *  Without dataflow (e.g. when program uses `ref`) only rotation is done.
+     *
+     *  Returns number of changes made.
+     */
+    ControlFlowGraph graph = buildControlFlowGraph(operations);
+    Dominators dominators = findDominators(graph);
+    vector<Loop> loops = findLoops(graph, dominators);
+    if (loops.empty()) { return 0; }
+
+    vector<Effects> fx = effects(operations);
+    Registers regs = numberRegisters(fx);
+
+    Dataflow flow(operations, fx, regs, graph);
+    Liveness liveness(operations, fx, regs, graph);
+    if (dataflow) {
+        flow.run();
+        liveness.run();
+    }
+
+    // index of the innermost loop every block belongs to (loops are sorted inner first)
+    vector<int> innermost(graph.blocks.size(), -1);
+    for (unsigned l = 0; l < loops.size(); ++l) {
+        for (int b : loops[l].blocks) {
+            if (innermost[b] == -1) { innermost[b] = l; }
+        }
+    }
+
+    Edits edits(operations.size());
+    vector<bool> claimed(graph.blocks.size(), false);
+    vector<LoopStats> transformed;
+    unsigned changes = 0;
+
+    for (unsigned l = 0; l < loops.size(); ++l) {
+        const Loop& loop = loops[l];
+        bool overlaps = false;
+        for (int b : loop.blocks) { if (claimed[b]) { overlaps = true; } }
+        if (overlaps) { continue; }
+
+        LoopOptimiser optimiser(operations, fx, regs, graph, dominators, (dataflow ? &flow : 0), (dataflow ? &liveness : 0), innermost, loop, l, edits);
+
+        LoopStats stats;
+        stats.hoisted = optimiser.hoistInvariants();
+        stats.reduced = optimiser.reduceStrength();
+        stats.rotated = optimiser.rotate();
+        if (not (stats.hoisted or stats.reduced or stats.rotated)) { continue; }
+
+        for (int b : loop.blocks) { claimed[b] = true; }
+        stats.header = graph.blocks[loop.header].first;
+        stats.line = operations[stats.header].line;
+        stats.blocks = loop.blocks.size();
+        for (int b : loop.blocks) { stats.instructions += graph.blocks[b].last - graph.blocks[b].first + 1; }
+        transformed.push_back(stats);
+        changes += stats.hoisted + stats.reduced + stats.rotated;
+    }
+
+    if (changes) { rebuild(operations, edits, graph); }
+
+    if (debug and transformed.size()) {
+        cout << " *  loops: " << loops.size() << " found, " << transformed.size() << " transformed" << '\n';
+        for (const LoopStats& stats : transformed) {
+            cout << " *  loop at +" << stats.header << " (line " << stats.line << "): "
+                 << stats.blocks << " blocks, " << stats.instructions << " instructions: "
+                 << stats.hoisted << " hoisted, " << stats.reduced << " strength-reduced, "
+                 << (stats.rotated ? "rotated" : "not rotated") << '\n';
+        }
+    }
+    return changes;
+}
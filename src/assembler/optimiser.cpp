@@ -0,0 +1,456 @@
+#include <iostream>
+#include <vector>
+#include "../bytecode/maps.h"
+#include "assembler.h"
+#include "analysis.h"
+#include "optimiser.h"
+using namespace std;
+using namespace assembler;
+
+
+/*  Dataflow passes keep a value for every register used by the program in every basic block.
+ *  Programs that would need more values than this are only optimised with control flow passes.
+ */
+const size_t MAX_DATAFLOW_VALUES = 1 << 22;
+
+/*  Passes are repeated until they stop changing the program (one pass usually
+ *  opens opportunities for others), but not more times than this.
+ */
+const unsigned MAX_OPTIMISER_ROUNDS = 16;
+
+
+struct OptimiserStats {
+    unsigned jumps_threaded;
+    unsigned unreachable_removed;
+    unsigned constants_folded;
+    unsigned branches_folded;
+    unsigned copies_propagated;
+    unsigned dead_stores_removed;
+    unsigned branches_inverted;
+    unsigned nops_removed;
+
+    OptimiserStats(): jumps_threaded(0), unreachable_removed(0), constants_folded(0), branches_folded(0),
+                      copies_propagated(0), dead_stores_removed(0), branches_inverted(0), nops_removed(0) {}
+};
+
+
+unsigned compact(vector<Operation>& operations, vector<bool> removed) {
+    /*  Removes operations marked as removed and renumbers jump targets.
+     *  A target pointing at a removed operation is moved to the first operation kept after it.
+     *  Passes never remove an operation that is reached by control flow and
+     *  has nothing after it, so targets always remain in bounds.
+     *
+     *  A jump looping back over removed operations would become a jump to itself (which CPU rejects), so
+     *  the target of such a jump is kept.
+     */
+    int n = operations.size();
+    for (int j = 0; j < n; ++j) {
+        if (removed[j] or operations[j].opcode != JUMP) { continue; }
+        int target = operations[j].targets[0];
+        int k = target;
+        while (k < j and removed[k]) { ++k; }
+        if (k == j and target != j) { removed[target] = false; }
+    }
+
+    vector<int> index(n+1);
+    int kept = 0;
+    for (int i = 0; i < n; ++i) {
+        index[i] = kept;
+        if (not removed[i]) { operations[kept++] = operations[i]; }
+    }
+    index[n] = kept;
+    operations.resize(kept);
+
+    for (int i = 0; i < kept; ++i) {
+        Operation& op = operations[i];
+        if (op.opcode == JUMP) { op.targets[0] = index[op.targets[0]]; }
+        if (op.opcode == BRANCH) {
+            op.targets[0] = index[op.targets[0]];
+            op.targets[1] = index[op.targets[1]];
+        }
+    }
+    return (n - kept);
+}
+
+
+unsigned threadJumps(vector<Operation>& operations) {
+    /*  Jump threading.
+     *  Jumps and branches to a `jump` are redirected to its final target, and
+     *  jumps to a `halt` are replaced by `halt`.
+     *  Chains of jumps that loop forever are left alone (CPU rejects a jump to itself).
+     */
+    int n = operations.size();
+    unsigned threaded = 0;
+
+    auto follow = [&operations, n] (int target) {
+        int steps = 0;
+        int final = target;
+        while (operations[final].opcode == JUMP) {
+            final = operations[final].targets[0];
+            if (++steps > n) { return target; }
+        }
+        return final;
+    };
+
+    for (int i = 0; i < n; ++i) {
+        Operation& op = operations[i];
+        if (op.opcode == JUMP) {
+            int final = follow(op.targets[0]);
+            if (operations[final].opcode == HALT) {
+                op.opcode = HALT;
+                op.targets[0] = 0;
+                ++threaded;
+            } else if (final != op.targets[0] and final != i) {
+                op.targets[0] = final;
+                ++threaded;
+            }
+        } else if (op.opcode == BRANCH) {
+            for (unsigned t = 0; t < 2; ++t) {
+                int final = follow(op.targets[t]);
+                if (final != op.targets[t]) {
+                    op.targets[t] = final;
+                    ++threaded;
+                }
+            }
+        }
+    }
+    return threaded;
+}
+
+unsigned removeUnreachable(vector<Operation>& operations) {
+    /*  Unreachable code elimination.
+     *  Blocks that can not be reached from the entry of the program are removed.
+     */
+    ControlFlowGraph graph = buildControlFlowGraph(operations);
+    vector<bool> reached(graph.blocks.size(), false);
+    vector<int> stack(1, 0);
+    reached[0] = true;
+    while (stack.size()) {
+        int b = stack.back();
+        stack.pop_back();
+        for (int s : graph.blocks[b].successors) {
+            if (not reached[s]) {
+                reached[s] = true;
+                stack.push_back(s);
+            }
+        }
+    }
+
+    vector<bool> removed(operations.size(), false);
+    bool any = false;
+    for (unsigned i = 0; i < operations.size(); ++i) {
+        removed[i] = not reached[graph.block_of[i]];
+        any = (any or removed[i]);
+    }
+    return (any ? compact(operations, removed) : 0);
+}
+
+unsigned removeNops(vector<Operation>& operations) {
+    /*  Removes `pass` operations and jumps to the very next operation.
+     *  Last operation is kept, so that jumps to it stay in bounds.
+     */
+    int n = operations.size();
+    vector<bool> removed(n, false);
+    bool any = false;
+    for (int i = 0; i+1 < n; ++i) {
+        const Operation& op = operations[i];
+        removed[i] = (op.opcode == PASS or (op.opcode == JUMP and op.targets[0] == i+1));
+        any = (any or removed[i]);
+    }
+    return (any ? compact(operations, removed) : 0);
+}
+
+
+bool rewrite(Operation& op, const Effects& e, const State& state, const Registers& regs, OptimiserStats& stats) {
+    /*  Constant folding and copy propagation of a single operation.
+     *  Returns true if the operation was changed.
+     */
+    if (e.opaque) { return false; }
+
+    int_op* ops = op.operands;
+    auto value = [&state, &regs] (const int_op& o) -> const Value& { return state[regs.dense[regof(o)]]; };
+    auto propagate = [&state, &regs, &stats] (int_op& o) {
+        int c = state[regs.dense[regof(o)]].copy;
+        if (c >= 0) {
+            o = int_op(false, regs.real[c]);
+            ++stats.copies_propagated;
+            return true;
+        }
+        return false;
+    };
+    auto store = [&op, &stats] (int reg, int number) {
+        op.opcode = ISTORE;
+        op.operands[0] = int_op(false, reg);
+        op.operands[1] = int_op(false, number);
+        op.operands[2] = int_op(false, 0);
+        ++stats.constants_folded;
+        return true;
+    };
+
+    switch (op.opcode) {
+        case ISTORE:
+            if (isref(ops[1]) and value(ops[1]).constant(INTEGER_TYPE)) { return store(regof(ops[0]), value(ops[1]).value); }
+            if (isref(ops[1])) {
+                int_op src(false, regof(ops[1]));
+                if (propagate(src)) {
+                    ops[1] = int_op(true, regof(src));
+                    return true;
+                }
+            }
+            return false;
+        case IADD: case ISUB: case IMUL: case IDIV:
+            if (foldable(op.opcode, value(ops[0]), value(ops[1]))) {
+                return store(regof(ops[2]), fold(op.opcode, value(ops[0]).value, value(ops[1]).value));
+            }
+            return (propagate(ops[0]) | propagate(ops[1]));
+        case ILT: case ILTE: case IGT: case IGTE: case IEQ:
+        case AND: case OR:
+            return (propagate(ops[0]) | propagate(ops[1]));
+        case IINC: case IDEC:
+            if (value(ops[0]).constant(INTEGER_TYPE)) {
+                return store(regof(ops[0]), int((unsigned)value(ops[0]).value + (op.opcode == IINC ? 1 : -1)));
+            }
+            return false;
+        case COPY:
+            if (value(ops[0]).constant(INTEGER_TYPE)) { return store(regof(ops[1]), value(ops[0]).value); }
+            if (value(ops[0]).constant(BYTE_TYPE)) {
+                op.opcode = BSTORE;
+                op.byte_operand = byte_op(false, (byte)value(ops[0]).value);
+                op.operands[0] = ops[1];
+                op.operands[1] = int_op(false, 0);
+                ++stats.constants_folded;
+                return true;
+            }
+            return propagate(ops[0]);
+        case RET:
+            if (value(ops[0]).constant(INTEGER_TYPE)) { return store(0, value(ops[0]).value); }
+            return propagate(ops[0]);
+        case PRINT: case ECHO:
+            return propagate(ops[0]);
+        case BRANCH: {
+            const Value& condition = value(ops[0]);
+            if (condition.kind == CONSTANT or (condition.present() and op.targets[0] == op.targets[1])) {
+                op.opcode = JUMP;
+                op.targets[0] = (condition.kind == CONSTANT and not condition.value ? op.targets[1] : op.targets[0]);
+                op.targets[1] = 0;
+                op.operands[0] = int_op(false, 0);
+                ++stats.branches_folded;
+                return true;
+            }
+            return propagate(ops[0]);
+        }
+        default:
+            return false;
+    }
+}
+
+unsigned propagateConstants(vector<Operation>& operations, const vector<Effects>& fx, const Registers& regs, OptimiserStats& stats) {
+    /*  Constant folding and copy propagation.
+     *  Operations whose operands are known constants are replaced by stores of their results,
+     *  branches on known conditions become jumps, and
+     *  registers known to be copies of other registers are replaced by the originals.
+     */
+    ControlFlowGraph graph = buildControlFlowGraph(operations);
+    Dataflow flow(operations, fx, regs, graph);
+    flow.run();
+
+    unsigned changed = 0;
+    for (unsigned b = 0; b < graph.blocks.size(); ++b) {
+        const Block& block = graph.blocks[b];
+        if (not flow.reached(b)) { continue; }
+        State state = flow.entry[b];
+        for (int i = block.first; i <= block.last; ++i) {
+            if (rewrite(operations[i], fx[i], state, regs, stats)) {
+                ++changed;
+                Effects e = effects(operations[i]);
+                flow.transfer(operations[i], e, state);
+            } else {
+                flow.transfer(operations[i], fx[i], state);
+            }
+        }
+    }
+    return changed;
+}
+
+
+unsigned removeDeadStores(vector<Operation>& operations, const vector<Effects>& fx, const Registers& regs) {
+    /*  Dead store elimination.
+     *  Operations writing a register whose value is never read afterwards are removed
+     *  (unless they could fail).
+     */
+    ControlFlowGraph graph = buildControlFlowGraph(operations);
+    Dataflow flow(operations, fx, regs, graph);
+    flow.run();
+    Liveness liveness(operations, fx, regs, graph);
+    liveness.run();
+
+    vector<bool> removed(operations.size(), false);
+    unsigned count = 0;
+    for (unsigned b = 0; b < graph.blocks.size(); ++b) {
+        if (not flow.reached(b)) { continue; }
+        const Block& block = graph.blocks[b];
+
+        // operations which would be safe to remove
+        vector<bool> safe(block.last - block.first + 1, false);
+        State state = flow.entry[b];
+        for (int i = block.first; i <= block.last; ++i) {
+            safe[i - block.first] = infallible(operations[i], fx[i], state, regs);
+            flow.transfer(operations[i], fx[i], state);
+        }
+
+        vector<bool> live = liveness.exit(b);
+        for (int i = block.last; i >= block.first; --i) {
+            if (safe[i - block.first] and i+1 < int(operations.size()) and not live[regs.dense[fx[i].defs[0]]]) {
+                removed[i] = true;
+                ++count;
+                continue;
+            }
+            liveness.step(i, live);
+        }
+    }
+    return (count ? compact(operations, removed) : 0);
+}
+
+unsigned invertBranches(vector<Operation>& operations, const vector<Effects>& fx, const Registers& regs) {
+    /*  Branches on a negated condition (`not r` followed by `branch r`) branch on the
+     *  condition itself with their targets swapped, if the negated value is not read afterwards.
+     */
+    ControlFlowGraph graph = buildControlFlowGraph(operations);
+    Liveness liveness(operations, fx, regs, graph);
+    liveness.run();
+
+    vector<bool> removed(operations.size(), false);
+    unsigned count = 0;
+    for (unsigned i = 0; i+1 < operations.size(); ++i) {
+        Operation& negation = operations[i];
+        Operation& branch = operations[i+1];
+        if (negation.opcode != NOT or branch.opcode != BRANCH or fx[i].opaque or fx[i+1].opaque) { continue; }
+        if (regof(negation.operands[0]) != regof(branch.operands[0])) { continue; }
+        if (graph.block_of[i] != graph.block_of[i+1]) { continue; }
+
+        vector<bool> live = liveness.exit(graph.block_of[i+1]);
+        if (live[regs.dense[regof(branch.operands[0])]]) { continue; }
+
+        std::swap(branch.targets[0], branch.targets[1]);
+        removed[i] = true;
+        ++count;
+    }
+    return (count ? compact(operations, removed) : 0);
+}
+
+
+void assembler::optimise(vector<Operation>& operations, const TokenMap& names, bool debug) {
+    /** Optimise a decoded program.
+     *
+     *  Passes work on a control flow graph of basic blocks built from jumps, branches and their targets:
+     *
+     *      * jump threading,
+     *      * unreachable code elimination,
+     *      * constant folding (including branches on known conditions) and copy propagation,
+     *      * dead store elimination,
+     *      * inversion of branches on negated conditions,
+     *      * loop optimisations (see optimiseLoops()),
+     *      * removal of `pass` operations and jumps to the next operation,
+     *
+     *  and are repeated until the program stops changing.
+     *  Finally, registers are renamed to occupy as few indexes as possible (see renameRegisters()).
+     *  Names given to registers are used in debugging output listing renamed registers.
+     *  Output of the program is not changed, and neither is its exit code (also in case of errors).
+     *
+     *  Operations with `@` operands are treated conservatively: they may read and write any register.
+     *  Programs using `ref` are only optimised with control flow passes, as
+     *  writing to one register may change value of another.
+     */
+    OptimiserStats stats;
+    unsigned before = operations.size();
+
+    if (operations.empty() or not normaliseTargets(operations)) {
+        if (debug) { cout << "optimising: skipped (empty program or jump targets out of bounds)" << endl << endl; }
+        return;
+    }
+
+    for (const Operation& op : operations) {
+        /*  Code reached only by spawned processes would look unreachable, and
+         *  values passed to processes are not tracked, so such programs are left as they are.
+         */
+        if (op.opcode == SPAWN) {
+            if (debug) { cout << "optimising: skipped (program spawns processes)" << endl << endl; }
+            return;
+        }
+    }
+
+    if (debug) { cout << "optimising:" << '\n'; }
+
+    bool aliasing = false;
+    for (unsigned i = 0; i < operations.size(); ++i) {
+        if (operations[i].opcode == REF) { aliasing = true; }
+    }
+
+    for (unsigned round = 0; round < MAX_OPTIMISER_ROUNDS; ++round) {
+        unsigned changed = 0;
+
+        unsigned threaded = threadJumps(operations);
+        stats.jumps_threaded += threaded;
+        changed += threaded;
+
+        unsigned unreachable = removeUnreachable(operations);
+        stats.unreachable_removed += unreachable;
+        changed += unreachable;
+
+        vector<Effects> fx = effects(operations);
+        Registers regs = numberRegisters(fx);
+        size_t blocks = buildControlFlowGraph(operations).blocks.size();
+        bool dataflow = (not aliasing and regs.size() and blocks * regs.size() <= MAX_DATAFLOW_VALUES);
+
+        if (dataflow) {
+            changed += propagateConstants(operations, fx, regs, stats);
+
+            fx = effects(operations);
+            unsigned dead = removeDeadStores(operations, fx, regs);
+            stats.dead_stores_removed += dead;
+            changed += dead;
+
+            fx = effects(operations);
+            unsigned inverted = invertBranches(operations, fx, regs);
+            stats.branches_inverted += inverted;
+            changed += inverted;
+        }
+
+        changed += optimiseLoops(operations, dataflow, debug);
+
+        unsigned nops = removeNops(operations);
+        stats.nops_removed += nops;
+        changed += nops;
+
+        if (not changed) { break; }
+    }
+
+    vector<int> renamed;
+    size_t values = buildControlFlowGraph(operations).blocks.size() * numberRegisters(effects(operations)).size();
+    if (not aliasing and values <= MAX_DATAFLOW_VALUES) { renamed = renameRegisters(operations); }
+
+    if (debug) {
+        cout << " *  instructions: " << before << " -> " << operations.size() << '\n';
+        cout << " *  jumps threaded: " << stats.jumps_threaded << '\n';
+        cout << " *  unreachable instructions removed: " << stats.unreachable_removed << '\n';
+        cout << " *  constants folded: " << stats.constants_folded << '\n';
+        cout << " *  branches folded: " << stats.branches_folded << '\n';
+        cout << " *  copies propagated: " << stats.copies_propagated << '\n';
+        cout << " *  dead stores removed: " << stats.dead_stores_removed << '\n';
+        cout << " *  branches inverted: " << stats.branches_inverted << '\n';
+        cout << " *  no-ops removed: " << stats.nops_removed << '\n';
+        if (aliasing) { cout << " *  dataflow passes skipped: program uses `ref`" << '\n'; }
+        if (renamed.empty()) {
+            cout << " *  registers not renamed" << '\n';
+        }
+        for (unsigned r = 0; r < renamed.size(); ++r) {
+            if (renamed[r] == -1) { continue; }
+            cout << " *  register: " << r;
+            for (auto name : names) {
+                if (name.second == int(r)) { cout << " `" << string(name.first.begin, name.first.length) << '`'; }
+            }
+            cout << " -> " << renamed[r] << '\n';
+        }
+        cout << endl;
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef WUDOO_ASSEMBLER_OPTIMISER_H
+#define WUDOO_ASSEMBLER_OPTIMISER_H
+
+#pragma once
+
+#include <vector>
+#include "assembler.h"
+
+
+namespace assembler {
+    /*  Passes working on the whole program are in optimiser.cpp,
+     *  passes working on loops are in loops.cpp, and
+     *  register renaming is in registers.cpp.
+     */
+    unsigned optimiseLoops(std::vector<Operation>& operations, bool dataflow, bool debug = false);
+    std::vector<int> renameRegisters(std::vector<Operation>& operations);
+
+    void optimise(std::vector<Operation>& operations, const TokenMap& names, bool debug = false);
+}
+
+
+#endif
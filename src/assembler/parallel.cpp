@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../program.h"
+#include "../debuginfo.h"
+#include "../support/threadpool.h"
+#include "lexer.h"
+#include "assembler.h"
+using namespace std;
+
+
+/*  Chunks smaller than this are not worth a task of their own.
+ */
+const size_t MIN_CHUNK_SIZE = 64 * 1024;
+
+/*  Source is split into several chunks per thread so that
+ *  threads which finish early can pick up remaining work.
+ */
+const unsigned CHUNKS_PER_JOB = 4;
+
+
+struct Chunk {
+    const char* data;
+    size_t size;
+
+    unsigned first_line;
+    int first_instruction;
+
+    assembler::Scan scanned;
+    Program program;
+
+    string error;
+};
+
+
+vector<Chunk*> split(const char* data, size_t size, unsigned count) {
+    /*  Splits source into (at most) count chunks.
+     *  Chunks always end just after a newline (or at the end of the source) so
+     *  no line is ever divided between two chunks.
+     */
+    vector<Chunk*> chunks;
+    const char* end = data + size;
+    const char* ptr = data;
+    size_t target = max(size / count, MIN_CHUNK_SIZE);
+
+    while (ptr < end) {
+        const char* chunk_end = (size_t(end - ptr) > target ? ptr + target : end);
+        if (chunk_end < end) {
+            const char* newline = (const char*)memchr(chunk_end, '\n', end - chunk_end);
+            chunk_end = (newline ? newline + 1 : end);
+        }
+
+        Chunk* chunk = new Chunk();
+        chunk->data = ptr;
+        chunk->size = chunk_end - ptr;
+        chunk->first_line = 1;
+        chunk->first_instruction = 0;
+        chunks.push_back(chunk);
+
+        ptr = chunk_end;
+    }
+    return chunks;
+}
+
+template<class F> void forEachChunk(ThreadPool& pool, vector<Chunk*>& chunks, F f) {
+    /*  Runs f on every chunk using the pool and waits for all of them.
+     *  Exceptions thrown by f are stored in the chunk they were thrown for.
+     */
+    for (unsigned i = 0; i < chunks.size(); ++i) {
+        Chunk* chunk = chunks[i];
+        pool.submit([chunk, f] () {
+            try {
+                f(*chunk);
+            } catch (const string& e) {
+                chunk->error = e;
+            } catch (const char* e) {
+                chunk->error = e;
+            } catch (const std::exception& e) {
+                chunk->error = e.what();
+            }
+        });
+    }
+    pool.wait();
+}
+
+void rethrow(const vector<Chunk*>& chunks) {
+    /*  Throws error of the first chunk (in source order) that failed.
+     *  This is the same error sequential assembler would report.
+     */
+    for (unsigned i = 0; i < chunks.size(); ++i) {
+        if (chunks[i]->error.size()) {
+            throw chunks[i]->error;
+        }
+    }
+}
+
+
+namespace assembler {
+    void assembleParallel(Program& program, const char* data, size_t size, const string& filename, unsigned jobs, DebugInfo* info) {
+        /** Assemble a source using several threads.
+         *
+         *  Bytecode produced is identical to the one produced by scan() and assemble().
+         *  Assembly is done in phases:
+         *
+         *      1. source is split into chunks at line boundaries,
+         *      2. lines are counted in every chunk (in parallel), so
+         *         errors report correct line numbers,
+         *      3. every chunk is scanned with its own, chunk-local, mark and name tables (in parallel),
+         *      4. chunk-local tables are merged into global ones - marks are rebased by
+         *         the number of instructions in preceding chunks and later definitions override earlier ones,
+         *         just like in a sequential scan,
+         *      5. every chunk is encoded into its own buffer (in parallel),
+         *      6. buffers are appended to the program in order,
+         *      7. debug information (if requested) is described from the merged tables.
+         *
+         *  Jump targets are left as instruction indexes - Program::calculateBranches() backpatches
+         *  them in the combined program.
+         */
+        vector<Chunk*> chunks = split(data, size, jobs * CHUNKS_PER_JOB);
+        ThreadPool pool(jobs);
+
+        try {
+            forEachChunk(pool, chunks, [] (Chunk& chunk) {
+                chunk.first_line = count(chunk.data, chunk.data + chunk.size, '\n');
+            });
+            unsigned line = 1;
+            for (unsigned i = 0; i < chunks.size(); ++i) {
+                unsigned lines = chunks[i]->first_line;
+                chunks[i]->first_line = line;
+                line += lines;
+            }
+
+            forEachChunk(pool, chunks, [&filename] (Chunk& chunk) {
+                chunk.scanned = scan(chunk.data, chunk.size, filename, false, chunk.first_line);
+            });
+            rethrow(chunks);
+
+            TokenMap marks, names;
+            size_t mark_count = 0;
+            for (unsigned i = 0; i < chunks.size(); ++i) { mark_count += chunks[i]->scanned.marks.size(); }
+            marks.reserve(mark_count);
+
+            int instructions = 0;
+            int bytes = 0;
+            for (unsigned i = 0; i < chunks.size(); ++i) {
+                Chunk* chunk = chunks[i];
+                chunk->first_instruction = instructions;
+                for (auto& mark : chunk->scanned.marks) { marks[mark.first] = instructions + mark.second; }
+                for (auto& name : chunk->scanned.names) { names[name.first] = name.second; }
+                instructions += chunk->scanned.instructions.size();
+                bytes += chunk->scanned.bytes;
+            }
+
+            forEachChunk(pool, chunks, [&marks, &names, &filename] (Chunk& chunk) {
+                chunk.program.reserve(chunk.scanned.bytes);
+                encode(chunk.program, chunk.scanned.instructions, marks, names, chunk.first_instruction, filename);
+            });
+            rethrow(chunks);
+
+            program.reserve(program.size() + bytes);
+            for (unsigned i = 0; i < chunks.size(); ++i) {
+                program.append(chunks[i]->program);
+            }
+
+            if (info) {
+                vector<unsigned> lines;
+                lines.reserve(instructions);
+                for (unsigned i = 0; i < chunks.size(); ++i) {
+                    for (const Instruction& instruction : chunks[i]->scanned.instructions) { lines.push_back(instruction.line.number); }
+                }
+                describe(*info, program, lines, lines, marks, names, filename);
+            }
+        } catch (...) {
+            for (unsigned i = 0; i < chunks.size(); ++i) { delete chunks[i]; }
+            throw;
+        }
+
+        for (unsigned i = 0; i < chunks.size(); ++i) { delete chunks[i]; }
+    }
+}
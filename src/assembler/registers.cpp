@@ -0,0 +1,119 @@
+#include <vector>
+#include "../cpu/cpu.h"
+#include "assembler.h"
+#include "analysis.h"
+#include "optimiser.h"
+using namespace std;
+using namespace assembler;
+
+
+unsigned registerOperands(Operation& op, int_op* operands[3]) {
+    /*  Collects operands of an operation which are register indexes.
+     *  Returns their number.
+     */
+    unsigned count = 0;
+    switch (op.opcode) {
+        case ISTORE:
+            operands[count++] = &op.operands[0];
+            if (isref(op.operands[1])) { operands[count++] = &op.operands[1]; }
+            break;
+        case IADD: case ISUB: case IMUL: case IDIV:
+        case ILT: case ILTE: case IGT: case IGTE: case IEQ:
+        case AND: case OR:
+            for (unsigned i = 0; i < 3; ++i) { operands[count++] = &op.operands[i]; }
+            break;
+        case MOVE: case COPY: case SWAP:
+            for (unsigned i = 0; i < 2; ++i) { operands[count++] = &op.operands[i]; }
+            break;
+        case IINC: case IDEC: case NOT: case BSTORE:
+        case PRINT: case ECHO: case BRANCH: case RET:
+            operands[count++] = &op.operands[0];
+            break;
+        default:
+            break;
+    }
+    return count;
+}
+
+
+vector<int> assembler::renameRegisters(vector<Operation>& operations) {
+    /** Register renaming.
+     *
+     *  Registers are renumbered so that they occupy the smallest possible range of indexes:
+     *  registers which are never live at the same time share an index.
+     *  Register 0 is never renamed and no other register is renamed to 0, as it holds the exit code.
+     *
+     *  Two registers interfere (can not share an index) if one is written while the other is live.
+     *  This also covers registers read before they are written: they are live from the entry of the program, so
+     *  nothing else may be written to their index before they are read.
+     *
+     *  Programs with operations that may access any register (e.g. `@` operands) or that
+     *  alias registers with `ref` are not renamed, i.e. all their registers are pinned.
+     *
+     *  Returns a map from old register indexes to new ones (-1 for unused registers), or
+     *  an empty vector if registers were not renamed.
+     */
+    vector<Effects> fx = effects(operations);
+    for (unsigned i = 0; i < operations.size(); ++i) {
+        if (fx[i].opaque or operations[i].opcode == REF) { return vector<int>(); }
+    }
+    Registers regs = numberRegisters(fx);
+    unsigned R = regs.size();
+    if (R == 0) { return vector<int>(); }
+
+    ControlFlowGraph graph = buildControlFlowGraph(operations);
+    Liveness liveness(operations, fx, regs, graph);
+    liveness.run();
+
+    vector<vector<bool> > interferes(R, vector<bool>(R, false));
+    auto interfere = [&interferes] (int a, int b) {
+        interferes[a][b] = true;
+        interferes[b][a] = true;
+    };
+    for (unsigned b = 0; b < graph.blocks.size(); ++b) {
+        const Block& block = graph.blocks[b];
+        vector<bool> live = liveness.exit(b);
+        for (int i = block.last; i >= block.first; --i) {
+            const Effects& e = fx[i];
+            for (unsigned d = 0; d < e.def_count; ++d) {
+                int def = regs.dense[e.defs[d]];
+                for (unsigned r = 0; r < R; ++r) {
+                    if (live[r] and int(r) != def) { interfere(def, r); }
+                }
+                for (unsigned other = 0; other < d; ++other) {
+                    int o = regs.dense[e.defs[other]];
+                    if (o != def) { interfere(def, o); }
+                }
+            }
+            liveness.step(i, live);
+        }
+    }
+
+    // greedy colouring in order of first use; index 0 is reserved for register 0
+    vector<int> colour(R, -1);
+    for (unsigned r = 0; r < R; ++r) {
+        if (regs.real[r] == 0) {
+            colour[r] = 0;
+            continue;
+        }
+        vector<bool> taken(R+1, false);
+        for (unsigned other = 0; other < R; ++other) {
+            if (interferes[r][other] and colour[other] >= 0) { taken[colour[other]] = true; }
+        }
+        int c = 1;
+        while (taken[c]) { ++c; }
+        colour[r] = c;
+    }
+
+    vector<int> renamed(DEFAULT_REGISTER_SIZE, -1);
+    for (unsigned r = 0; r < R; ++r) { renamed[regs.real[r]] = colour[r]; }
+
+    for (Operation& op : operations) {
+        int_op* operands[3];
+        unsigned count = registerOperands(op, operands);
+        for (unsigned i = 0; i < count; ++i) {
+            *operands[i] = int_op(isref(*operands[i]), renamed[regof(*operands[i])]);
+        }
+    }
+    return renamed;
+}
@@ -5,6 +5,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 #include "opcodes.h"
 
 
@@ -64,6 +65,14 @@ const std::map<std::string, unsigned> OP_SIZES = {
 
     { "pass",   sizeof(byte) },
     { "halt",   sizeof(byte) },
+
+    { "spawn",  sizeof(byte) + sizeof(bool) + 2*sizeof(int) },
+    { "yield",  sizeof(byte) },
+
+    { "chan",   sizeof(byte) + 2*sizeof(bool) + 2*sizeof(int) },
+    { "send",   sizeof(byte) + 2*sizeof(bool) + 2*sizeof(int) },
+    { "recv",   sizeof(byte) + 2*sizeof(bool) + 2*sizeof(int) },
+    { "tryrecv",sizeof(byte) + 3*sizeof(bool) + 3*sizeof(int) },
 };
 
 
@@ -123,7 +132,33 @@ const std::map<enum OPCODE, std::string> OP_NAMES = {
 
     { PASS,	    "pass" },
     { HALT,	    "halt" },
+
+    { SPAWN,	"spawn" },
+    { YIELD,	"yield" },
+
+    { CHAN,	    "chan" },
+    { SEND,	    "send" },
+    { RECV,	    "recv" },
+    { TRYRECV,	"tryrecv" },
 };
 
 
+inline std::vector<unsigned> buildOpSizesTable() {
+    /** Builds a table of instruction sizes indexed by opcode.
+     *  Unknown opcodes have size 0.
+     */
+    std::vector<unsigned> sizes(256, 0);
+    for (auto& op : OP_NAMES) { sizes[op.first] = OP_SIZES.at(op.second); }
+    return sizes;
+}
+
+inline unsigned opsize(byte opcode) {
+    /** Returns size (in bytes, including the opcode) of an instruction.
+     *  Use this instead of going through OP_NAMES and OP_SIZES when walking bytecode.
+     */
+    static const std::vector<unsigned> sizes = buildOpSizesTable();
+    return sizes[opcode];
+}
+
+
 #endif
@@ -70,6 +70,20 @@ enum OPCODE : byte {
 
     PASS,   // do nothing
     HALT,
+
+    // processes (added after HALT so encoding of older programs does not change)
+    SPAWN,  // start a new process at given instruction, passing it a copy of a register
+    YIELD,  // let other processes run
+
+    // channels
+    CHAN,   // create a channel with given capacity
+    SEND,   // send an object to a channel (waits while the channel is full)
+    RECV,   // receive an object from a channel (waits while the channel is empty)
+    TRYRECV,// receive an object from a channel if there is one, store whether there was in a register
+
+    // reserved for debuggers, which patch it over the first byte of instructions in their own copies of programs;
+    // it is not an instruction of the language, so the assembler does not know it and programs never contain it
+    BREAK = 0xff,
 };
 
 #endif
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "../support/string.h"
+#include "../types/object.h"
+#include "allocations.h"
+using namespace std;
+
+
+thread_local AllocationObserver* Object::observer = 0;
+
+void* Object::operator new(std::size_t size) {
+    void* memory = ::operator new(size);
+    if (observer) { observer->allocated(static_cast<const Object*>(memory), size); }
+    return memory;
+}
+
+void Object::operator delete(void* memory, std::size_t size) {
+    if (observer) { observer->freed(static_cast<const Object*>(memory), size); }
+    ::operator delete(memory);
+}
+
+
+static string opname(byte opcode) {
+    auto name = OP_NAMES.find(OPCODE(opcode));
+    return (name != OP_NAMES.end() ? name->second : "<unknown>");
+}
+
+static unsigned bucket(uint64_t lifetime) {
+    unsigned n = 0;
+    while (lifetime) {
+        lifetime >>= 1;
+        ++n;
+    }
+    return min(n, AllocationStats::LIFETIME_BUCKETS - 1);
+}
+
+static vector<pair<string, AllocationStats::Counter> > bySize(const map<string, AllocationStats::Counter>& counters) {
+    vector<pair<string, AllocationStats::Counter> > sorted(counters.begin(), counters.end());
+    stable_sort(sorted.begin(), sorted.end(), [](const pair<string, AllocationStats::Counter>& a, const pair<string, AllocationStats::Counter>& b) {
+        return a.second.bytes > b.second.bytes;
+    });
+    return sorted;
+}
+
+static vector<byte> allocating(const AllocationStats& stats) {
+    vector<byte> opcodes;
+    for (unsigned i = 0; i < 256; ++i) {
+        if (stats.opcodes[i].objects) { opcodes.push_back(i); }
+    }
+    stable_sort(opcodes.begin(), opcodes.end(), [&stats](byte a, byte b) { return stats.opcodes[a].bytes > stats.opcodes[b].bytes; });
+    return opcodes;
+}
+
+static string counter(const AllocationStats::Counter& c) {
+    return "{\"objects\": " + to_string(c.objects) + ", \"bytes\": " + to_string(c.bytes) + "}";
+}
+
+
+AllocationStats::AllocationStats(): running(false), current_opcode(0), current_offset(0), clock(0) {
+    fill(lifetimes, lifetimes + LIFETIME_BUCKETS, 0);
+}
+
+void AllocationStats::allocated(const Object* object, size_t size) {
+    allocations.add(size);
+    live.add(size);
+    if (live.objects > peak.objects) { peak.objects = live.objects; }
+    if (live.bytes > peak.bytes) { peak.bytes = live.bytes; }
+
+    if (running) {
+        opcodes[current_opcode].add(size);
+        if (current_offset < offsets.size()) { offsets[current_offset].add(size); }
+    } else {
+        outside.add(size);
+    }
+    living[object] = Living{clock, size, false};
+    pending.push_back(object);
+}
+
+void AllocationStats::freed(const Object* object, size_t size) {
+    auto found = living.find(object);
+    if (found == living.end()) {
+        untracked.add(size);
+        return;
+    }
+    frees.add(size);
+    --live.objects;
+    live.bytes -= size;
+    ++lifetimes[bucket(clock - found->second.born)];
+    if (not found->second.settled) {
+        types["(temporary)"].add(size);
+        pending.erase(find(pending.begin(), pending.end(), object));
+    }
+    living.erase(found);
+}
+
+void AllocationStats::settle() {
+    /*  Objects still pending were created by the instruction that has just finished, and are fully constructed.
+     */
+    for (const Object* object : pending) {
+        Living& entry = living[object];
+        types[object->type()].add(entry.size);
+        entry.settled = true;
+    }
+    pending.clear();
+    running = false;
+}
+
+uint64_t AllocationStats::size(const Object* object) const {
+    auto found = living.find(object);
+    return (found != living.end() ? found->second.size : 0);
+}
+
+void AllocationStats::report(ostream& out, const byte* bytecode, unsigned hottest) const {
+    out << "allocations: " << allocations.objects << " objects, " << allocations.bytes << " bytes; ";
+    out << "freed: " << frees.objects << " objects; ";
+    out << "peak: " << peak.objects << " objects, " << peak.bytes << " bytes live" << endl;
+    if (outside.objects) { out << "allocated outside of instructions: " << outside.objects << " objects" << endl; }
+    if (untracked.objects) { out << "freed, but allocated before collection began: " << untracked.objects << " objects" << endl; }
+
+    out << left << setw(16) << "type" << right << setw(14) << "objects" << setw(14) << "bytes" << endl;
+    for (auto& type : bySize(types)) {
+        out << left << setw(16) << type.first << right << setw(14) << type.second.objects << setw(14) << type.second.bytes << endl;
+    }
+
+    out << left << setw(16) << "opcode" << right << setw(14) << "objects" << setw(14) << "bytes" << endl;
+    for (byte opcode : allocating(*this)) {
+        out << left << setw(16) << opname(opcode) << right << setw(14) << opcodes[opcode].objects << setw(14) << opcodes[opcode].bytes << endl;
+    }
+
+    vector<uint32_t> hot;
+    for (uint32_t offset = 0; offset < offsets.size(); ++offset) {
+        if (offsets[offset].objects) { hot.push_back(offset); }
+    }
+    stable_sort(hot.begin(), hot.end(), [this](uint32_t a, uint32_t b) { return offsets[a].bytes > offsets[b].bytes; });
+    if (hot.size() > hottest) { hot.resize(hottest); }
+    out << "most allocating instructions:" << endl;
+    out << left << setw(12) << "offset" << setw(12) << "opcode" << right << setw(14) << "objects" << setw(14) << "bytes" << endl;
+    for (uint32_t offset : hot) {
+        out << left << setw(12) << offset << setw(12) << opname(bytecode[offset]) << right << setw(14) << offsets[offset].objects << setw(14) << offsets[offset].bytes << endl;
+    }
+
+    out << "lifetimes of freed objects (instructions):" << endl;
+    for (unsigned i = 0; i < LIFETIME_BUCKETS; ++i) {
+        if (not lifetimes[i]) { continue; }
+        string range = (i == 0 ? "0" : to_string(1ULL << (i-1)));
+        if (i > 1) { range += '-' + (i+1 < LIFETIME_BUCKETS ? to_string((1ULL << i) - 1) : ""); }
+        out << left << setw(16) << range << right << setw(14) << lifetimes[i] << endl;
+    }
+
+    uint64_t held = 0;
+    for (auto& type : census) { held += type.second.objects; }
+    out << "live in registers at exit: " << held << " objects" << endl;
+    for (auto& type : bySize(census)) {
+        out << left << setw(16) << type.first << right << setw(14) << type.second.objects << setw(14) << type.second.bytes << endl;
+    }
+}
+
+void AllocationStats::json(ostream& out, const byte* bytecode) const {
+    out << "{\n";
+    out << "    \"allocations\": " << counter(allocations) << ",\n";
+    out << "    \"frees\": " << counter(frees) << ",\n";
+    out << "    \"live\": " << counter(live) << ",\n";
+    out << "    \"peak\": " << counter(peak) << ",\n";
+    out << "    \"outside\": " << counter(outside) << ",\n";
+    out << "    \"untracked\": " << counter(untracked) << ",\n";
+
+    auto list = [&out](const string& key, const vector<pair<string, Counter> >& entries, const string& field) {
+        out << "    \"" << key << "\": [";
+        bool first = true;
+        for (auto& entry : entries) {
+            out << (first ? "\n" : ",\n");
+            out << "        {\"" << field << "\": " << str::enquote(entry.first) << ", \"objects\": " << entry.second.objects << ", \"bytes\": " << entry.second.bytes << '}';
+            first = false;
+        }
+        out << "\n    ],\n";
+    };
+    list("types", bySize(types), "type");
+
+    vector<pair<string, Counter> > by_opcode;
+    for (byte opcode : allocating(*this)) { by_opcode.push_back(make_pair(opname(opcode), opcodes[opcode])); }
+    list("opcodes", by_opcode, "opcode");
+
+    out << "    \"offsets\": [";
+    bool first = true;
+    for (uint32_t offset = 0; offset < offsets.size(); ++offset) {
+        if (not offsets[offset].objects) { continue; }
+        out << (first ? "\n" : ",\n");
+        out << "        {\"offset\": " << offset << ", \"opcode\": " << str::enquote(opname(bytecode[offset]));
+        out << ", \"objects\": " << offsets[offset].objects << ", \"bytes\": " << offsets[offset].bytes << '}';
+        first = false;
+    }
+    out << "\n    ],\n";
+
+    out << "    \"lifetimes\": [";
+    first = true;
+    for (unsigned i = 0; i < LIFETIME_BUCKETS; ++i) {
+        if (not lifetimes[i]) { continue; }
+        out << (first ? "\n" : ",\n");
+        out << "        {\"min\": " << (i ? 1ULL << (i-1) : 0) << ", \"max\": ";
+        if (i+1 < LIFETIME_BUCKETS) { out << (i ? (1ULL << i) - 1 : 0); } else { out << "null"; }
+        out << ", \"objects\": " << lifetimes[i] << '}';
+        first = false;
+    }
+    out << "\n    ],\n";
+
+    out << "    \"census\": [";
+    first = true;
+    for (auto& entry : bySize(census)) {
+        out << (first ? "\n" : ",\n");
+        out << "        {\"type\": " << str::enquote(entry.first) << ", \"objects\": " << entry.second.objects << ", \"bytes\": " << entry.second.bytes << '}';
+        first = false;
+    }
+    out << "\n    ]\n";
+    out << "}\n";
+}
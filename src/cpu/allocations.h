@@ -0,0 +1,116 @@
+#ifndef WUDOO_CPU_ALLOCATIONS_H
+#define WUDOO_CPU_ALLOCATIONS_H
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../types/object.h"
+
+
+class AllocationStats : public AllocationObserver {
+    /*  Allocation and lifetime statistics of objects, collected by a CPU running with them (see CPU::allocation_stats).
+     *
+     *  The CPU installs the statistics as the allocation observer of its thread while it runs, and
+     *  tells them which instruction is running, so every object is attributed to the opcode and
+     *  the bytecode offset of the instruction that created it.
+     *  Types of objects are read when the instruction finishes (while an object is being constructed
+     *  its type is not known yet); objects freed by the instruction that created them are counted as "(temporary)".
+     *  Lifetimes are measured in executed instructions.
+     */
+    public:
+        struct Counter {
+            uint64_t objects;
+            uint64_t bytes;
+
+            void add(uint64_t size) { ++objects; bytes += size; }
+            Counter(): objects(0), bytes(0) {}
+        };
+
+        static const unsigned LIFETIME_BUCKETS = 33;
+
+        Counter allocations;
+        Counter frees;
+        Counter live;
+        Counter peak;
+
+        // objects allocated when no instruction was running (e.g. by an embedding program)
+        Counter outside;
+
+        // frees of objects allocated before the statistics were installed
+        Counter untracked;
+
+        std::map<std::string, Counter> types;
+        Counter opcodes[256];
+        std::vector<Counter> offsets;
+
+        /*  Freed objects by lifetime: bucket 0 counts objects freed by the instruction that created them, and
+         *  bucket N objects that lived for 2^(N-1) up to 2^N - 1 instructions.
+         */
+        uint64_t lifetimes[LIFETIME_BUCKETS];
+
+        // objects held in registers at the end of a run, by type (see CPU::census())
+        std::map<std::string, Counter> census;
+
+        void prepare(uint32_t bytecode_size) {
+            if (offsets.size() < bytecode_size) { offsets.resize(bytecode_size); }
+        }
+
+        void begin(byte opcode, uint32_t offset) {
+            running = true;
+            current_opcode = opcode;
+            current_offset = offset;
+            ++clock;
+        }
+        void settle();
+
+        void allocated(const Object* object, std::size_t size);
+        void freed(const Object* object, std::size_t size);
+
+        // size of a live object (0 if it was allocated before the statistics were installed)
+        uint64_t size(const Object* object) const;
+
+        /*  Human-readable report, and the same data as JSON:
+         *
+         *      {
+         *          "allocations": {"objects": <number>, "bytes": <number>},
+         *          "frees": {...}, "live": {...}, "peak": {...}, "outside": {...}, "untracked": {...},
+         *          "types": [{"type": "Integer", "objects": <number>, "bytes": <number>}, ...],
+         *          "opcodes": [{"opcode": "istore", "objects": <number>, "bytes": <number>}, ...],
+         *          "offsets": [{"offset": <number>, "opcode": "istore", "objects": <number>, "bytes": <number>}, ...],
+         *          "lifetimes": [{"min": <number>, "max": <number>, "objects": <number>}, ...],
+         *          "census": [{"type": "Integer", "objects": <number>, "bytes": <number>}, ...]
+         *      }
+         *
+         *  Types, opcodes and the census are sorted by bytes, offsets by offset; only non-empty entries are listed.
+         *  Opcodes of instructions at offsets are read from the bytecode the statistics were collected for.
+         */
+        void report(std::ostream& out, const byte* bytecode, unsigned hottest = 10) const;
+        void json(std::ostream& out, const byte* bytecode) const;
+
+        AllocationStats();
+
+    private:
+        struct Living {
+            uint64_t born;
+            uint64_t size;
+            bool settled;
+        };
+        std::unordered_map<const Object*, Living> living;
+
+        // objects created by the running instruction, whose types are not known yet
+        std::vector<const Object*> pending;
+
+        bool running;
+        byte current_opcode;
+        uint32_t current_offset;
+        uint64_t clock;
+};
+
+
+#endif
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "../support/string.h"
+#include "coverage.h"
+using namespace std;
+
+
+struct Totals {
+    unsigned executed;
+    uint64_t instructions;
+    uint64_t covered;
+};
+
+static Totals total(const vector<BlockCoverage::Block>& blocks) {
+    Totals totals = {0, 0, 0};
+    for (const BlockCoverage::Block& block : blocks) {
+        totals.instructions += block.instructions;
+        if (block.count) {
+            ++totals.executed;
+            totals.covered += block.instructions;
+        }
+    }
+    return totals;
+}
+
+BlockCoverage::BlockCoverage(const CodeImagePtr& program): image(program), starts(program->blocks()) {
+    /*  Walk instructions of every block once, to find where it ends and whether execution falls through from it.
+     */
+    const byte* code = image->bytecode();
+    uint32_t bytes = image->bytes();
+    entries.assign(starts.size(), 0);
+    falls.assign(starts.size(), false);
+    ends.assign(starts.size(), 0);
+    sizes.assign(starts.size(), 0);
+    if (starts.empty()) { return; }
+
+    index.assign(bytes, 0);
+    for (unsigned i = 0; i < starts.size(); ++i) {
+        uint32_t limit = (i+1 < starts.size() ? starts[i+1] : bytes);
+        uint32_t offset = starts[i];
+        byte last = 0;
+        while (offset < limit) {
+            unsigned size = opsize(code[offset]);
+            if (size == 0 or offset + size > bytes) { break; }
+            last = code[offset];
+            offset += size;
+            ++sizes[i];
+        }
+        ends[i] = offset;
+        falls[i] = (i+1 < starts.size() and offset == starts[i+1] and last != JUMP and last != BRANCH and last != HALT);
+        for (uint32_t o = starts[i]; o < limit; ++o) { index[o] = i; }
+    }
+}
+
+vector<BlockCoverage::Block> BlockCoverage::blocks() const {
+    vector<Block> result;
+    uint64_t following = 0;
+    for (unsigned i = 0; i < starts.size(); ++i) {
+        uint64_t count = entries[i] + following;
+        result.push_back(Block{starts[i], ends[i], sizes[i], count});
+        following = (falls[i] ? count : 0);
+    }
+    return result;
+}
+
+void BlockCoverage::report(ostream& out) const {
+    vector<Block> all = blocks();
+    Totals totals = total(all);
+    out << "coverage: " << totals.executed << " of " << all.size() << " blocks, " << totals.covered << " of " << totals.instructions << " instructions executed" << endl;
+}
+
+void BlockCoverage::json(ostream& out) const {
+    const DebugInfo* info = image->debuginfo();
+    vector<Block> all = blocks();
+    Totals totals = total(all);
+
+    out << "{\n";
+    out << "    \"blocks\": " << all.size() << ",\n";
+    out << "    \"executed\": " << totals.executed << ",\n";
+    out << "    \"instructions\": " << totals.instructions << ",\n";
+    out << "    \"covered\": " << totals.covered << ",\n";
+    out << "    \"counts\": [";
+    for (unsigned i = 0; i < all.size(); ++i) {
+        const Block& block = all[i];
+        out << (i ? ",\n" : "\n");
+        out << "        {\"offset\": " << block.offset << ", \"end\": " << block.end << ", \"instructions\": " << block.instructions;
+        if (info) {
+            unsigned line = info->line(block.offset);
+            string mark = info->enclosing(block.offset);
+            if (line) { out << ", \"line\": " << line; }
+            if (mark.size()) { out << ", \"mark\": " << str::enquote(mark); }
+        }
+        out << ", \"count\": " << block.count << '}';
+    }
+    out << "\n    ]\n";
+    out << "}\n";
+}
+
+void BlockCoverage::lcov(ostream& out, const string& test) const {
+    const DebugInfo* info = image->debuginfo();
+    if (not info) { throw "program has no debug information (assemble it with wudoo-asm -g)"; }
+
+    const byte* code = image->bytecode();
+    vector<Block> all = blocks();
+    map<unsigned, uint64_t> lines;
+    for (const Block& block : all) {
+        for (uint32_t offset = block.offset; offset < block.end; offset += opsize(code[offset])) {
+            unsigned line = info->line(offset);
+            if (not line) { continue; }
+            uint64_t& count = lines[line];
+            if (block.count > count) { count = block.count; }
+        }
+    }
+
+    out << "TN:" << test << '\n';
+    out << "SF:" << info->file << '\n';
+    unsigned functions = 0, functions_hit = 0;
+    for (auto& mark : info->marks) {
+        unsigned line = info->line(mark.first);
+        if (mark.first >= index.size() or not line) { continue; }
+        out << "FN:" << line << ',' << mark.second << '\n';
+    }
+    for (auto& mark : info->marks) {
+        unsigned line = info->line(mark.first);
+        if (mark.first >= index.size() or not line) { continue; }
+        uint64_t count = all[index[mark.first]].count;
+        out << "FNDA:" << count << ',' << mark.second << '\n';
+        ++functions;
+        if (count) { ++functions_hit; }
+    }
+    out << "FNF:" << functions << '\n';
+    out << "FNH:" << functions_hit << '\n';
+    unsigned hit = 0;
+    for (auto& line : lines) {
+        out << "DA:" << line.first << ',' << line.second << '\n';
+        if (line.second) { ++hit; }
+    }
+    out << "LF:" << lines.size() << '\n';
+    out << "LH:" << hit << '\n';
+    out << "end_of_record" << '\n';
+}
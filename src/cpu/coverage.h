@@ -0,0 +1,80 @@
+#ifndef WUDOO_CPU_COVERAGE_H
+#define WUDOO_CPU_COVERAGE_H
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "image.h"
+
+
+class BlockCoverage {
+    /*  Execution counts of basic blocks (see CodeImage::blocks()), collected by a CPU running with them (see CPU::coverage).
+     *
+     *  The CPU stops at every transfer of control anyway, to pay for the block it enters (see CPU::pay()), and
+     *  counts the entry there, so there is one counter per block and straight-line code costs nothing.
+     *  Blocks that execution falls through into are not entered by a transfer of control, so
+     *  a block is executed as many times as it was entered plus as many times as the block before it
+     *  was executed, if that one does not end with a jump, branch or halt.
+     *  A block is counted as executed when it is entered, even if an instruction in it throws.
+     */
+    public:
+        struct Block {
+            uint32_t offset;
+            // offset just past the last instruction of the block, and number of its instructions
+            uint32_t end;
+            unsigned instructions;
+            uint64_t count;
+        };
+
+        explicit BlockCoverage(const CodeImagePtr& image);
+
+        void enter(uint32_t offset) {
+            if (offset < index.size()) { ++entries[index[offset]]; }
+        }
+
+        // blocks with execution counts, sorted by offset
+        std::vector<Block> blocks() const;
+
+        /*  One line summary: executed blocks and instructions out of all of them.
+         */
+        void report(std::ostream& out) const;
+
+        /*  Execution counts as JSON:
+         *
+         *      {
+         *          "blocks": <number>, "executed": <number>,
+         *          "instructions": <number>, "covered": <number>,
+         *          "counts": [{"offset": <number>, "end": <number>, "instructions": <number>, "count": <number>}, ...]
+         *      }
+         *
+         *  All blocks are listed (also those that never ran), sorted by offset.
+         *  With debug information, blocks also carry "line" (of their first instruction) and
+         *  "mark" (the mark they are in, if any).
+         */
+        void json(std::ostream& out) const;
+
+        /*  Line coverage of the source of the program, as an lcov tracefile (for genhtml and compatible tools).
+         *  A line is executed as many times as the most executed instruction assembled from it, and
+         *  marks are reported as functions.
+         *  Throws if the program was assembled without debug information.
+         */
+        void lcov(std::ostream& out, const std::string& test = "") const;
+
+    private:
+        CodeImagePtr image;
+        std::vector<uint32_t> starts;
+        // bytecode offset -> block the offset is in
+        std::vector<uint32_t> index;
+        std::vector<uint64_t> entries;
+        // whether execution falls through from the block into the next one
+        std::vector<bool> falls;
+        std::vector<uint32_t> ends;
+        std::vector<unsigned> sizes;
+};
+
+
+#endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include "../bytecode/bytetypedef.h"
@@ -7,42 +8,164 @@
 #include "../types/integer.h"
 #include "../types/byte.h"
 #include "../support/pointer.h"
+#include "../support/cycles.h"
 #include "cpu.h"
 using namespace std;
 
 
-CPU& CPU::load(byte* bc) {
-    /*  Load bytecode into the CPU.
-     *  CPU becomes owner of loaded bytecode - meaning it will consider itself responsible for proper
-     *  destruction of it, so make sure you have a copy of the bytecode.
+CPU& CPU::load(const CodeImagePtr& img) {
+    /*  Load an image into the CPU.
+     *  CPU keeps a reference to the image (so the image stays alive as long as it may be executed), but
+     *  does not copy it - any number of CPUs may run the same image.
      *
-     *  Any previously loaded bytecode is freed.
-     *  To free bytecode without loading anything new it is possible to call .load(0).
+     *  Reference to any previously loaded image is dropped.
+     *  To drop it without loading anything new it is possible to call .load(CodeImagePtr()).
      *
      *  :params:
      *
-     *  bc:char*    - pointer to byte array containing bytecode with a program to run
+     *  img:CodeImagePtr    - image of the program to run
      */
-    if (bytecode) { delete[] bytecode; }
-    bytecode = bc;
+    image = img;
+    bytecode = (image ? image->bytecode() : 0);
+    bytecode_size = (image ? image->bytes() : 0);
+    executable_offset = (image ? image->eoffset() : 0);
+    retired = 0;
+    return start(executable_offset);
+}
+
+CPU& CPU::start(uint32_t offset) {
+    /*  Set offset of the instruction at which execution of the program begins
+     *  (processes spawned by a program begin at instructions given to `spawn`).
+     */
+    instruction_pointer = (bytecode ? bytecode+offset : 0);
+    finished = false;
+    return_code = 0;
+    block_paid = false;
     return (*this);
 }
 
-CPU& CPU::bytes(uint16_t sz) {
-    /*  Set bytecode size, so the CPU can stop execution even if it doesn't reach HALT instruction but reaches
-     *  bytecode address out of bounds.
+int CPU::exitcode() const {
+    /*  Exit code of a finished program.
+     */
+    return return_code;
+}
+
+
+struct CPU::SharedObjects {
+    /*  Objects frozen when a CPU was cloned.
+     */
+    vector<Object*> objects;
+
+    ~SharedObjects() {
+        for (Object* object : objects) { delete object; }
+    }
+};
+
+CPU* CPU::clone() {
+    CPU* copy = new CPU(reg_count);
+    clone(*copy);
+    return copy;
+}
+
+CPU& CPU::clone(CPU& copy) {
+    /*  Objects owned by the CPU become shared (they are frozen: neither the CPU nor the clone modifies them), and
+     *  the clone gets copies of the register arrays and references to all shared objects.
+     *  Objects frozen by earlier clones stay in their own sets, so cloning a CPU again does not copy anything more.
      */
-    bytecode_size = sz;
+    if (copy.reg_count != reg_count or copy.image) { throw "clone: target must be a new CPU with the same number of registers"; }
+
+    shared_ptr<SharedObjects> frozen(new SharedObjects());
+    for (int i = 0; i < reg_count; ++i) {
+        if (registers[i] and !references[i] and !shared[i]) { frozen->objects.push_back(registers[i]); }
+    }
+    for (int i = 0; i < reg_count; ++i) { shared[i] = (registers[i] != 0); }
+    if (frozen->objects.size()) { shared_objects.push_back(frozen); }
+
+    copy.image = image;
+    copy.bytecode = bytecode;
+    copy.bytecode_size = bytecode_size;
+    copy.executable_offset = executable_offset;
+    copy.instruction_pointer = instruction_pointer;
+    copy.finished = finished;
+    copy.return_code = return_code;
+    copy.metered = metered;
+    copy.fuel = fuel;
+    copy.block_paid = block_paid;
+    copy.shared_objects = shared_objects;
+    std::copy(registers, registers+reg_count, copy.registers);
+    std::copy(references, references+reg_count, copy.references);
+    std::copy(shared, shared+reg_count, copy.shared);
+    copy.debug = debug;
+    copy.out.rdbuf(out.rdbuf());
+    return copy;
+}
+
+CPU& CPU::limit(uint64_t instructions) {
+    metered = (instructions != 0);
+    fuel = instructions;
     return (*this);
 }
 
-CPU& CPU::eoffset(uint16_t o) {
-    /*  Set offset of first executable instruction.
+uint64_t CPU::remaining() const {
+    return fuel;
+}
+
+int CPU::trap() {
+    /*  Stop a program which ran out of fuel.
      */
-    executable_offset = o;
+    out << "CPU: stopped: instruction limit exceeded" << endl;
+    finished = true;
+    return_code = FUEL_EXHAUSTED_EXIT_CODE;
+    return return_code;
+}
+
+bool CPU::pay(const byte* block, uint64_t& spent) {
+    /*  Pay for instructions from given one to the end of its basic block.
+     *  Returns false (and pays nothing) if there is not enough fuel for all of them.
+     */
+    uint32_t cost = image->cost(block - bytecode);
+    if (metered) {
+        if (fuel < cost) { return false; }
+        fuel -= cost;
+    }
+    if (coverage) { coverage->enter(block - bytecode); }
+    spent += cost;
+    block_paid = true;
+    return true;
+}
+
+
+Object* CPU::peek(int index) const {
+    /*  Return pointer to object at given register, or null if the register is empty.
+     *  Unlike fetch() this never throws - it is meant for code embedding the CPU.
+     */
+    if (index < 0 or index >= reg_count) { return 0; }
+    return registers[index];
+}
+
+CPU& CPU::put(int index, Object* object) {
+    /*  Place an object in a register from outside of the program, e.g.
+     *  an argument of a newly spawned process.
+     */
+    place(index, object);
     return (*this);
 }
 
+Object* CPU::writable(int index) {
+    /*  Return pointer to object at given register, which may be modified in place.
+     *  A shared object is first copied, and every register holding it (i.e. references to it) gets the copy.
+     */
+    Object* object = fetch(index);
+    if (not shared[index]) { return object; }
+    Object* own = object->copy();
+    for (int i = 0; i < reg_count; ++i) {
+        if (registers[i] == object) {
+            registers[i] = own;
+            shared[i] = false;
+        }
+    }
+    return own;
+}
 
 Object* CPU::fetch(int index) {
     /*  Return pointer to object at given register.
@@ -79,13 +202,23 @@ void CPU::updaterefs(Object* before, Object* now) {
     for (int i = 0; i < reg_count; ++i) {
         if (registers[i] == before and references[i]) {
             if (debug) {
-                cout << "CPU: updating reference address in register " << i << hex << ": 0x" << (unsigned long)before << " -> 0x" << (unsigned long)now << dec << endl;
+                out << "CPU: updating reference address in register " << i << hex << ": 0x" << (unsigned long)before << " -> 0x" << (unsigned long)now << dec << endl;
             }
             registers[i] = now;
+            shared[i] = false;
         }
     }
 }
 
+string CPU::where(uint32_t offset) const {
+    const DebugInfo* info = (image ? image->debuginfo() : 0);
+    if (not info) { return ""; }
+    string location = info->location(offset);
+    string mark = info->enclosing(offset);
+    if (location.empty()) { location = "byte " + to_string(offset); }
+    return (mark.size() ? location + ", in :" + mark : location);
+}
+
 bool CPU::hasrefs(int index) {
     /** This method checks if object at a given address exists as a reference in another register.
      */
@@ -108,12 +241,12 @@ void CPU::place(int index, Object* obj) {
      *
      */
     if (index >= reg_count) { throw "register access out of bounds: write"; }
-    if (registers[index] != 0 and !references[index]) {
+    if (registers[index] != 0 and !references[index] and !shared[index]) {
         // register is not empty and is not a reference - the object in it must be destroyed to avoid memory leaks
         delete registers[index];
     }
     if (references[index]) {
-        Object* referenced = fetch(index);
+        Object* referenced = writable(index);
 
         // it is a reference, copy value of the object
         if (referenced->type() == "Integer") { copyvalue<Integer*>(referenced, obj); }
@@ -124,35 +257,135 @@ void CPU::place(int index, Object* obj) {
     } else {
         Object* old_ref_ptr = (hasrefs(index) ? registers[index] : 0);
         registers[index] = obj;
+        shared[index] = false;
         if (old_ref_ptr) { updaterefs(old_ref_ptr, obj); }
     }
 }
 
 
 int CPU::run() {
+    /*  Run the loaded program from its first executable instruction to the end.
+     */
+    if (!bytecode) {
+        throw "null bytecode (maybe not loaded?)";
+    }
+    start(executable_offset);
+    Slice slice;
+    while ((slice = resume()) != FINISHED) {
+        if (slice == EXHAUSTED) { return trap(); }
+    }
+    return return_code;
+}
+
+CPU::Slice CPU::resume(uint64_t budget) {
+    if (profile and bytecode) {
+        profile->prepare(bytecode_size);
+        return execute<PROFILED>(budget);
+    }
+    if (published_offset) {
+        Slice slice = execute<PUBLISHED>(budget);
+        *published_offset = -1;
+        return slice;
+    }
+    if (tracer) {
+        return execute<TRACED>(budget);
+    }
+    if (allocation_stats and bytecode) {
+        allocation_stats->prepare(bytecode_size);
+        AllocationObserver* previous = Object::observer;
+        Object::observer = allocation_stats;
+        Slice slice = execute<ALLOCATIONS>(budget);
+        // objects created by an instruction that threw are settled here
+        allocation_stats->settle();
+        Object::observer = previous;
+        return slice;
+    }
+    return execute<PLAIN>(budget);
+}
+
+void CPU::census(AllocationStats& stats) const {
+    for (int i = 0; i < reg_count; ++i) {
+        if (not registers[i] or references[i]) { continue; }
+        stats.census[registers[i]->type()].add(stats.size(registers[i]));
+    }
+}
+
+void CPU::trace(const byte* instruction) {
+    /*  Operands that are references are resolved the same way instructions resolve them
+     *  (when the register holds an integer), so the trace shows which registers were actually used.
+     */
+    Tracer::Record& record = tracer->claim();
+    record.time = cycles::now();
+    record.offset = (instruction - bytecode);
+    record.opcode = *instruction;
+    record.resolved = 0;
+    record.reserved = 0;
+
+    Tracer::Operand operands[Tracer::MAX_OPERANDS];
+    unsigned count = Tracer::operands(instruction, operands);
+    for (unsigned i = 0; i < Tracer::MAX_OPERANDS; ++i) {
+        record.operands[i] = (i < count ? operands[i].value : 0);
+        if (i >= count or not operands[i].ref or operands[i].value < 0 or operands[i].value >= reg_count) { continue; }
+        Integer* resolved = dynamic_cast<Integer*>(registers[operands[i].value]);
+        if (resolved) {
+            record.operands[i] = resolved->value();
+            record.resolved |= (1 << i);
+        }
+    }
+    tracer->commit();
+}
+
+template<CPU::Instrumentation MODE> CPU::Slice CPU::execute(uint64_t budget) {
     /*  VM CPU implementation.
      *
      *  A giant switch-in-while which iterates over bytecode and executes encoded instructions.
+     *
+     *  Execution stops at the first block boundary after `budget` instructions (if it is not 0), after a `yield` instruction,
+     *  at a channel instruction that can not proceed, or when fuel runs out, and
+     *  position in the bytecode is saved so that the next call continues from there.
+     *
+     *  PROFILED instantiation records every executed instruction in the profile, and
+     *  PUBLISHED instantiation publishes offset of every instruction before executing it,
+     *  TRACED instantiation records it in the tracer, and
+     *  ALLOCATIONS instantiation attributes objects created by every instruction to it.
      */
     if (!bytecode) {
         throw "null bytecode (maybe not loaded?)";
     }
-    int return_code = 0;
+    if (finished) { return FINISHED; }
+    waiting_channel.reset();
 
     bool halt = false;
+    bool broke = false;
+    Slice slice = FINISHED;
+
+    const byte* instr_ptr = instruction_pointer; // instruction pointer
+    volatile sig_atomic_t* published = published_offset;
 
-    byte* instr_ptr = bytecode+executable_offset; // instruction pointer
+    // instructions paid for in this slice, and whether the last instruction entered a new block
+    uint64_t spent = 0;
+    bool entered = false;
+    if (not block_paid and instr_ptr < (bytecode+bytecode_size) and not pay(instr_ptr, spent)) { return EXHAUSTED; }
 
     while (true) {
         if (debug) {
-            cout << "CPU: bytecode ";
-            cout << dec << ((long)instr_ptr - (long)bytecode);
-            cout << " at 0x" << hex << (long)instr_ptr;
-            cout << dec << ": ";
+            out << "CPU: bytecode ";
+            out << dec << ((long)instr_ptr - (long)bytecode);
+            out << " at 0x" << hex << (long)instr_ptr << dec;
+            string location = where(instr_ptr - bytecode);
+            if (location.size()) { out << " (" << location << ')'; }
+            out << ": ";
         }
 
+        // opcode and offset of the instruction, and when it started (used only when profiling)
+        const byte* executed = instr_ptr;
+        uint64_t started = (MODE == PROFILED ? cycles::now() : 0);
+        if (MODE == PUBLISHED) { *published = (instr_ptr - bytecode); }
+        if (MODE == TRACED) { trace(instr_ptr); }
+        if (MODE == ALLOCATIONS) { allocation_stats->begin(*instr_ptr, instr_ptr - bytecode); }
+
         try {
-            if (debug) { cout << OP_NAMES.at(OPCODE(*instr_ptr)); }
+            if (debug) { out << OP_NAMES.at(OPCODE(*instr_ptr)); }
             switch (*instr_ptr) {
                 case ISTORE:
                     instr_ptr = istore(instr_ptr+1);
@@ -225,9 +458,11 @@ int CPU::run() {
                     break;
                 case JUMP:
                     instr_ptr = jump(instr_ptr+1);
+                    entered = true;
                     break;
                 case BRANCH:
                     instr_ptr = branch(instr_ptr+1);
+                    entered = true;
                     break;
                 case RET:
                     instr_ptr = ret(instr_ptr+1);
@@ -238,27 +473,87 @@ int CPU::run() {
                 case PASS:
                     ++instr_ptr;
                     break;
+                case SPAWN:
+                    instr_ptr = spawn(instr_ptr+1);
+                    break;
+                case YIELD:
+                    instr_ptr = yield(instr_ptr+1);
+                    break;
+                case CHAN:
+                    instr_ptr = chan(instr_ptr+1);
+                    break;
+                case SEND:
+                    instr_ptr = send(instr_ptr+1);
+                    break;
+                case RECV:
+                    instr_ptr = recv(instr_ptr+1);
+                    break;
+                case TRYRECV:
+                    instr_ptr = tryrecv(instr_ptr+1);
+                    break;
+                case BREAK:
+                    /*  Stop before the instruction the BREAK was patched over, the same way `yield` stops after it
+                     *  (so the run loop does not test for breakpoints after every instruction).
+                     */
+                    yielded = true;
+                    broke = true;
+                    break;
                 default:
                     ostringstream error;
                     error << "unrecognised instruction (bytecode value: " << *((int*)bytecode) << ")";
                     throw error.str().c_str();
             }
-            if (debug) { cout << endl; }
+            if (MODE == PROFILED) { profile->record(*executed, executed - bytecode, cycles::now() - started); }
+            if (MODE == ALLOCATIONS) { allocation_stats->settle(); }
+            if (debug) { out << endl; }
         } catch (const char* &e) {
             return_code = 1;
-            cout << (debug ? "\n" : "") <<  "exception: " << e << endl;
+            out << (debug ? "\n" : "") <<  "exception: " << e << endl;
+            string location = where(executed - bytecode);
+            if (location.size()) { out << "    at " << location << endl; }
             break;
         }
 
         if (halt) break;
 
         if (instr_ptr >= (bytecode+bytecode_size)) {
-            cout << "CPU: aborting: bytecode address out of bounds" << endl;
+            out << "CPU: aborting: bytecode address out of bounds" << endl;
             return_code = 1;
             break;
         }
+
+        if (yielded) {
+            yielded = false;
+            slice = (broke ? BREAKPOINT : YIELDED);
+            break;
+        }
+        if (waiting_channel) {
+            // instruction pointer was left at the blocked instruction
+            slice = BLOCKED;
+            break;
+        }
+        if (entered) {
+            /*  Slices end, and fuel is checked, only at starts of blocks.
+             *  The new block is not paid for yet, so when execution continues it is paid for then.
+             */
+            entered = false;
+            block_paid = false;
+            if (budget and spent >= budget) {
+                slice = PREEMPTED;
+                break;
+            }
+            if (not pay(instr_ptr, spent)) {
+                slice = EXHAUSTED;
+                break;
+            }
+        }
     }
 
+    retired += spent;
+    instruction_pointer = instr_ptr;
+    if (slice != FINISHED) { return slice; }
+    finished = true;
+
     if (return_code == 0 and registers[0]) {
         // if return code if the default one and
         // return register is not unused
@@ -266,5 +561,5 @@ int CPU::run() {
         return_code = static_cast<Integer*>(registers[0])->value();
     }
 
-    return return_code;
+    return FINISHED;
 }
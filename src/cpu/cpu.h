@@ -3,21 +3,76 @@
 
 #pragma once
 
+#include <csignal>
 #include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
 #include "../bytecode/bytetypedef.h"
 #include "../types/object.h"
+#include "image.h"
+#include "profile.h"
+#include "tracer.h"
+#include "allocations.h"
+#include "coverage.h"
 
 
 const int DEFAULT_REGISTER_SIZE = 256;
 
+// exit code of programs stopped because they exceeded their limit of instructions
+const int FUEL_EXHAUSTED_EXIT_CODE = 124;
+
+
+class Scheduler;
+class ChannelState;
+
+
+/*  Number of times targets of a jump or a branch were taken during a run.
+ *  Branches count taken true and false targets, jumps use only the first counter.
+ */
+struct BranchCounts {
+    bool conditional;
+    uint64_t taken[2];
+
+    BranchCounts(): conditional(false) { taken[0] = taken[1] = 0; }
+};
+
+// bytecode offset of jump or branch instruction -> its counts
+typedef std::map<uint32_t, BranchCounts> BranchProfile;
+
 
 class CPU {
-    /*  Bytecode pointer is a pointer to program's code.
-     *  Size and executable offset are metadata exported from bytecode dump.
+    /*  Image of the program the CPU runs.
+     *  It is shared with other CPUs running the same program and never modified;
+     *  bytecode pointer, size and executable offset are taken from it when it is loaded.
      */
-    byte* bytecode;
-    uint16_t bytecode_size;
-    uint16_t executable_offset;
+    CodeImagePtr image;
+    const byte* bytecode;
+    uint32_t bytecode_size;
+    uint32_t executable_offset;
+
+    /*  Execution state kept between slices of execution (see resume()):
+     *  address of the next instruction, whether the program finished and its return code.
+     */
+    const byte* instruction_pointer;
+    bool finished;
+    int return_code;
+    bool yielded;
+
+    /*  Fuel metering.
+     *  When metered, the CPU has fuel for a number of instructions and stops when it would run out.
+     *  Instructions are paid for a basic block at a time, when execution enters it (where a slice begins, and
+     *  at targets of jumps and branches), so cost of metering does not grow with the number of instructions.
+     */
+    bool metered;
+    uint64_t fuel;
+    bool block_paid;
+    bool pay(const byte*, uint64_t& spent);
+
+    // instructions paid for since the program was loaded (see instructions())
+    uint64_t retired;
 
     /*  Registers and their number stored.
      */
@@ -25,96 +80,257 @@ class CPU {
     bool* references;
     int reg_count;
 
+    /*  Objects shared with clones of the CPU (see clone()).
+     *  Registers marked as shared hold objects owned jointly by the CPU and its clones (or its parent):
+     *  they are never modified or deleted by the CPU - a register is given its own copy of the object
+     *  before it is modified in place, and a shared object is simply dropped when the register is overwritten.
+     *  Shared objects are freed together with the last CPU referencing them.
+     */
+    struct SharedObjects;
+    std::vector<std::shared_ptr<SharedObjects> > shared_objects;
+    bool* shared;
+
     /*  Methods to deal with registers.
      */
     void updaterefs(Object* before, Object* now);
     bool hasrefs(int index);
     Object* fetch(int);
+    Object* writable(int);
     void place(int, Object*);
 
+    /*  Where in the source the instruction at given offset comes from ("<file>:<line>, in :<mark>"), or
+     *  an empty string if the program has no debug information.
+     */
+    std::string where(uint32_t offset) const;
+
     /*  Methods implementing CPU instructions.
      */
-    byte* istore(byte*);
-    byte* iadd(byte*);
-    byte* isub(byte*);
-    byte* imul(byte*);
-    byte* idiv(byte*);
+    const byte* istore(const byte*);
+    const byte* iadd(const byte*);
+    const byte* isub(const byte*);
+    const byte* imul(const byte*);
+    const byte* idiv(const byte*);
+
+    const byte* ilt(const byte*);
+    const byte* ilte(const byte*);
+    const byte* igt(const byte*);
+    const byte* igte(const byte*);
+    const byte* ieq(const byte*);
+
+    const byte* iinc(const byte*);
+    const byte* idec(const byte*);
 
-    byte* ilt(byte*);
-    byte* ilte(byte*);
-    byte* igt(byte*);
-    byte* igte(byte*);
-    byte* ieq(byte*);
+    const byte* bstore(const byte*);
 
-    byte* iinc(byte*);
-    byte* idec(byte*);
+    const byte* boolean(const byte*);
+    const byte* lognot(const byte*);
+    const byte* logand(const byte*);
+    const byte* logor(const byte*);
 
-    byte* bstore(byte*);
+    const byte* move(const byte*);
+    const byte* copy(const byte*);
+    const byte* ref(const byte*);
+    const byte* swap(const byte*);
+    const byte* del(const byte*);
+    const byte* isnull(const byte*);
 
-    byte* boolean(byte*);
-    byte* lognot(byte*);
-    byte* logand(byte*);
-    byte* logor(byte*);
+    const byte* ret(const byte*);
 
-    byte* move(byte*);
-    byte* copy(byte*);
-    byte* ref(byte*);
-    byte* swap(byte*);
-    byte* del(byte*);
-    byte* isnull(byte*);
+    const byte* print(const byte*);
+    const byte* echo(const byte*);
 
-    byte* ret(byte*);
+    const byte* jump(const byte*);
+    const byte* branch(const byte*);
 
-    byte* print(byte*);
-    byte* echo(byte*);
+    const byte* spawn(const byte*);
+    const byte* yield(const byte*);
 
-    byte* jump(byte*);
-    byte* branch(byte*);
+    const byte* chan(const byte*);
+    const byte* send(const byte*);
+    const byte* recv(const byte*);
+    const byte* tryrecv(const byte*);
 
     public:
         // debug flag
         bool debug;
 
+        /*  Stream the CPU writes to: program output, debugging output and error messages.
+         *  Writes to standard output by default, and
+         *  can be redirected by giving it a different stream buffer (with out.rdbuf()).
+         */
+        std::ostream out;
+
+        // when set, executed jumps and branches are counted here
+        BranchProfile* branch_profile;
+
+        /*  When set, entries into basic blocks are counted here when the CPU pays for them (see pay()), so
+         *  the cost is a check per jump or branch and does not need a separate instantiation of the run loop.
+         *  Coverage must be created for the image the CPU runs.
+         */
+        BlockCoverage* coverage;
+
+        // when set, executed instructions are counted, and timed, here
+        ExecutionProfile* profile;
+
+        /*  When set, offset of the instruction being executed is stored here before it is executed (and -1 when
+         *  the CPU is not executing), so that a sampling profiler can read it from a signal handler running on
+         *  the thread of the CPU.
+         */
+        volatile sig_atomic_t* published_offset;
+
+        /*  When set, every executed instruction is recorded in the tracer (with its operands resolved) before
+         *  it is executed.
+         */
+        Tracer* tracer;
+
+        // when set, objects created and freed while the CPU runs are accounted here (see AllocationStats)
+        AllocationStats* allocation_stats;
+
+        /*  Count objects held in registers (objects in reference registers are not counted again) into
+         *  the census of allocation statistics.
+         */
+        void census(AllocationStats& stats) const;
+
+        /*  Scheduler running the CPU as one of its processes.
+         *  Processes started by `spawn` instructions are handed to it;
+         *  without a scheduler `spawn` is an error and `yield` does nothing.
+         */
+        Scheduler* scheduler;
+
+        /*  Channel a blocked CPU waits for, and whether it waits to send to it (otherwise - to receive from it).
+         *  Set when a slice ends with BLOCKED; the blocked instruction is executed again when the CPU is resumed.
+         */
+        std::shared_ptr<ChannelState> waiting_channel;
+        bool waiting_to_send;
+
+        /*  Result of running a slice of a program:
+         *
+         *      * FINISHED  - program halted (or failed), exitcode() is its exit code,
+         *      * PREEMPTED - instruction budget of the slice was used up,
+         *      * YIELDED   - program executed `yield` instruction,
+         *      * BLOCKED   - program can not send to or receive from a channel (see waiting_channel),
+         *      * EXHAUSTED - program ran out of fuel (it can be given more and resumed, or stopped with trap()),
+         *      * BREAKPOINT - program reached a BREAK patched in by a debugger; position() is the offset of the BREAK,
+         *                   and the CPU stops at it every time it is resumed until the original instruction is put back.
+         */
+        enum Slice {
+            FINISHED,
+            PREEMPTED,
+            YIELDED,
+            BLOCKED,
+            EXHAUSTED,
+            BREAKPOINT,
+        };
+
         /*  Public API of the CPU provides basic actions:
          *
-         *      * load bytecode,
-         *      * set its size,
-         *      * tell the CPU where to start execution,
+         *      * load an image of a program (it carries bytecode, its size and where to start execution),
          *      * kick the CPU so it starts running,
+         *
+         *  Programs may also be run in slices: start() sets where execution begins, and
+         *  resume() runs about given number of instructions (0 means no limit; slices end at basic block
+         *  boundaries, so a slice may run a few more) and
+         *  can be called again to continue from where the previous slice stopped.
          */
-        CPU& load(byte*);
-        CPU& bytes(uint16_t);
-        CPU& eoffset(uint16_t);
+        CPU& load(const CodeImagePtr&);
         int run();
 
-        CPU(int r = DEFAULT_REGISTER_SIZE): bytecode(0), bytecode_size(0), executable_offset(0), registers(0), references(0), reg_count(r), debug(false) {
+        CPU& start(uint32_t offset);
+        Slice resume(uint64_t budget = 0);
+        int exitcode() const;
+
+        /*  Limit number of instructions the program may still execute (0 removes the limit), and
+         *  read how many it may still execute.
+         *  run() stops a program that runs out of fuel with trap(); resume() returns EXHAUSTED, and
+         *  the program can be given more fuel and resumed.
+         */
+        CPU& limit(uint64_t instructions);
+        uint64_t remaining() const;
+        int trap();
+
+        /*  Number of instructions executed since the program was loaded, counted the way fuel is
+         *  (a block at a time, so a block left by an exception counts whole), and
+         *  offset of the instruction the CPU continues from.
+         */
+        uint64_t instructions() const { return retired; }
+        uint32_t position() const { return (instruction_pointer and bytecode ? instruction_pointer - bytecode : 0); }
+
+        /*  Inspect contents of a register after (or between) runs.
+         *  Returns null for empty registers and indexes out of bounds.
+         */
+        Object* peek(int) const;
+
+        /*  Put an object in a register (CPU becomes its owner).
+         */
+        CPU& put(int, Object*);
+
+        /*  Save state of a halted or paused (e.g. yielded) CPU: its registers, including references between them, and
+         *  position in the program (see snapshot.h for the format).
+         *  restore() replaces the state of a CPU with a saved one; it must have the same image loaded.
+         *  Both throw if the state can not be saved or restored.
+         */
+        std::vector<byte> snapshot() const;
+        CPU& restore(const byte* data, size_t size);
+
+        /*  Create a copy of the CPU, continuing from the same point of the same program.
+         *  Cloning does not copy objects in registers: the CPU and its clone share them until
+         *  either of them writes to a register (copy-on-write), so many clones of a CPU are cheap.
+         *  Clone writes to the same output stream. Caller becomes owner of the clone.
+         *
+         *  The second form turns a newly created CPU with the same number of registers into the clone.
+         */
+        CPU* clone();
+        CPU& clone(CPU& copy);
+
+        CPU(int r = DEFAULT_REGISTER_SIZE): image(), bytecode(0), bytecode_size(0), executable_offset(0), instruction_pointer(0), finished(false), return_code(0), yielded(false), metered(false), fuel(0), block_paid(false), retired(0), registers(0), references(0), reg_count(r), shared(0), debug(false), out(std::cout.rdbuf()), branch_profile(0), coverage(0), profile(0), published_offset(0), tracer(0), allocation_stats(0), scheduler(0), waiting_channel(), waiting_to_send(false) {
             /*  Basic constructor.
              *  Creates registers array of requested size and
              *  initializes it with zeroes.
              */
             registers = new Object*[reg_count];
             references = new bool[reg_count];
+            shared = new bool[reg_count];
             for (int i = 0; i < reg_count; ++i) {
                 registers[i] = 0;
                 references[i] = false;
+                shared[i] = false;
             }
         }
 
+        CPU(const CPU&) = delete;
+        CPU& operator=(const CPU&) = delete;
+
         ~CPU() {
             /*  Destructor must free all memory allocated for values stored in registers.
              *  Here we iterate over all registers and delete non-null pointers.
              *
-             *  Destructor also frees memory at bytecode pointer so make sure you gave CPU a copy of the bytecode if you want to keep it
-             *  after the CPU is finished.
+             *  Bytecode belongs to the image, which is freed with the last CPU (or other owner) referencing it, and
+             *  shared objects are freed with the last CPU sharing them.
              */
             for (int i = 0; i < reg_count; ++i) {
-                if (registers[i] and !references[i]) {
+                if (registers[i] and !references[i] and !shared[i]) {
                     delete registers[i];
                 }
             }
             delete[] registers;
-            if (bytecode) { delete[] bytecode; }
+            delete[] references;
+            delete[] shared;
         }
+
+    private:
+        /*  Run loop of resume() is instantiated once for every kind of instrumentation (profile, published_offset,
+         *  tracer and allocation_stats), so the plain loop never tests whether one is enabled and
+         *  programs run without instrumentation do not pay for it.
+         */
+        enum Instrumentation {
+            PLAIN,
+            PROFILED,       // counts and times executed instructions
+            PUBLISHED,      // publishes offset of the instruction being executed
+            TRACED,         // records executed instructions
+            ALLOCATIONS,    // accounts objects created and freed
+        };
+        void trace(const byte* instruction);
+        template<Instrumentation MODE> Slice execute(uint64_t budget);
 };
 
 #endif
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "../types/object.h"
+#include "../types/integer.h"
+#include "../types/boolean.h"
+#include "../types/byte.h"
+#include "debugger.h"
+using namespace std;
+
+
+Debugger::Debugger(CPU& c, const CodeImagePtr& program): cpu(c), original(program), next_id(1), done(false), stopped(0), passing(false) {
+    if (program->spawns()) { throw "programs that spawn processes can not be debugged"; }
+    code = CodeImage::copy(*program);
+    cpu.load(code);
+}
+
+unsigned Debugger::add(uint32_t offset, const Condition& condition) {
+    /*  Instructions are found by walking the program from its beginning, the same way the image verifies it.
+     */
+    const byte* bytecode = original->bytecode();
+    uint32_t walked = 0;
+    while (walked < offset and opsize(bytecode[walked])) { walked += opsize(bytecode[walked]); }
+    if (walked != offset or offset >= original->bytes() or opsize(bytecode[offset]) == 0) {
+        throw ("breakpoint must be set at an instruction: byte " + to_string(offset));
+    }
+
+    if (not at(offset)) { patch(offset); }
+    points.push_back(Breakpoint{next_id, offset, condition, 0});
+    return next_id++;
+}
+
+void Debugger::remove(unsigned id) {
+    auto found = find_if(points.begin(), points.end(), [id](const Breakpoint& point) { return point.id == id; });
+    if (found == points.end()) { throw ("no breakpoint " + to_string(id)); }
+    uint32_t offset = found->offset;
+    points.erase(found);
+    if (not at(offset)) { unpatch(offset); }
+    if (stopped == id) { stopped = 0; }
+}
+
+const Debugger::Breakpoint* Debugger::current() const {
+    for (const Breakpoint& point : points) {
+        if (point.id == stopped) { return &point; }
+    }
+    return 0;
+}
+
+vector<uint32_t> Debugger::successors(uint32_t offset) const {
+    vector<uint32_t> next;
+    if (offset >= original->bytes()) { return next; }
+    const byte* instr = instruction(offset);
+    unsigned size = opsize(*instr);
+    if (size == 0 or *instr == HALT) { return next; }
+
+    if (*instr == JUMP) {
+        next.push_back(*((const int*)(instr+1)));
+    } else if (*instr == BRANCH) {
+        const int* targets = (const int*)(instr + 1 + sizeof(bool) + sizeof(int));
+        next.push_back(targets[0]);
+        if (targets[1] != targets[0]) { next.push_back(targets[1]); }
+    } else {
+        next.push_back(offset + size);
+    }
+    // targets outside of the program end the run (the CPU reports them), there is nothing to stop at
+    next.erase(remove_if(next.begin(), next.end(), [this](uint32_t target) { return target >= original->bytes(); }), next.end());
+    return next;
+}
+
+bool Debugger::holds(const Condition& condition) const {
+    if (condition.comparison == Condition::NONE) { return true; }
+    Object* object = cpu.peek(condition.reg);
+    if (not object) { return false; }
+
+    int64_t value = 0;
+    string type = object->type();
+    if (type == "Integer") {
+        value = static_cast<Integer*>(object)->value();
+    } else if (type == "Boolean") {
+        value = static_cast<Boolean*>(object)->value();
+    } else if (type == "Byte") {
+        value = static_cast<Byte*>(object)->value();
+    } else {
+        return false;
+    }
+
+    switch (condition.comparison) {
+        case Condition::EQ: return value == condition.value;
+        case Condition::NE: return value != condition.value;
+        case Condition::LT: return value < condition.value;
+        case Condition::LTE: return value <= condition.value;
+        case Condition::GT: return value > condition.value;
+        case Condition::GTE: return value >= condition.value;
+        default: return true;
+    }
+}
+
+Debugger::Stop Debugger::resume() {
+    return run(false);
+}
+
+Debugger::Stop Debugger::step() {
+    return run(true);
+}
+
+
+bool Debugger::at(uint32_t offset) const {
+    for (const Breakpoint& point : points) {
+        if (point.offset == offset) { return true; }
+    }
+    return false;
+}
+
+void Debugger::patch(uint32_t offset) {
+    code->patch(offset, BREAK);
+}
+
+void Debugger::unpatch(uint32_t offset) {
+    code->patch(offset, original->bytecode()[offset]);
+}
+
+bool Debugger::hit() {
+    /*  Every breakpoint at the position counts the hit; the CPU stops at the first one whose condition holds.
+     */
+    passing = true;
+    stopped = 0;
+    for (Breakpoint& point : points) {
+        if (point.offset != position()) { continue; }
+        ++point.hits;
+        if (not stopped and holds(point.condition)) { stopped = point.id; }
+    }
+    return (stopped != 0);
+}
+
+CPU::Slice Debugger::execute(uint32_t offset) {
+    /*  The breakpoint at the instruction (if there is one) is taken out while it executes, and
+     *  put back after temporary ones at its successors are taken out, so an instruction jumping to itself stops there.
+     */
+    bool patched = at(offset);
+    if (patched) { unpatch(offset); }
+    vector<uint32_t> temporary;
+    for (uint32_t next : successors(offset)) {
+        if (code->bytecode()[next] != BREAK) {
+            patch(next);
+            temporary.push_back(next);
+        }
+    }
+    CPU::Slice slice = cpu.resume();
+    for (uint32_t next : temporary) { unpatch(next); }
+    if (patched) { patch(offset); }
+    return slice;
+}
+
+Debugger::Stop Debugger::run(bool single) {
+    /*  The CPU runs freely between breakpoints; only the instruction under a breakpoint that was already hit, and
+     *  the instruction being stepped, are executed one at a time.
+     */
+    stopped = 0;
+    while (not done) {
+        CPU::Slice slice;
+        if (single or passing) {
+            slice = execute(position());
+        } else if (at(position())) {
+            if (hit()) { return BREAKPOINT; }
+            continue;
+        } else {
+            slice = cpu.resume();
+        }
+        passing = false;
+
+        if (slice == CPU::EXHAUSTED) { cpu.trap(); }
+        if (slice == CPU::FINISHED or slice == CPU::EXHAUSTED) {
+            done = true;
+            break;
+        }
+        if (single) {
+            if (at(position()) and hit()) { return BREAKPOINT; }
+            return STEPPED;
+        }
+    }
+    return FINISHED;
+}
@@ -0,0 +1,112 @@
+#ifndef WUDOO_CPU_DEBUGGER_H
+#define WUDOO_CPU_DEBUGGER_H
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "image.h"
+#include "cpu.h"
+
+
+class Debugger {
+    /*  Breakpoints and single-stepping for a CPU running a program (`wudoo-dbg`).
+     *
+     *  The debugger runs the program from its own copy of the image, and sets a breakpoint by
+     *  patching the first byte of an instruction with BREAK, at which the CPU stops (see CPU::BREAKPOINT).
+     *  Between breakpoints the program runs in the plain run loop, at full speed: nothing is checked per instruction.
+     *  To continue from a breakpoint the original instruction is put back, executed alone, and the BREAK patched in again.
+     *
+     *  A single instruction is executed by patching BREAK over every instruction control can go to from it
+     *  (the next one, targets of jumps and branches) for as long as it executes.
+     *  Conditions of breakpoints are evaluated only when the CPU stops at them, and
+     *  breakpoints whose conditions do not hold are passed over without returning to the caller.
+     *
+     *  Programs that spawn processes can not be debugged.
+     */
+    public:
+        struct Condition {
+            enum Comparison { NONE, EQ, NE, LT, LTE, GT, GTE } comparison;
+            int reg;
+            int64_t value;
+
+            Condition(): comparison(NONE), reg(0), value(0) {}
+            Condition(int r, Comparison c, int64_t v): comparison(c), reg(r), value(v) {}
+        };
+
+        struct Breakpoint {
+            unsigned id;
+            uint32_t offset;
+            Condition condition;
+            // times the CPU stopped at the breakpoint (also when its condition did not hold)
+            uint64_t hits;
+        };
+
+        enum Stop {
+            BREAKPOINT, // stopped at a breakpoint whose condition holds (see current())
+            STEPPED,    // executed a single instruction
+            FINISHED,   // program halted, failed or ran out of fuel (stopped with CPU::trap()), see CPU::exitcode()
+        };
+
+        /*  Load a private copy of the image into the CPU.
+         *  Throws if the program spawns processes.
+         */
+        Debugger(CPU& cpu, const CodeImagePtr& program);
+
+        /*  Set a breakpoint at an instruction (with a condition that must hold for the CPU to stop there), and
+         *  delete it by its id.
+         *  Throw if the offset is not the start of an instruction, or there is no breakpoint with the id.
+         */
+        unsigned add(uint32_t offset, const Condition& condition = Condition());
+        void remove(unsigned id);
+        const std::vector<Breakpoint>& breakpoints() const { return points; }
+
+        /*  Run until a breakpoint whose condition holds, or to the end of the program, and
+         *  execute a single instruction.
+         */
+        Stop resume();
+        Stop step();
+
+        // offset of the next instruction, and the breakpoint the CPU stopped at (null if it did not)
+        uint32_t position() const { return cpu.position(); }
+        const Breakpoint* current() const;
+        bool finished() const { return done; }
+
+        /*  Instruction at an offset as it is in the program (breakpoints are not visible), and
+         *  offsets control may go to after executing it.
+         */
+        const byte* instruction(uint32_t offset) const { return original->bytecode() + offset; }
+        std::vector<uint32_t> successors(uint32_t offset) const;
+
+        // whether the condition holds for registers of the CPU (integers, booleans and bytes are compared by value)
+        bool holds(const Condition& condition) const;
+
+    private:
+        CPU& cpu;
+        CodeImagePtr original;
+        std::shared_ptr<CodeImage> code;
+        std::vector<Breakpoint> points;
+        unsigned next_id;
+        bool done;
+
+        // id of the breakpoint the CPU stopped at (0 if it did not stop at one)
+        unsigned stopped;
+
+        /*  Set when the CPU is at a breakpoint that has already been hit (and either reported or passed over), so
+         *  resuming executes its instruction instead of hitting it again.
+         */
+        bool passing;
+
+        bool at(uint32_t offset) const;
+        void patch(uint32_t offset);
+        void unpatch(uint32_t offset);
+        bool hit();
+        CPU::Slice execute(uint32_t offset);
+        Stop run(bool single);
+};
+
+
+#endif
@@ -0,0 +1,177 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "image.h"
+using namespace std;
+
+
+CodeImage::CodeImage(byte* bytecode, uint32_t size, uint32_t eoffset): header(2*HEADER_FIELD_SIZE, 0), code(bytecode), bytecode_size(size), executable_offset(eoffset), identity(0), is_verified(false), instruction_count(0), spawning(false) {
+    *((uint32_t*)&header[0]) = size;
+    *((uint32_t*)&header[HEADER_FIELD_SIZE]) = eoffset;
+
+    // 64-bit FNV-1a of the contents (header followed by bytecode)
+    identity = 14695981039346656037ULL;
+    for (byte b : header) { identity = (identity ^ b) * 1099511628211ULL; }
+    for (uint32_t i = 0; i < size; ++i) { identity = (identity ^ code[i]) * 1099511628211ULL; }
+
+    verify();
+}
+
+CodeImage::CodeImage(const CodeImage& other): header(other.header), code(new byte[other.bytecode_size]), bytecode_size(other.bytecode_size), executable_offset(other.executable_offset), identity(other.identity), is_verified(other.is_verified), verification_problem(other.verification_problem), instruction_count(other.instruction_count), spawning(other.spawning), block_costs(other.block_costs), block_starts(other.block_starts), debug_info(other.debug_info) {
+    if (bytecode_size) { memcpy(code.get(), other.code.get(), bytecode_size); }
+}
+
+CodeImagePtr CodeImage::create(const byte* bytecode, uint32_t size, uint32_t eoffset) {
+    /*  Bytecode is copied into the image.
+     */
+    byte* copied = new byte[size];
+    if (size) { memcpy(copied, bytecode, size); }
+    return CodeImagePtr(new CodeImage(copied, size, eoffset));
+}
+
+CodeImagePtr CodeImage::adopt(byte* bytecode, uint32_t size, uint32_t eoffset) {
+    /*  Bytecode becomes the image's; it may be null if the size is zero.
+     */
+    return CodeImagePtr(new CodeImage(bytecode, size, eoffset));
+}
+
+CodeImagePtr CodeImage::load(const byte* data, size_t size) {
+    /*  Create an image from contents of a compiled program.
+     *  A debug section after the bytecode is decoded, and anything else after the bytecode is ignored, so
+     *  programs assembled without debug information pay nothing for it.
+     *  Throws a message describing what could not be read.
+     */
+    if (size < HEADER_FIELD_SIZE) { throw "cannot read size"; }
+    if (size < 2*HEADER_FIELD_SIZE) { throw "cannot read executable offset"; }
+    uint32_t bytes = *((const uint32_t*)data);
+    uint32_t eoffset = *((const uint32_t*)(data + HEADER_FIELD_SIZE));
+    if (size - 2*HEADER_FIELD_SIZE < bytes) { throw "cannot read instructions"; }
+
+    size_t rest = 2*HEADER_FIELD_SIZE + bytes;
+    DebugInfoPtr info = DebugInfo::decode(data + rest, size - rest);
+    byte* bytecode = new byte[bytes];
+    if (bytes) { memcpy(bytecode, data + 2*HEADER_FIELD_SIZE, bytes); }
+    CodeImage* image = new CodeImage(bytecode, bytes, eoffset);
+    image->debug_info = info;
+    return CodeImagePtr(image);
+}
+
+std::shared_ptr<CodeImage> CodeImage::copy(const CodeImage& original) {
+    return std::shared_ptr<CodeImage>(new CodeImage(original));
+}
+
+void CodeImage::patch(uint32_t offset, byte value) {
+    if (offset >= bytecode_size) { throw "patch: offset out of bytecode"; }
+    code[offset] = value;
+}
+
+const byte* CodeImage::data() const {
+    /*  Images are shared between threads, so contents are put together once.
+     *  Patches made to copies after the first call are not seen in the contents.
+     */
+    std::call_once(joined, [this]() {
+        contents.reserve(size());
+        contents.insert(contents.end(), header.begin(), header.end());
+        contents.insert(contents.end(), code.get(), code.get() + bytecode_size);
+    });
+    return &contents[0];
+}
+
+
+void CodeImage::verify() {
+    /*  Walk the bytecode once, finding where instructions start, and
+     *  check that control is only ever transferred to starts of instructions.
+     *  Costs and starts of blocks are computed for all instructions found (also in images that fail verification).
+     */
+    const byte* code = bytecode();
+    vector<bool> starts(bytecode_size, false);
+    vector<int> targets;
+    vector<uint32_t> offsets;
+
+    uint32_t offset = 0;
+    while (offset < bytecode_size) {
+        unsigned size = opsize(code[offset]);
+        if (size == 0) {
+            verification_problem = "invalid opcode at byte " + to_string(offset);
+            costs(offsets);
+            partition(offsets, starts, targets);
+            return;
+        }
+        if (offset + size > bytecode_size) {
+            verification_problem = "truncated instruction at byte " + to_string(offset);
+            costs(offsets);
+            partition(offsets, starts, targets);
+            return;
+        }
+        starts[offset] = true;
+        offsets.push_back(offset);
+        ++instruction_count;
+
+        const byte* operands = code + offset + 1;
+        if (code[offset] == JUMP) {
+            targets.push_back(*((const int*)operands));
+        } else if (code[offset] == BRANCH) {
+            operands += sizeof(bool) + sizeof(int);
+            targets.push_back(*((const int*)operands));
+            targets.push_back(*((const int*)operands + 1));
+        } else if (code[offset] == SPAWN) {
+            operands += sizeof(bool) + sizeof(int);
+            targets.push_back(*((const int*)operands));
+            spawning = true;
+        }
+        offset += size;
+    }
+    costs(offsets);
+    partition(offsets, starts, targets);
+
+    if (executable_offset >= bytecode_size or not starts[executable_offset]) {
+        verification_problem = "executable offset does not point at an instruction";
+        return;
+    }
+    for (int target : targets) {
+        if (target < 0 or uint32_t(target) >= bytecode_size or not starts[target]) {
+            verification_problem = "jump target does not point at an instruction: " + to_string(target);
+            return;
+        }
+    }
+    is_verified = true;
+}
+
+void CodeImage::costs(const vector<uint32_t>& offsets) {
+    /*  Straight-line code runs until the next jump, branch or halt, so
+     *  cost of an instruction is one more than cost of the instruction after it (unless it transfers control).
+     */
+    const byte* code = bytecode();
+    block_costs.assign(bytecode_size, 0);
+    uint32_t following = 0;
+    for (unsigned i = offsets.size(); i > 0; --i) {
+        byte opcode = code[offsets[i-1]];
+        following = ((opcode == JUMP or opcode == BRANCH or opcode == HALT) ? 1 : following+1);
+        block_costs[offsets[i-1]] = following;
+    }
+}
+
+void CodeImage::partition(const vector<uint32_t>& offsets, const vector<bool>& starts, const vector<int>& targets) {
+    /*  Blocks begin wherever control can arrive other than by falling through from the instruction before, and
+     *  after every instruction control does not fall through from.
+     *  Targets that are not starts of instructions do not begin blocks (such images are not verified).
+     */
+    if (offsets.empty()) { return; }
+    const byte* code = bytecode();
+    vector<bool> leaders(bytecode_size, false);
+    leaders[offsets[0]] = true;
+    if (executable_offset < bytecode_size and starts[executable_offset]) { leaders[executable_offset] = true; }
+    for (int target : targets) {
+        if (target >= 0 and uint32_t(target) < bytecode_size and starts[target]) { leaders[target] = true; }
+    }
+    for (unsigned i = 0; i+1 < offsets.size(); ++i) {
+        byte opcode = code[offsets[i]];
+        if (opcode == JUMP or opcode == BRANCH or opcode == HALT) { leaders[offsets[i+1]] = true; }
+    }
+    for (uint32_t offset : offsets) {
+        if (leaders[offset]) { block_starts.push_back(offset); }
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef WUDOO_CPU_IMAGE_H
+#define WUDOO_CPU_IMAGE_H
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../debuginfo.h"
+
+
+class CodeImage;
+
+/*  Images are shared by reference counting: every CPU running an image holds a reference to it, and
+ *  the image is freed when the last reference goes away.
+ *  Reference counts of std::shared_ptr are atomic, so references may be taken and dropped on any thread.
+ */
+typedef std::shared_ptr<const CodeImage> CodeImagePtr;
+
+
+class CodeImage {
+    /*  Compiled program: bytecode and everything derived from it.
+     *
+     *  Image is immutable after it is created, so
+     *  any number of CPUs on any number of threads may execute it at the same time -
+     *  each of them only keeps its own registers.
+     *  The only exception are private copies made for debuggers (see copy()).
+     *
+     *  Header fields of the format wudoo-asm writes to files (two fields, HEADER_FIELD_SIZE bytes each:
+     *  size of the bytecode and offset of the first executable instruction, stored in first bytes of the fields)
+     *  are kept apart from the bytecode, so bytecode released by an assembled Program is taken over without copying.
+     */
+    std::vector<byte> header;
+    std::unique_ptr<byte[]> code;
+    uint32_t bytecode_size;
+    uint32_t executable_offset;
+    uint64_t identity;
+
+    /*  Results of verification, done once when the image is created.
+     */
+    bool is_verified;
+    std::string verification_problem;
+    unsigned instruction_count;
+    bool spawning;
+
+    /*  Number of instructions executed from an instruction (indexed by its offset) up to and including
+     *  the next jump, branch or halt, i.e. the cost of entering the rest of the basic block there.
+     */
+    std::vector<uint32_t> block_costs;
+
+    /*  Offsets of first instructions of basic blocks, sorted: the first instruction, the executable offset,
+     *  targets of jumps, branches and spawns, and instructions following jumps, branches and halts.
+     */
+    std::vector<uint32_t> block_starts;
+
+    // debug section found after the bytecode (null if the program was assembled without it)
+    DebugInfoPtr debug_info;
+
+    // header and bytecode put together, made on first call of data()
+    mutable std::vector<byte> contents;
+    mutable std::once_flag joined;
+
+    CodeImage(byte* bytecode, uint32_t size, uint32_t eoffset);
+    CodeImage(const CodeImage&);
+    void verify();
+    void costs(const std::vector<uint32_t>&);
+    void partition(const std::vector<uint32_t>&, const std::vector<bool>&, const std::vector<int>&);
+
+    public:
+        static const unsigned HEADER_FIELD_SIZE = 16;
+
+        /*  Create images from a copy of bytecode,
+         *  from bytecode allocated with new[] (e.g. by Program::release()), which the image takes over and frees, or
+         *  from contents of a compiled program (throws if they are truncated or their debug section is malformed).
+         */
+        static CodeImagePtr create(const byte* bytecode, uint32_t size, uint32_t eoffset);
+        static CodeImagePtr adopt(byte* bytecode, uint32_t size, uint32_t eoffset);
+        static CodeImagePtr load(const byte* data, size_t size);
+
+        /*  Private copy of an image, which only its owner (a debugger, see debugger.h) runs and
+         *  may patch bytes of; it has the same fingerprint and debug information as the original, and
+         *  everything derived from the bytecode (verification, blocks) is taken from the original.
+         */
+        static std::shared_ptr<CodeImage> copy(const CodeImage& original);
+        void patch(uint32_t offset, byte value);
+
+        const byte* bytecode() const { return code.get(); }
+        uint32_t bytes() const { return bytecode_size; }
+        uint32_t eoffset() const { return executable_offset; }
+
+        /*  Contents in the format of compiled programs.
+         *  The header and bytecode are copied together the first time they are asked for.
+         */
+        const byte* data() const;
+        size_t size() const { return 2*HEADER_FIELD_SIZE + bytecode_size; }
+
+        // hash of the contents, identifying the program (e.g. in CPU snapshots)
+        uint64_t fingerprint() const { return identity; }
+
+        /*  Image is verified if its bytecode is a sequence of valid instructions, and
+         *  the executable offset and all jump, branch and spawn targets point at instructions.
+         *  Unverified images still run (errors are caught by the CPU when they are reached).
+         */
+        bool verified() const { return is_verified; }
+        const std::string& problem() const { return verification_problem; }
+        unsigned instructions() const { return instruction_count; }
+
+        // true if the program contains `spawn` instructions, i.e. must be run by a scheduler
+        bool spawns() const { return spawning; }
+
+        /*  Cost (in instructions) of running from given offset to the next transfer of control.
+         *  Offsets that are not known starts of instructions cost one instruction.
+         */
+        uint32_t cost(uint32_t offset) const { return (offset < block_costs.size() and block_costs[offset] ? block_costs[offset] : 1); }
+
+        /*  Starts of basic blocks (only instructions found before the first invalid one, if there is one).
+         */
+        const std::vector<uint32_t>& blocks() const { return block_starts; }
+
+        /*  Source lines, marks and register names of the program (`wudoo-asm -g`).
+         *  Null if the program has no debug section.
+         */
+        const DebugInfo* debuginfo() const { return debug_info.get(); }
+};
+
+
+#endif
@@ -10,20 +10,20 @@
 using namespace std;
 
 
-byte* CPU::lognot(byte* addr) {
+const byte* CPU::lognot(const byte* addr) {
     /*  Run idec instruction.
      */
     bool ref = false;
     int regno;
 
     ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
 
     regno = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (ref ? " @" : " ") << regno;
+        out << (ref ? " @" : " ") << regno;
     }
 
     if (ref) {
@@ -31,7 +31,7 @@ byte* CPU::lognot(byte* addr) {
     }
 
     if (debug) {
-        if (ref) { cout << " -> " << regno; }
+        if (ref) { out << " -> " << regno; }
     }
 
     place(regno, new Boolean(not fetch(regno)->boolean()));
@@ -39,43 +39,43 @@ byte* CPU::lognot(byte* addr) {
     return addr;
 }
 
-byte* CPU::logand(byte* addr) {
+const byte* CPU::logand(const byte* addr) {
     /*  Run ieq instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -84,43 +84,43 @@ byte* CPU::logand(byte* addr) {
     return addr;
 }
 
-byte* CPU::logor(byte* addr) {
+const byte* CPU::logor(const byte* addr) {
     /*  Run ieq instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
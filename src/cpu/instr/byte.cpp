@@ -9,7 +9,7 @@
 using namespace std;
 
 
-byte* CPU::bstore(byte* addr) {
+const byte* CPU::bstore(const byte* addr) {
     /*  Run bstore instruction.
      */
     int reg;
@@ -17,23 +17,23 @@ byte* CPU::bstore(byte* addr) {
     byte bt;
 
     reg_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     reg = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     byte_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
-    bt = *((byte*)addr);
+    pointer::inc<bool, const byte>(addr);
+    bt = *((const byte*)addr);
     ++addr;
 
     if (debug) {
-        cout << (reg_ref ? " @" : " ") << reg;
-        cout << (byte_ref ? " @" : " ");
+        out << (reg_ref ? " @" : " ") << reg;
+        out << (byte_ref ? " @" : " ");
         // this range is to display ASCII byteacters as their printable representations
         if (bt >= 32 and bt <= 127) {
-            cout << '"' << bt << '"';
+            out << '"' << bt << '"';
         } else {
-            cout << (int)bt;
+            out << (int)bt;
         }
     }
 
@@ -45,6 +45,7 @@ byte* CPU::bstore(byte* addr) {
     }
 
     registers[reg] = new Byte(bt);
+    shared[reg] = false;
 
     return addr;
 }
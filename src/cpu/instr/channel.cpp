@@ -0,0 +1,197 @@
+#include <iostream>
+#include "../../bytecode/bytetypedef.h"
+#include "../../types/object.h"
+#include "../../types/integer.h"
+#include "../../types/boolean.h"
+#include "../../types/channel.h"
+#include "../../support/pointer.h"
+#include "../cpu.h"
+using namespace std;
+
+
+static Channel* tochannel(Object* object, const char* error) {
+    if (object->type() != "Channel") { throw error; }
+    return static_cast<Channel*>(object);
+}
+
+
+const byte* CPU::chan(const byte* addr) {
+    /*  Run chan instruction.
+     */
+    bool reg_ref, capacity_ref;
+    int reg, capacity;
+
+    reg_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    reg = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    capacity_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    capacity = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    if (debug) {
+        out << (reg_ref ? " @" : " ") << reg;
+        out << (capacity_ref ? " @" : " ") << capacity;
+    }
+
+    if (reg_ref) {
+        reg = static_cast<Integer*>(fetch(reg))->value();
+    }
+    if (capacity_ref) {
+        capacity = static_cast<Integer*>(fetch(capacity))->value();
+    }
+    if (capacity <= 0) {
+        throw "chan: capacity must be positive";
+    }
+
+    place(reg, new Channel(capacity));
+
+    return addr;
+}
+
+const byte* CPU::send(const byte* addr) {
+    /*  Run send instruction.
+     *
+     *  Object owned by the register (i.e. the register is not a reference, no other register refers to it and
+     *  it is not shared with a clone of the CPU) is moved to the channel and the register is emptied; otherwise a copy is sent.
+     *  When the channel is full the CPU blocks and the instruction is executed again when it is resumed.
+     */
+    const byte* instruction = addr-1;
+    bool channel_ref, reg_ref;
+    int channel, reg;
+
+    channel_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    channel = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    reg_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    reg = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    if (debug) {
+        out << (channel_ref ? " @" : " ") << channel;
+        out << (reg_ref ? " @" : " ") << reg;
+    }
+
+    if (channel_ref) {
+        channel = static_cast<Integer*>(fetch(channel))->value();
+    }
+    if (reg_ref) {
+        reg = static_cast<Integer*>(fetch(reg))->value();
+    }
+
+    Channel* ch = tochannel(fetch(channel), "send: not a channel");
+    Object* object = fetch(reg);
+    bool owned = (not references[reg] and not hasrefs(reg) and not shared[reg]);
+    Object* message = (owned ? object : object->copy());
+
+    if (not ch->state()->send(message)) {
+        if (not owned) { delete message; }
+        if (not scheduler) {
+            throw "send: channel is full and no other process can receive from it (deadlock)";
+        }
+        waiting_channel = ch->state();
+        waiting_to_send = true;
+        return instruction;
+    }
+    if (owned) { registers[reg] = 0; }
+
+    return addr;
+}
+
+const byte* CPU::recv(const byte* addr) {
+    /*  Run recv instruction.
+     *  When the channel is empty the CPU blocks and the instruction is executed again when it is resumed.
+     */
+    const byte* instruction = addr-1;
+    bool channel_ref, reg_ref;
+    int channel, reg;
+
+    channel_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    channel = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    reg_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    reg = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    if (debug) {
+        out << (channel_ref ? " @" : " ") << channel;
+        out << (reg_ref ? " @" : " ") << reg;
+    }
+
+    if (channel_ref) {
+        channel = static_cast<Integer*>(fetch(channel))->value();
+    }
+    if (reg_ref) {
+        reg = static_cast<Integer*>(fetch(reg))->value();
+    }
+
+    Channel* ch = tochannel(fetch(channel), "recv: not a channel");
+    Object* message = 0;
+    if (not ch->state()->receive(message)) {
+        if (not scheduler) {
+            throw "recv: channel is empty and no other process can send to it (deadlock)";
+        }
+        waiting_channel = ch->state();
+        waiting_to_send = false;
+        return instruction;
+    }
+
+    place(reg, message);
+
+    return addr;
+}
+
+const byte* CPU::tryrecv(const byte* addr) {
+    /*  Run tryrecv instruction.
+     *  Never blocks: if the channel is empty, target register is left as it was and false is stored in the flag register.
+     */
+    bool channel_ref, reg_ref, flag_ref;
+    int channel, reg, flag;
+
+    channel_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    channel = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    reg_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    reg = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    flag_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    flag = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    if (debug) {
+        out << (channel_ref ? " @" : " ") << channel;
+        out << (reg_ref ? " @" : " ") << reg;
+        out << (flag_ref ? " @" : " ") << flag;
+    }
+
+    if (channel_ref) {
+        channel = static_cast<Integer*>(fetch(channel))->value();
+    }
+    if (reg_ref) {
+        reg = static_cast<Integer*>(fetch(reg))->value();
+    }
+    if (flag_ref) {
+        flag = static_cast<Integer*>(fetch(flag))->value();
+    }
+
+    Channel* ch = tochannel(fetch(channel), "tryrecv: not a channel");
+    Object* message = 0;
+    bool received = ch->state()->receive(message);
+    if (received) { place(reg, message); }
+    place(flag, new Boolean(received));
+
+    return addr;
+}
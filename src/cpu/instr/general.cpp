@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include "../../bytecode/bytetypedef.h"
 #include "../../types/object.h"
 #include "../../types/integer.h"
@@ -6,44 +7,45 @@
 #include "../../types/byte.h"
 #include "../../support/pointer.h"
 #include "../cpu.h"
+#include "../scheduler.h"
 using namespace std;
 
 
-byte* CPU::echo(byte* addr) {
+const byte* CPU::echo(const byte* addr) {
     /*  Run echo instruction.
      */
     bool ref = false;
     int reg;
 
     ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
 
     reg = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (ref ? " @" : " ") << reg << endl;
+        out << (ref ? " @" : " ") << reg << endl;
     }
 
     if (ref) {
         reg = static_cast<Integer*>(fetch(reg))->value();
     }
 
-    cout << fetch(reg)->str();
+    out << fetch(reg)->str();
 
     return addr;
 }
 
-byte* CPU::print(byte* addr) {
+const byte* CPU::print(const byte* addr) {
     /*  Run print instruction.
      */
     addr = echo(addr);
-    cout << '\n';
+    out << '\n';
     return addr;
 }
 
 
-byte* CPU::move(byte* addr) {
+const byte* CPU::move(const byte* addr) {
     /** Run move instruction.
      *  Move an object from one register into another.
      */
@@ -51,18 +53,18 @@ byte* CPU::move(byte* addr) {
     bool a_ref = false, b_ref = false;
 
     a_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     a = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     b_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     b = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (a_ref ? " @" : " ") << a;
-        cout << (b_ref ? " @" : " ") << b;
+        out << (a_ref ? " @" : " ") << a;
+        out << (b_ref ? " @" : " ") << b;
     }
 
     if (a_ref) {
@@ -74,10 +76,12 @@ byte* CPU::move(byte* addr) {
 
     registers[b] = registers[a];    // copy pointer from first-operand register to second-operand register
     registers[a] = 0;               // zero first-operand register
+    shared[b] = shared[a];
+    shared[a] = false;
 
     return addr;
 }
-byte* CPU::copy(byte* addr) {
+const byte* CPU::copy(const byte* addr) {
     /** Run move instruction.
      *  Copy an object from one register into another.
      */
@@ -85,18 +89,18 @@ byte* CPU::copy(byte* addr) {
     bool a_ref = false, b_ref = false;
 
     a_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     a = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     b_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     b = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (a_ref ? " @" : " ") << a;
-        cout << (b_ref ? " @" : " ") << b;
+        out << (a_ref ? " @" : " ") << a;
+        out << (b_ref ? " @" : " ") << b;
     }
 
     if (a_ref) {
@@ -110,7 +114,7 @@ byte* CPU::copy(byte* addr) {
 
     return addr;
 }
-byte* CPU::ref(byte* addr) {
+const byte* CPU::ref(const byte* addr) {
     /** Run ref instruction.
      *  Create a reference (implementation detail: copy a pointer) of an object in one register in
      *  another register.
@@ -119,18 +123,18 @@ byte* CPU::ref(byte* addr) {
     bool a_ref = false, b_ref = false;
 
     a_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     a = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     b_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     b = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (a_ref ? " @" : " ") << a;
-        cout << (b_ref ? " @" : " ") << b;
+        out << (a_ref ? " @" : " ") << a;
+        out << (b_ref ? " @" : " ") << b;
     }
 
     if (a_ref) {
@@ -142,10 +146,11 @@ byte* CPU::ref(byte* addr) {
 
     registers[b] = registers[a];    // copy pointer
     references[b] = true;
+    shared[b] = shared[a];
 
     return addr;
 }
-byte* CPU::swap(byte* addr) {
+const byte* CPU::swap(const byte* addr) {
     /** Run swap instruction.
      *  Swaps two objects in registers.
      */
@@ -153,18 +158,18 @@ byte* CPU::swap(byte* addr) {
     bool a_ref = false, b_ref = false;
 
     a_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     a = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     b_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     b = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (a_ref ? " @" : " ") << a;
-        cout << (b_ref ? " @" : " ") << b;
+        out << (a_ref ? " @" : " ") << a;
+        out << (b_ref ? " @" : " ") << b;
     }
 
     if (a_ref) {
@@ -177,31 +182,32 @@ byte* CPU::swap(byte* addr) {
     Object* tmp = registers[a];
     registers[a] = registers[b];
     registers[b] = tmp;
+    std::swap(shared[a], shared[b]);
 
     return addr;
 }
-byte* CPU::del(byte* addr) {
+const byte* CPU::del(const byte* addr) {
     return addr;
 }
-byte* CPU::isnull(byte* addr) {
+const byte* CPU::isnull(const byte* addr) {
     return addr;
 }
 
 
-byte* CPU::ret(byte* addr) {
+const byte* CPU::ret(const byte* addr) {
     /*  Run iinc instruction.
      */
     bool ref = false;
     int regno;
 
     ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
 
     regno = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (ref ? " @" : " ") << regno;
+        out << (ref ? " @" : " ") << regno;
     }
 
     if (ref) {
@@ -209,7 +215,7 @@ byte* CPU::ret(byte* addr) {
     }
 
     if (debug) {
-        if (ref) { cout << " -> " << regno; }
+        if (ref) { out << " -> " << regno; }
     }
 
     place(0, new Integer(static_cast<Integer*>(fetch(regno))->value()));
@@ -218,53 +224,105 @@ byte* CPU::ret(byte* addr) {
 }
 
 
-byte* CPU::jump(byte* addr) {
+const byte* CPU::jump(const byte* addr) {
     /*  Run jump instruction.
      */
     if (debug) {
-        cout << ' ' << *(int*)addr;
+        out << ' ' << *(int*)addr;
     }
-    byte* target = bytecode+(*(int*)addr);
+    const byte* target = bytecode+(*(int*)addr);
     if (target == addr) {
         throw "aborting: JUMP instruction pointing to itself";
     }
+    if (branch_profile) { ++(*branch_profile)[(addr-1) - bytecode].taken[0]; }
     return target;
 }
 
-byte* CPU::branch(byte* addr) {
+const byte* CPU::branch(const byte* addr) {
     /*  Run branch instruction.
      */
     bool regcond_ref;
     int regcond_num;
 
+    // bytecode offset of the instruction (profile is keyed by it)
+    uint32_t offset = (addr-1) - bytecode;
 
     regcond_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
 
     regcond_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     int addr_true = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     int addr_false = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << dec << (regcond_ref ? " @" : " ") << regcond_num;
-        cout << " " << addr_true  << "::0x" << hex << (long)(bytecode+addr_true) << dec;
-        cout << " " << addr_false << "::0x" << hex << (long)(bytecode+addr_false);
+        out << dec << (regcond_ref ? " @" : " ") << regcond_num;
+        out << " " << addr_true  << "::0x" << hex << (long)(bytecode+addr_true) << dec;
+        out << " " << addr_false << "::0x" << hex << (long)(bytecode+addr_false);
     }
 
 
     if (regcond_ref) {
-        if (debug) { cout << "resolving reference to condition register" << endl; }
+        if (debug) { out << "resolving reference to condition register" << endl; }
         regcond_num = static_cast<Integer*>(fetch(regcond_num))->value();
     }
 
     bool result = fetch(regcond_num)->boolean();
 
+    if (branch_profile) {
+        BranchCounts& counts = (*branch_profile)[offset];
+        counts.conditional = true;
+        ++counts.taken[result ? 0 : 1];
+    }
+
     addr = bytecode + (result ? addr_true : addr_false);
 
     return addr;
 }
+
+
+const byte* CPU::spawn(const byte* addr) {
+    /*  Run spawn instruction.
+     *  New process is handed to the scheduler with a copy of the value in given register.
+     */
+    bool reg_ref;
+    int reg;
+
+    reg_ref = *((bool*)addr);
+    pointer::inc<bool, const byte>(addr);
+    reg = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    int target = *((int*)addr);
+    pointer::inc<int, const byte>(addr);
+
+    if (debug) {
+        out << (reg_ref ? " @" : " ") << reg << ' ' << target;
+    }
+
+    if (reg_ref) {
+        reg = static_cast<Integer*>(fetch(reg))->value();
+    }
+    if (not scheduler) {
+        throw "spawn: processes can only be started by programs run by a scheduler";
+    }
+    if (target < 0 or uint32_t(target) >= bytecode_size) {
+        throw "spawn: target out of bounds";
+    }
+
+    scheduler->spawn(target, reg, fetch(reg)->copy());
+
+    return addr;
+}
+
+const byte* CPU::yield(const byte* addr) {
+    /*  Run yield instruction.
+     *  Execution stops after the instruction, so the scheduler can run other processes.
+     */
+    yielded = true;
+    return addr;
+}
@@ -9,25 +9,25 @@
 using namespace std;
 
 
-byte* CPU::istore(byte* addr) {
+const byte* CPU::istore(const byte* addr) {
     /*  Run istore instruction.
      */
     int reg, num;
     bool reg_ref = false, num_ref = false;
 
     reg_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     reg = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     num_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (reg_ref ? " @" : " ") << reg;
-        cout << (num_ref ? " @" : " ") << num;
+        out << (reg_ref ? " @" : " ") << reg;
+        out << (num_ref ? " @" : " ") << num;
     }
 
     if (reg_ref) {
@@ -42,43 +42,43 @@ byte* CPU::istore(byte* addr) {
     return addr;
 }
 
-byte* CPU::iadd(byte* addr) {
+const byte* CPU::iadd(const byte* addr) {
     /*  Run iadd instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -90,43 +90,43 @@ byte* CPU::iadd(byte* addr) {
     return addr;
 }
 
-byte* CPU::isub(byte* addr) {
+const byte* CPU::isub(const byte* addr) {
     /*  Run isub instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -138,43 +138,43 @@ byte* CPU::isub(byte* addr) {
     return addr;
 }
 
-byte* CPU::imul(byte* addr) {
+const byte* CPU::imul(const byte* addr) {
     /*  Run imul instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -186,43 +186,43 @@ byte* CPU::imul(byte* addr) {
     return addr;
 }
 
-byte* CPU::idiv(byte* addr) {
+const byte* CPU::idiv(const byte* addr) {
     /*  Run idiv instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -234,43 +234,43 @@ byte* CPU::idiv(byte* addr) {
     return addr;
 }
 
-byte* CPU::ilt(byte* addr) {
+const byte* CPU::ilt(const byte* addr) {
     /*  Run ilt instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -282,43 +282,43 @@ byte* CPU::ilt(byte* addr) {
     return addr;
 }
 
-byte* CPU::ilte(byte* addr) {
+const byte* CPU::ilte(const byte* addr) {
     /*  Run ilte instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -330,43 +330,43 @@ byte* CPU::ilte(byte* addr) {
     return addr;
 }
 
-byte* CPU::igt(byte* addr) {
+const byte* CPU::igt(const byte* addr) {
     /*  Run igt instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -378,43 +378,43 @@ byte* CPU::igt(byte* addr) {
     return addr;
 }
 
-byte* CPU::igte(byte* addr) {
+const byte* CPU::igte(const byte* addr) {
     /*  Run igte instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -426,43 +426,43 @@ byte* CPU::igte(byte* addr) {
     return addr;
 }
 
-byte* CPU::ieq(byte* addr) {
+const byte* CPU::ieq(const byte* addr) {
     /*  Run ieq instruction.
      */
     bool rega_ref, regb_ref, regr_ref;
     int rega_num, regb_num, regr_num;
 
     rega_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     rega_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regb_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regb_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     regr_ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
     regr_num = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (rega_ref ? " @" : " ") << rega_num;
-        cout << (regb_ref ? " @" : " ") << regb_num;
-        cout << (regr_ref ? " @" : " ") << regr_num;
+        out << (rega_ref ? " @" : " ") << rega_num;
+        out << (regb_ref ? " @" : " ") << regb_num;
+        out << (regr_ref ? " @" : " ") << regr_num;
     }
 
     if (rega_ref) {
-        if (debug) { cout << "resolving reference to a-operand register" << endl; }
+        if (debug) { out << "resolving reference to a-operand register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
     if (regb_ref) {
-        if (debug) { cout << "resolving reference to b-operand register" << endl; }
+        if (debug) { out << "resolving reference to b-operand register" << endl; }
         regb_num = static_cast<Integer*>(registers[regb_num])->value();
     }
     if (regr_ref) {
-        if (debug) { cout << "resolving reference to result register" << endl; }
+        if (debug) { out << "resolving reference to result register" << endl; }
         rega_num = static_cast<Integer*>(registers[rega_num])->value();
     }
 
@@ -474,20 +474,20 @@ byte* CPU::ieq(byte* addr) {
     return addr;
 }
 
-byte* CPU::iinc(byte* addr) {
+const byte* CPU::iinc(const byte* addr) {
     /*  Run iinc instruction.
      */
     bool ref = false;
     int regno;
 
     ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
 
     regno = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (ref ? " @" : " ") << regno;
+        out << (ref ? " @" : " ") << regno;
     }
 
     if (ref) {
@@ -495,28 +495,28 @@ byte* CPU::iinc(byte* addr) {
     }
 
     if (debug) {
-        if (ref) { cout << " -> " << regno; }
+        if (ref) { out << " -> " << regno; }
     }
 
-    ++(static_cast<Integer*>(fetch(regno))->value());
+    ++(static_cast<Integer*>(writable(regno))->value());
 
     return addr;
 }
 
-byte* CPU::idec(byte* addr) {
+const byte* CPU::idec(const byte* addr) {
     /*  Run idec instruction.
      */
     bool ref = false;
     int regno;
 
     ref = *((bool*)addr);
-    pointer::inc<bool, byte>(addr);
+    pointer::inc<bool, const byte>(addr);
 
     regno = *((int*)addr);
-    pointer::inc<int, byte>(addr);
+    pointer::inc<int, const byte>(addr);
 
     if (debug) {
-        cout << (ref ? " @" : " ") << regno;
+        out << (ref ? " @" : " ") << regno;
     }
 
     if (ref) {
@@ -524,10 +524,10 @@ byte* CPU::idec(byte* addr) {
     }
 
     if (debug) {
-        if (ref) { cout << " -> " << regno; }
+        if (ref) { out << " -> " << regno; }
     }
 
-    --(static_cast<Integer*>(fetch(regno))->value());
+    --(static_cast<Integer*>(writable(regno))->value());
 
     return addr;
 }
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "../support/cycles.h"
+#include "../support/string.h"
+#include "profile.h"
+using namespace std;
+
+
+static string opname(byte opcode) {
+    auto name = OP_NAMES.find(OPCODE(opcode));
+    return (name != OP_NAMES.end() ? name->second : "<unknown>");
+}
+
+static vector<byte> executed(const ExecutionProfile& profile) {
+    /*  Opcodes executed at least once, those taking the most time first.
+     */
+    vector<byte> opcodes;
+    for (unsigned i = 0; i < 256; ++i) {
+        if (profile.counts[i]) { opcodes.push_back(i); }
+    }
+    sort(opcodes.begin(), opcodes.end(), [&profile](byte a, byte b) {
+        return (profile.times[a] != profile.times[b] ? profile.times[a] > profile.times[b] : a < b);
+    });
+    return opcodes;
+}
+
+
+ExecutionProfile::ExecutionProfile(): overhead(cycles::overhead()) {
+    fill(counts, counts+256, 0);
+    fill(times, times+256, 0);
+}
+
+uint64_t ExecutionProfile::instructions() const {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < 256; ++i) { total += counts[i]; }
+    return total;
+}
+
+uint64_t ExecutionProfile::time() const {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < 256; ++i) { total += times[i]; }
+    return total;
+}
+
+void ExecutionProfile::report(ostream& out, const byte* bytecode, unsigned hottest, const DebugInfo* info) const {
+    uint64_t total_count = instructions(), total_time = time();
+    out << "profile: " << total_count << " instructions, " << total_time << ' ' << cycles::UNIT << endl;
+    if (total_count == 0) { return; }
+
+    out << left << setw(12) << "opcode" << right << setw(14) << "count" << setw(9) << "count%";
+    out << setw(16) << cycles::UNIT << setw(9) << "time%" << setw(12) << "per instr" << endl;
+    for (byte opcode : executed(*this)) {
+        out << left << setw(12) << opname(opcode) << right << setw(14) << counts[opcode];
+        out << setw(8) << fixed << setprecision(1) << (100.0 * counts[opcode] / total_count) << '%';
+        out << setw(16) << times[opcode];
+        out << setw(8) << (total_time ? 100.0 * times[opcode] / total_time : 0.0) << '%';
+        out << setw(12) << (double(times[opcode]) / counts[opcode]) << endl;
+    }
+
+    vector<uint32_t> hot;
+    for (uint32_t offset = 0; offset < offsets.size(); ++offset) {
+        if (offsets[offset]) { hot.push_back(offset); }
+    }
+    sort(hot.begin(), hot.end(), [this](uint32_t a, uint32_t b) {
+        return (offsets[a] != offsets[b] ? offsets[a] > offsets[b] : a < b);
+    });
+    if (hot.size() > hottest) { hot.resize(hottest); }
+
+    out << "hottest instructions:" << endl;
+    out << left << setw(12) << "offset" << setw(12) << "opcode" << right << setw(14) << "count";
+    out << (info ? "  location" : "") << endl;
+    for (uint32_t offset : hot) {
+        out << left << setw(12) << offset << setw(12) << opname(bytecode[offset]) << right << setw(14) << offsets[offset];
+        if (info) {
+            string mark = info->enclosing(offset);
+            out << "  " << info->location(offset) << (mark.size() ? " (:" + mark + ')' : "");
+        }
+        out << endl;
+    }
+    out << defaultfloat;
+}
+
+void ExecutionProfile::json(ostream& out, const byte* bytecode, const DebugInfo* info) const {
+    out << "{\n";
+    out << "    \"unit\": " << str::enquote(cycles::UNIT) << ",\n";
+    out << "    \"instructions\": " << instructions() << ",\n";
+    out << "    \"time\": " << time() << ",\n";
+
+    out << "    \"opcodes\": [";
+    bool first = true;
+    for (byte opcode : executed(*this)) {
+        out << (first ? "\n" : ",\n");
+        out << "        {\"opcode\": " << str::enquote(opname(opcode)) << ", \"count\": " << counts[opcode] << ", \"time\": " << times[opcode] << '}';
+        first = false;
+    }
+    out << "\n    ],\n";
+
+    out << "    \"offsets\": [";
+    first = true;
+    for (uint32_t offset = 0; offset < offsets.size(); ++offset) {
+        if (not offsets[offset]) { continue; }
+        out << (first ? "\n" : ",\n");
+        out << "        {\"offset\": " << offset << ", \"opcode\": " << str::enquote(opname(bytecode[offset])) << ", \"count\": " << offsets[offset];
+        if (info) {
+            string mark = info->enclosing(offset);
+            out << ", \"line\": " << info->line(offset);
+            if (mark.size()) { out << ", \"mark\": " << str::enquote(mark); }
+        }
+        out << '}';
+        first = false;
+    }
+    out << "\n    ]\n";
+    out << "}\n";
+}
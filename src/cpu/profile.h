@@ -0,0 +1,69 @@
+#ifndef WUDOO_CPU_PROFILE_H
+#define WUDOO_CPU_PROFILE_H
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../debuginfo.h"
+
+
+class ExecutionProfile {
+    /*  Counts of executed instructions (per opcode and per bytecode offset) and
+     *  time spent in every opcode, collected by a CPU running with a profile (see CPU::profile).
+     *
+     *  Time is measured with the cycle counter (see support/cycles.h) around every instruction, minus
+     *  the cost of reading the counter, so it includes dispatch of the instruction but not of the run loop.
+     *  Instructions that block (e.g. `recv` on an empty channel) are counted every time they are tried.
+     */
+    uint64_t overhead;
+
+    public:
+        uint64_t counts[256];
+        uint64_t times[256];
+
+        // bytecode offset -> number of times the instruction at the offset was executed
+        std::vector<uint64_t> offsets;
+
+        void prepare(uint32_t bytecode_size) {
+            if (offsets.size() < bytecode_size) { offsets.resize(bytecode_size, 0); }
+        }
+
+        void record(byte opcode, uint32_t offset, uint64_t time) {
+            ++counts[opcode];
+            times[opcode] += (time > overhead ? time - overhead : 0);
+            ++offsets[offset];
+        }
+
+        uint64_t instructions() const;
+        uint64_t time() const;
+
+        /*  Human-readable report: opcodes sorted by time spent in them and the most often executed instructions.
+         *  Opcodes of instructions at offsets are read from the bytecode the profile was collected for, and
+         *  their source locations from its debug information (if given).
+         */
+        void report(std::ostream& out, const byte* bytecode, unsigned hottest = 20, const DebugInfo* info = 0) const;
+
+        /*  Machine-readable report:
+         *
+         *      {
+         *          "unit": "cycles",
+         *          "instructions": <number>,
+         *          "time": <number>,
+         *          "opcodes": [{"opcode": "iadd", "count": <number>, "time": <number>}, ...],
+         *          "offsets": [{"offset": <number>, "opcode": "iadd", "count": <number>}, ...]
+         *      }
+         *
+         *  Opcodes are sorted by time, offsets by offset; only executed ones are listed.
+         *  Unit of time is "ns" on machines without a cycle counter.
+         *  With debug information, offsets also carry "line" and "mark" (the mark they are in, if any).
+         */
+        void json(std::ostream& out, const byte* bytecode, const DebugInfo* info = 0) const;
+
+        ExecutionProfile();
+};
+
+
+#endif
@@ -0,0 +1,115 @@
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "image.h"
+#include "cpu.h"
+#include "sampler.h"
+using namespace std;
+
+
+// profiler the handler counts samples for, and handler that was installed before it
+static atomic<SamplingProfiler*> running(nullptr);
+static struct sigaction previous;
+
+
+void SamplingProfiler::handle(int) {
+    SamplingProfiler* profiler = running.load(memory_order_relaxed);
+    if (not profiler) { return; }
+    int32_t offset = profiler->slot;
+    if (offset < 0 or uint32_t(offset) >= profiler->bytes) {
+        profiler->outside.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    profiler->counts[offset].fetch_add(1, memory_order_relaxed);
+}
+
+
+SamplingProfiler::SamplingProfiler(const CodeImagePtr& program, unsigned samples_per_second): image(program), bytes(program->bytes()), rate(samples_per_second), attached(0), slot(-1), counts(new atomic<uint64_t>[bytes]), outside(0) {
+    for (uint32_t i = 0; i < bytes; ++i) { counts[i] = 0; }
+    if (rate == 0) { rate = DEFAULT_RATE; }
+}
+
+SamplingProfiler::~SamplingProfiler() {
+    stop();
+}
+
+void SamplingProfiler::start(CPU& cpu) {
+    SamplingProfiler* none = nullptr;
+    if (not running.compare_exchange_strong(none, this)) { throw "sampling profiler: another profiler is already running"; }
+    attached = &cpu;
+    cpu.published_offset = &slot;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = SamplingProfiler::handle;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = (rate > 1000000 ? 1 : 1000000 / rate);
+    timer.it_value = timer.it_interval;
+    if (sigaction(SIGPROF, &action, &previous) != 0 or setitimer(ITIMER_PROF, &timer, 0) != 0) {
+        cpu.published_offset = 0;
+        running = nullptr;
+        throw "sampling profiler: timer could not be set";
+    }
+}
+
+void SamplingProfiler::stop() {
+    if (running.load() != this) { return; }
+    struct itimerval timer;
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, 0);
+    sigaction(SIGPROF, &previous, 0);
+    attached->published_offset = 0;
+    running = nullptr;
+}
+
+uint64_t SamplingProfiler::samples() const {
+    uint64_t total = outside;
+    for (uint32_t i = 0; i < bytes; ++i) { total += counts[i]; }
+    return total;
+}
+
+void SamplingProfiler::folded(ostream& out, const string& root) const {
+    /*  Blocks are the image's (see CodeImage::blocks()), the same the CPU pays fuel and counts coverage for.
+     */
+    const byte* code = image->bytecode();
+    const vector<uint32_t>& starts = image->blocks();
+    vector<uint32_t> offsets;
+    uint32_t offset = 0;
+    while (offset < bytes) {
+        unsigned size = opsize(code[offset]);
+        if (size == 0 or offset + size > bytes) { break; }
+        offsets.push_back(offset);
+        offset += size;
+    }
+
+    const DebugInfo* info = image->debuginfo();
+    uint32_t block = 0;
+    unsigned next = 0;
+    for (uint32_t instruction : offsets) {
+        if (next < starts.size() and starts[next] == instruction) { block = starts[next++]; }
+        if (counts[instruction] == 0) { continue; }
+        auto name = OP_NAMES.find(OPCODE(code[instruction]));
+        string location = (info ? info->location(instruction) : "");
+        out << root;
+        if (info) {
+            string mark = info->enclosing(block);
+            out << ';' << (mark.size() ? ':' + mark : "[no mark]");
+        }
+        out << ";block@" << block << ';' << (name != OP_NAMES.end() ? name->second : "<unknown>") << '@';
+        if (location.size()) { out << location; } else { out << instruction; }
+        out << ' ' << counts[instruction] << '\n';
+    }
+    if (outside) { out << root << ";[outside] " << outside << '\n'; }
+}
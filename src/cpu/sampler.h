@@ -0,0 +1,72 @@
+#ifndef WUDOO_CPU_SAMPLER_H
+#define WUDOO_CPU_SAMPLER_H
+
+#pragma once
+
+#include <atomic>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "image.h"
+#include "cpu.h"
+
+
+class SamplingProfiler {
+    /*  Statistical profiler of a CPU.
+     *
+     *  A profiling timer (setitimer(ITIMER_PROF)) interrupts the process `rate` times per second of CPU time, and
+     *  the SIGPROF handler reads the offset of the instruction the CPU is executing from a slot the CPU publishes it in
+     *  (see CPU::published_offset) and counts a sample for it.
+     *  The slot is a volatile sig_atomic_t and the handler only reads it and increments lock-free atomics, so
+     *  it is safe to interrupt the CPU at any point.
+     *  Timer signals may be delivered to any thread, so the CPU must run on the only thread of the process.
+     *  Samples taken while the CPU is not executing an instruction (e.g. while the program is being loaded) are
+     *  counted separately.
+     *
+     *  The handler is global to the process, so only one profiler may be running at a time.
+     */
+    CodeImagePtr image;
+    uint32_t bytes;
+    unsigned rate;
+    CPU* attached;
+
+    volatile sig_atomic_t slot;
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::atomic<uint64_t> outside;
+
+    // SIGPROF handler, counting a sample for the running profiler
+    static void handle(int);
+
+    public:
+        static const unsigned DEFAULT_RATE = 1000;
+
+        /*  Attach the profiler to a CPU (which must have the image loaded) and start sampling.
+         *  Throws if another profiler is running or the timer can not be set.
+         */
+        void start(CPU& cpu);
+        void stop();
+
+        uint64_t samples() const;
+        uint64_t missed() const { return outside; }
+
+        /*  Write samples as folded stacks (the input format of flamegraph.pl and compatible tools):
+         *
+         *      <root>;<block>;<instruction> <samples>
+         *
+         *  where <block> is the basic block containing the instruction (`block@<offset of its first instruction>`),
+         *  <instruction> is `<opcode>@<offset>`, and samples taken outside of the program are reported as `<root>;[outside]`.
+         *  When the program has debug information, blocks are grouped under the marks they are in and
+         *  instructions are located in the source:
+         *
+         *      <root>;:<mark>;<block>;<opcode>@<file>:<line> <samples>
+         */
+        void folded(std::ostream& out, const std::string& root) const;
+
+        SamplingProfiler(const CodeImagePtr& program, unsigned samples_per_second = DEFAULT_RATE);
+        ~SamplingProfiler();
+};
+
+
+#endif
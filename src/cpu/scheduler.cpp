@@ -0,0 +1,258 @@
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include "../types/object.h"
+#include "../types/channel.h"
+#include "../support/exception.h"
+#include "cpu.h"
+#include "scheduler.h"
+using namespace std;
+
+
+// index of the worker running on current thread (-1 if the thread is not a worker)
+static thread_local int current_worker = -1;
+
+
+class Scheduler::ProcessOutput : public std::streambuf {
+    /*  Output of a process is collected until a line is complete, and
+     *  written to the output of the scheduler as a whole line.
+     */
+    Scheduler& scheduler;
+    string line;
+
+    protected:
+        int overflow(int c) {
+            if (c != traits_type::eof()) {
+                line += char(c);
+                if (c == '\n') { sync(); }
+            }
+            return traits_type::not_eof(c);
+        }
+        streamsize xsputn(const char* s, streamsize n) {
+            line.append(s, n);
+            size_t end = line.rfind('\n');
+            if (end != string::npos) {
+                scheduler.write(line.data(), end+1);
+                line.erase(0, end+1);
+            }
+            return n;
+        }
+        int sync() {
+            if (line.size()) {
+                scheduler.write(line.data(), line.size());
+                line.clear();
+            }
+            return 0;
+        }
+
+    public:
+        ProcessOutput(Scheduler& s): scheduler(s) {}
+};
+
+class Scheduler::Process {
+    public:
+        ProcessOutput output;
+        CPU cpu;
+        bool first;
+
+        Process(Scheduler& scheduler): output(scheduler), first(false) {
+            cpu.out.rdbuf(&output);
+            cpu.scheduler = &scheduler;
+            cpu.debug = scheduler.debug;
+            cpu.limit(scheduler.max_instructions);
+            cpu.load(scheduler.image);
+        }
+};
+
+
+Scheduler::Scheduler(const CodeImagePtr& i, unsigned n, ostream& o, uint64_t b): image(i), out(o), budget(b), live(0), queued(0), spawned(0), sleeping(0), exit_code(0), debug(false), max_instructions(0) {
+    if (n == 0) { n = 1; }
+    for (unsigned w = 0; w < n; ++w) { workers.push_back(unique_ptr<Worker>(new Worker())); }
+}
+
+Scheduler::~Scheduler() {
+    /*  Processes left in queues (possible only if run() was interrupted by an exception) are freed.
+     */
+    for (auto& worker : workers) {
+        for (Process* process : worker->queue) { delete process; }
+    }
+    for (Process* process : parked) { delete process; }
+}
+
+
+void Scheduler::write(const char* data, size_t size) {
+    unique_lock<mutex> guard(output_lock);
+    out.write(data, size);
+    out.flush();
+}
+
+
+void Scheduler::enqueue(unsigned w, Process* process) {
+    {
+        unique_lock<mutex> guard(workers[w]->lock);
+        workers[w]->queue.push_back(process);
+    }
+    ++queued;
+    if (sleeping) { idle.notify_one(); }
+}
+
+Scheduler::Process* Scheduler::take(unsigned w) {
+    /*  Take a process from the front of worker's own queue, or
+     *  steal one from the back of a queue of another worker.
+     */
+    Process* process = 0;
+    {
+        unique_lock<mutex> guard(workers[w]->lock);
+        if (workers[w]->queue.size()) {
+            process = workers[w]->queue.front();
+            workers[w]->queue.pop_front();
+        }
+    }
+    for (unsigned k = 1; not process and queued and k < workers.size(); ++k) {
+        Worker& victim = *workers[(w + k) % workers.size()];
+        unique_lock<mutex> guard(victim.lock);
+        if (victim.queue.size()) {
+            process = victim.queue.back();
+            victim.queue.pop_back();
+            ++workers[w]->steals;
+        }
+    }
+    if (process) { --queued; }
+    return process;
+}
+
+void Scheduler::finish(Process* process, int code) {
+    process->output.pubsync();
+    if (process->first) { exit_code = code; }
+    delete process;
+    if (--live == 0) {
+        unique_lock<mutex> guard(idle_lock);
+        idle.notify_all();
+    }
+}
+
+
+void Scheduler::park(Process* process) {
+    /*  Park a process blocked on a channel until the channel wakes it up.
+     *  After the channel registers the wake-up function the process belongs to the channel:
+     *  it may be woken up (and run by another worker) before this function returns.
+     */
+    shared_ptr<ChannelState> channel = process->cpu.waiting_channel;
+    unique_lock<recursive_mutex> guard(parked_lock);
+    parked.insert(process);
+    channel->park(process->cpu.waiting_to_send, [this, process] { wake(process); });
+}
+
+void Scheduler::wake(Process* process) {
+    {
+        unique_lock<recursive_mutex> guard(parked_lock);
+        if (not parked.erase(process)) { return; }
+    }
+    enqueue((current_worker >= 0 ? current_worker : 0), process);
+}
+
+bool Scheduler::deadlocked() {
+    /*  Finish processes which wait for channels no running or queued process can send to or receive from.
+     *  Every wake-up is done by a running process, so if all unfinished processes are parked
+     *  none of them will ever run again.
+     */
+    vector<Process*> stuck;
+    {
+        unique_lock<recursive_mutex> guard(parked_lock);
+        if (parked.empty() or queued or parked.size() != live) { return false; }
+        stuck.assign(parked.begin(), parked.end());
+        parked.clear();
+    }
+    for (Process* process : stuck) {
+        process->cpu.out << "exception: deadlock: all processes are waiting on channels" << endl;
+        finish(process, 1);
+    }
+    return true;
+}
+
+
+void Scheduler::spawn(uint32_t offset, int reg, Object* value) {
+    Process* process = new Process(*this);
+    process->cpu.start(offset);
+    process->cpu.put(reg, value);
+    ++live;
+    ++spawned;
+    enqueue((current_worker >= 0 ? current_worker : 0), process);
+}
+
+
+void Scheduler::work(unsigned w) {
+    /*  Main loop of a worker.
+     */
+    int previous_worker = current_worker;
+    current_worker = w;
+
+    while (true) {
+        Process* process = take(w);
+        if (not process) {
+            if (live == 0) { break; }
+            if (deadlocked()) { continue; }
+            unique_lock<mutex> guard(idle_lock);
+            ++sleeping;
+            idle.wait_for(guard, chrono::milliseconds(1), [this] { return queued > 0 or live == 0; });
+            --sleeping;
+            continue;
+        }
+
+        ++workers[w]->slices;
+        CPU::Slice slice = CPU::FINISHED;
+        int code = 1;
+        try {
+            slice = process->cpu.resume(budget);
+            if (slice == CPU::EXHAUSTED) {
+                process->cpu.trap();
+                slice = CPU::FINISHED;
+            }
+            code = process->cpu.exitcode();
+        } catch (...) {
+            process->cpu.out << "exception: " << exceptionMessage() << endl;
+        }
+
+        if (slice == CPU::FINISHED) {
+            finish(process, code);
+        } else if (slice == CPU::BLOCKED) {
+            park(process);
+        } else {
+            enqueue(w, process);
+        }
+    }
+
+    current_worker = previous_worker;
+}
+
+int Scheduler::run() {
+    /*  Run the program until all its processes finish.
+     *  Calling thread becomes one of the workers.
+     */
+    Process* first = new Process(*this);
+    first->first = true;
+    live = 1;
+    spawned = 1;
+    enqueue(0, first);
+
+    vector<thread> threads;
+    for (unsigned w = 1; w < workers.size(); ++w) { threads.push_back(thread(&Scheduler::work, this, w)); }
+    work(0);
+    for (thread& t : threads) { t.join(); }
+
+    return exit_code;
+}
+
+SchedulerStats Scheduler::stats() const {
+    /*  Statistics of the last run.
+     */
+    SchedulerStats s;
+    s.processes = spawned;
+    s.slices = 0;
+    s.steals = 0;
+    for (auto& worker : workers) {
+        s.slices += worker->slices;
+        s.steals += worker->steals;
+    }
+    return s;
+}
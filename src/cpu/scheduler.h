@@ -0,0 +1,120 @@
+#ifndef WUDOO_CPU_SCHEDULER_H
+#define WUDOO_CPU_SCHEDULER_H
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "../types/object.h"
+#include "image.h"
+
+
+// number of instructions a process executes before it is preempted
+const uint64_t DEFAULT_PREEMPTION_BUDGET = 1000;
+
+
+struct SchedulerStats {
+    uint64_t processes;     // processes run, including the first one
+    uint64_t slices;        // slices of execution, i.e. context switches
+    uint64_t steals;        // processes taken from queues of other workers
+};
+
+
+class Scheduler {
+    /** M:N scheduler of VM processes.
+     *
+     *  A program run by the scheduler starts as a single process and may start more of them with `spawn`.
+     *  Every process is a CPU with its own registers and instruction pointer, executing the shared image.
+     *  Processes are multiplexed onto a fixed number of worker threads:
+     *
+     *      * every worker has its own queue of runnable processes,
+     *      * a worker runs the process from the front of its queue for one slice (until it yields or
+     *        uses up its instruction budget) and puts it at the back of the queue,
+     *      * processes spawned by a process go to the back of the queue of the worker running it,
+     *      * a worker with an empty queue steals from the back of queues of other workers,
+     *      * a process that can not send to or receive from a channel is parked (it is in no queue) and
+     *        is put back in a queue by the process that made room in, or sent something to, the channel,
+     *
+     *  When all unfinished processes are parked none of them can ever be woken up;
+     *  they are finished with an error (deadlock).
+     *  Output of each process is written line by line, so lines written by different processes never mix.
+     *  Scheduler runs until all processes finish; exit code is the exit code of the first process.
+     */
+    class Process;
+    class ProcessOutput;
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<Process*> queue;
+        uint64_t slices;
+        uint64_t steals;
+
+        Worker(): slices(0), steals(0) {}
+    };
+
+    CodeImagePtr image;
+    std::ostream& out;
+    std::mutex output_lock;
+    uint64_t budget;
+
+    std::vector<std::unique_ptr<Worker> > workers;
+
+    /*  Numbers of unfinished processes, of processes waiting in queues, and of all processes run.
+     *  Workers with nothing to do sleep until something is queued or everything is finished.
+     */
+    std::atomic<uint64_t> live;
+    std::atomic<uint64_t> queued;
+    std::atomic<uint64_t> spawned;
+    std::atomic<unsigned> sleeping;
+    std::mutex idle_lock;
+    std::condition_variable idle;
+
+    /*  Processes blocked on channels.
+     *  The lock is held by a process while it is being parked, so it can not be mistaken for a deadlock
+     *  before its channel is checked once more; it is recursive because the check may wake the process at once.
+     */
+    std::recursive_mutex parked_lock;
+    std::set<Process*> parked;
+
+    int exit_code;
+
+    void work(unsigned);
+    void park(Process*);
+    void wake(Process*);
+    bool deadlocked();
+    Process* take(unsigned);
+    void enqueue(unsigned, Process*);
+    void finish(Process*, int);
+    void write(const char*, size_t);
+
+    public:
+        // debug flag, passed to every process
+        bool debug;
+
+        // limit of instructions every process may execute (0 means no limit)
+        uint64_t max_instructions;
+
+        /*  Start a new process at given bytecode offset, with given object placed in given register.
+         *  Called by CPUs executing `spawn` instructions.
+         */
+        void spawn(uint32_t offset, int reg, Object* value);
+
+        int run();
+        SchedulerStats stats() const;
+
+        Scheduler(const CodeImagePtr&, unsigned n = std::thread::hardware_concurrency(), std::ostream& o = std::cout, uint64_t b = DEFAULT_PREEMPTION_BUDGET);
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+        ~Scheduler();
+};
+
+
+#endif
@@ -0,0 +1,132 @@
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../types/object.h"
+#include "../types/integer.h"
+#include "../types/boolean.h"
+#include "../types/byte.h"
+#include "cpu.h"
+#include "snapshot.h"
+using namespace std;
+
+
+vector<byte> CPU::snapshot() const {
+    /*  Save state of the CPU.
+     *
+     *  Registers created by `ref` are saved as references to the register owning their object, so
+     *  after restoring they refer to the same (restored) object again.
+     */
+    if (not image) { throw "snapshot: no program loaded"; }
+
+    vector<byte> data(sizeof(SnapshotHeader) + reg_count*sizeof(SnapshotRegister), 0);
+    SnapshotHeader* header = (SnapshotHeader*)&data[0];
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header->version = SNAPSHOT_VERSION;
+    header->register_count = reg_count;
+    header->image_fingerprint = image->fingerprint();
+    header->bytecode_size = bytecode_size;
+    header->instruction_pointer = (instruction_pointer - bytecode);
+    header->return_code = return_code;
+    header->finished = finished;
+
+    SnapshotRegister* records = (SnapshotRegister*)(&data[0] + sizeof(SnapshotHeader));
+    for (int i = 0; i < reg_count; ++i) {
+        SnapshotRegister& record = records[i];
+        record.alias = -1;
+        if (not registers[i]) { continue; }
+
+        if (references[i]) {
+            for (int j = 0; j < reg_count; ++j) {
+                if (registers[j] == registers[i] and not references[j]) { record.alias = j; }
+            }
+            if (record.alias == -1) {
+                throw ("snapshot: register " + to_string(i) + " refers to an object not owned by any register");
+            }
+            record.reference = 1;
+            continue;
+        }
+
+        string type = registers[i]->type();
+        if (type == "Integer") {
+            record.type = SNAPSHOT_INTEGER;
+            record.value = static_cast<Integer*>(registers[i])->value();
+        } else if (type == "Boolean") {
+            record.type = SNAPSHOT_BOOLEAN;
+            record.value = static_cast<Boolean*>(registers[i])->value();
+        } else if (type == "Byte") {
+            record.type = SNAPSHOT_BYTE;
+            record.value = static_cast<Byte*>(registers[i])->value();
+        } else {
+            throw ("snapshot: register " + to_string(i) + " holds an object of type " + type + " which can not be saved");
+        }
+    }
+    return data;
+}
+
+CPU& CPU::restore(const byte* data, size_t size) {
+    /*  Replace state of the CPU with a saved one.
+     *  Snapshot is checked completely before anything is changed, so
+     *  the CPU is left as it was if it is rejected.
+     */
+    if (not image) { throw "restore: no program loaded"; }
+    if (size < sizeof(SnapshotHeader) or memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw "restore: not a snapshot";
+    }
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(SnapshotHeader));
+    if (header.version != SNAPSHOT_VERSION) { throw "restore: unsupported snapshot version"; }
+    if (header.register_count != uint32_t(reg_count)) { throw "restore: snapshot was made by a CPU with a different number of registers"; }
+    if (size != sizeof(SnapshotHeader) + reg_count*sizeof(SnapshotRegister)) { throw "restore: snapshot is truncated"; }
+    if (header.image_fingerprint != image->fingerprint() or header.bytecode_size != bytecode_size) {
+        throw "restore: snapshot was made for a different program";
+    }
+    if (header.instruction_pointer >= bytecode_size) { throw "restore: instruction pointer out of bounds"; }
+
+    vector<SnapshotRegister> records(reg_count);
+    memcpy(&records[0], data + sizeof(SnapshotHeader), reg_count*sizeof(SnapshotRegister));
+    for (int i = 0; i < reg_count; ++i) {
+        const SnapshotRegister& record = records[i];
+        bool valid = (record.type <= SNAPSHOT_BYTE);
+        if (record.reference) {
+            valid = (record.type == SNAPSHOT_EMPTY and record.alias >= 0 and record.alias < reg_count and
+                     not records[record.alias].reference and records[record.alias].type != SNAPSHOT_EMPTY);
+        }
+        if (not valid) { throw ("restore: invalid record of register " + to_string(i)); }
+    }
+
+    for (int i = 0; i < reg_count; ++i) {
+        if (registers[i] and not references[i] and not shared[i]) { delete registers[i]; }
+        registers[i] = 0;
+        references[i] = false;
+        shared[i] = false;
+    }
+    for (int i = 0; i < reg_count; ++i) {
+        const SnapshotRegister& record = records[i];
+        switch (record.type) {
+            case SNAPSHOT_INTEGER:
+                registers[i] = new Integer(record.value);
+                break;
+            case SNAPSHOT_BOOLEAN:
+                registers[i] = new Boolean(record.value);
+                break;
+            case SNAPSHOT_BYTE:
+                registers[i] = new Byte(record.value);
+                break;
+        }
+    }
+    for (int i = 0; i < reg_count; ++i) {
+        if (records[i].reference) {
+            registers[i] = registers[records[i].alias];
+            references[i] = true;
+        }
+    }
+
+    instruction_pointer = bytecode + header.instruction_pointer;
+    return_code = header.return_code;
+    finished = header.finished;
+    yielded = false;
+    block_paid = false;
+    waiting_channel.reset();
+    return (*this);
+}
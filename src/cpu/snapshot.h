@@ -0,0 +1,53 @@
+#ifndef WUDOO_CPU_SNAPSHOT_H
+#define WUDOO_CPU_SNAPSHOT_H
+
+#pragma once
+
+#include <cstdint>
+
+
+/*  Format of CPU snapshots (see CPU::snapshot() and CPU::restore()).
+ *
+ *  A snapshot is a header followed by one fixed-size record for every register of the CPU, so
+ *  it is written and read in a single operation and restored in a single pass over the records.
+ *  Fields are stored in the byte order of the machine, like in compiled programs.
+ */
+
+const char SNAPSHOT_MAGIC[8] = { 'W', 'U', 'D', 'O', 'O', 'S', 'N', 'P' };
+const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t register_count;
+
+    // identity of the code image the CPU was running; a snapshot is restored only into a CPU running the same image
+    uint64_t image_fingerprint;
+    uint32_t bytecode_size;
+
+    // bytecode offset of the next instruction to execute
+    uint32_t instruction_pointer;
+    int32_t return_code;
+    uint32_t finished;
+};
+
+/*  Types of objects in registers.
+ *  Only values of these types can be saved; a register holding anything else makes snapshot() fail.
+ */
+enum SnapshotType : uint8_t {
+    SNAPSHOT_EMPTY = 0,
+    SNAPSHOT_INTEGER,
+    SNAPSHOT_BOOLEAN,
+    SNAPSHOT_BYTE,
+};
+
+struct SnapshotRegister {
+    uint8_t type;
+    uint8_t reference;  // the register is a reference (created by `ref`) to the object of register `alias`
+    uint16_t unused;
+    int32_t alias;
+    int64_t value;
+};
+
+
+#endif
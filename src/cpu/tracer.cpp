@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "../support/cycles.h"
+#include "image.h"
+#include "tracer.h"
+using namespace std;
+
+
+unsigned Tracer::operands(const byte* instruction, Operand out[MAX_OPERANDS]) {
+    /*  Most instructions take only register operands (a reference flag and an int each);
+     *  the rest are decoded the same way their implementations read them.
+     *  Returns the number of operands (0 for invalid opcodes).
+     */
+    byte opcode = *instruction;
+    const byte* ptr = instruction + 1;
+    auto reg = [&ptr, out](unsigned i) {
+        out[i].kind = Operand::REGISTER;
+        out[i].ref = *((const bool*)ptr);
+        ptr += sizeof(bool);
+        out[i].value = *((const int*)ptr);
+        ptr += sizeof(int);
+    };
+    auto target = [&ptr, out](unsigned i, Operand::Kind kind) {
+        out[i].kind = kind;
+        out[i].ref = false;
+        out[i].value = *((const int*)ptr);
+        ptr += sizeof(int);
+    };
+
+    switch (opcode) {
+        case JUMP:
+            target(0, Operand::TARGET);
+            return 1;
+        case BRANCH:
+            reg(0);
+            target(1, Operand::ADDRESS);
+            target(2, Operand::ADDRESS);
+            return 3;
+        case SPAWN:
+            reg(0);
+            target(1, Operand::TARGET);
+            return 2;
+        case BSTORE:
+            reg(0);
+            out[1].kind = Operand::BYTE;
+            out[1].ref = *((const bool*)ptr);
+            out[1].value = *(ptr + sizeof(bool));
+            return 2;
+        default:
+            unsigned size = opsize(opcode);
+            unsigned count = (size ? min((size - 1) / unsigned(sizeof(bool) + sizeof(int)), unsigned(MAX_OPERANDS)) : 0);
+            for (unsigned i = 0; i < count; ++i) { reg(i); }
+            return count;
+    }
+}
+
+
+Tracer::Tracer(const string& path, const CodeImagePtr& program, size_t capacity): mask(0), head(0), tail(0), stall_count(0), stopping(false) {
+    size_t size = 1;
+    while (size < capacity) { size <<= 1; }
+    ring.reset(new Record[size]);
+    mask = size - 1;
+
+    file.open(path, ios::out | ios::binary);
+    if (!file) { throw "tracer: trace file could not be opened"; }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(Record);
+    header.fingerprint = program->fingerprint();
+    header.base = (uint64_t)program->bytecode();
+    strncpy(header.unit, cycles::UNIT, sizeof(header.unit));
+    file.write((const char*)&header, sizeof(header));
+
+    flusher = thread(&Tracer::flush, this);
+}
+
+Tracer::~Tracer() {
+    stop();
+}
+
+bool Tracer::stop() {
+    if (flusher.joinable()) {
+        stopping.store(true, memory_order_release);
+        flusher.join();
+        file.close();
+    }
+    return not file.fail();
+}
+
+void Tracer::flush() {
+    /*  Records are written in runs of contiguous slots.
+     *  The thread sleeps only when the buffer is empty, and
+     *  `stopping` is read before `head`, so after it is seen set every record committed before stop() is written.
+     */
+    while (true) {
+        bool last = stopping.load(memory_order_acquire);
+        uint64_t from = tail.load(memory_order_relaxed);
+        uint64_t to = head.load(memory_order_acquire);
+        if (from == to) {
+            if (last) { return; }
+            this_thread::sleep_for(chrono::milliseconds(1));
+            continue;
+        }
+        uint64_t first = (from & mask);
+        uint64_t count = min(to - from, mask + 1 - first);
+        file.write((const char*)&ring[first], count * sizeof(Record));
+        tail.store(from + count, memory_order_release);
+    }
+}
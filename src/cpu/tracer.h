@@ -0,0 +1,114 @@
+#ifndef WUDOO_CPU_TRACER_H
+#define WUDOO_CPU_TRACER_H
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include "../bytecode/bytetypedef.h"
+#include "image.h"
+
+
+const char TRACE_MAGIC[8] = { 'W', 'U', 'D', 'O', 'O', 'T', 'R', 'C' };
+const uint32_t TRACE_VERSION = 1;
+
+
+class Tracer {
+    /*  Binary execution tracer (`wudoo-run --trace <file>`).
+     *
+     *  The CPU appends a fixed-size record for every instruction it executes to a ring buffer, and
+     *  a background thread writes records from the buffer to the file.
+     *  The buffer has a single producer (the CPU, which must run on one thread) and a single consumer (the flushing thread),
+     *  so both sides only need a pair of atomic counters; when the buffer is full the CPU waits for
+     *  the flushing thread instead of dropping records.
+     *
+     *  Trace files begin with a header (see Header) followed by records.
+     *  They are decoded by `wudoo-trace`, which needs the program the trace was recorded for.
+     */
+    public:
+        static const unsigned MAX_OPERANDS = 4;
+        static const size_t DEFAULT_CAPACITY = 1 << 18;
+
+        struct Header {
+            char magic[8];
+            uint32_t version;
+            uint32_t record_size;
+            // fingerprint of the traced image, and address its bytecode was loaded at (for rendering of addresses)
+            uint64_t fingerprint;
+            uint64_t base;
+            // unit of timestamps (see support/cycles.h), zero-padded
+            char unit[8];
+        };
+
+        struct Record {
+            // cycle counter when the instruction began
+            uint64_t time;
+            uint32_t offset;
+            uint8_t opcode;
+            // bit N is set if operand N was a reference and has been resolved
+            uint8_t resolved;
+            uint16_t reserved;
+            // operands with references resolved to what the instruction used
+            int32_t operands[MAX_OPERANDS];
+        };
+
+        /*  Operands of an instruction, decoded from bytecode.
+         *  Registers are `(@)<n>`, bytes are the second operand of `bstore`, and
+         *  targets are bytecode offsets of `jump`, `branch` (ADDRESS) and `spawn`.
+         */
+        struct Operand {
+            enum Kind { REGISTER, BYTE, TARGET, ADDRESS } kind;
+            bool ref;
+            int32_t value;
+        };
+        static unsigned operands(const byte* instruction, Operand out[MAX_OPERANDS]);
+
+        /*  Open the file and start the flushing thread.
+         *  Throws if the file can not be written.
+         */
+        Tracer(const std::string& path, const CodeImagePtr& program, size_t capacity = DEFAULT_CAPACITY);
+        ~Tracer();
+
+        /*  Record slot for the next instruction, and publishing it once it is filled in.
+         *  Called only by the CPU.
+         */
+        Record& claim() {
+            uint64_t next = head.load(std::memory_order_relaxed);
+            while (next - tail.load(std::memory_order_acquire) > mask) {
+                ++stall_count;
+                std::this_thread::yield();
+            }
+            return ring[next & mask];
+        }
+        void commit() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /*  Write the remaining records and stop the flushing thread.
+         *  Returns false if writing failed.
+         */
+        bool stop();
+
+        uint64_t records() const { return head.load(); }
+        uint64_t stalls() const { return stall_count; }
+
+    private:
+        std::unique_ptr<Record[]> ring;
+        uint64_t mask;
+        std::atomic<uint64_t> head;
+        std::atomic<uint64_t> tail;
+        uint64_t stall_count;
+
+        std::ofstream file;
+        std::atomic<bool> stopping;
+        std::thread flusher;
+
+        void flush();
+};
+
+
+#endif
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bytecode/bytetypedef.h"
+#include "debuginfo.h"
+using namespace std;
+
+
+static void putUnsigned(vector<byte>& out, uint64_t value) {
+    do {
+        byte b = (value & 0x7f);
+        value >>= 7;
+        out.push_back(b | (value ? 0x80 : 0));
+    } while (value);
+}
+
+static void putSigned(vector<byte>& out, int64_t value) {
+    // zigzag encoding keeps small negative numbers small
+    putUnsigned(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+static void putString(vector<byte>& out, const string& s) {
+    putUnsigned(out, s.size());
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+
+class Reader {
+    /*  Reads fields of a section, throwing when it ends too early.
+     */
+    const byte* ptr;
+    const byte* end;
+
+    public:
+        uint64_t getUnsigned() {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                if (ptr >= end) { throw "invalid debug information: truncated"; }
+                byte b = *ptr++;
+                value |= (uint64_t(b & 0x7f) << shift);
+                if (not (b & 0x80)) { return value; }
+            }
+            throw "invalid debug information: number too long";
+        }
+
+        int64_t getSigned() {
+            uint64_t value = getUnsigned();
+            return int64_t(value >> 1) ^ -int64_t(value & 1);
+        }
+
+        string getString() {
+            uint64_t size = getUnsigned();
+            if (size > uint64_t(end - ptr)) { throw "invalid debug information: truncated"; }
+            string s((const char*)ptr, size);
+            ptr += size;
+            return s;
+        }
+
+        uint64_t count() {
+            // every entry takes at least one byte, so a larger count can only come from a malformed section
+            uint64_t n = getUnsigned();
+            if (n > uint64_t(end - ptr)) { throw "invalid debug information: truncated"; }
+            return n;
+        }
+
+        Reader(const byte* data, size_t size): ptr(data), end(data+size) {}
+};
+
+
+unsigned DebugInfo::line(uint32_t offset) const {
+    auto found = lower_bound(lines.begin(), lines.end(), offset, [](const Line& l, uint32_t o) { return l.offset < o; });
+    return ((found != lines.end() and found->offset == offset) ? found->line : 0);
+}
+
+string DebugInfo::location(uint32_t offset) const {
+    unsigned n = line(offset);
+    return (n ? file + ':' + to_string(n) : "");
+}
+
+string DebugInfo::mark(uint32_t offset) const {
+    auto found = lower_bound(marks.begin(), marks.end(), make_pair(offset, string()));
+    return ((found != marks.end() and found->first == offset) ? found->second : "");
+}
+
+string DebugInfo::enclosing(uint32_t offset) const {
+    auto found = upper_bound(marks.begin(), marks.end(), offset, [](uint32_t o, const pair<uint32_t, string>& m) { return o < m.first; });
+    return (found == marks.begin() ? "" : (found-1)->second);
+}
+
+string DebugInfo::name(int reg) const {
+    string joined;
+    for (auto& n : names) {
+        if (n.first != reg) { continue; }
+        joined += (joined.size() ? "/" : "") + n.second;
+    }
+    return joined;
+}
+
+vector<byte> DebugInfo::encode() const {
+    vector<byte> out(DEBUG_INFO_MAGIC, DEBUG_INFO_MAGIC + sizeof(DEBUG_INFO_MAGIC));
+    putUnsigned(out, DEBUG_INFO_VERSION);
+    putString(out, file);
+
+    putUnsigned(out, lines.size());
+    uint32_t offset = 0;
+    unsigned line = 0;
+    for (const Line& l : lines) {
+        putUnsigned(out, l.offset - offset);
+        putSigned(out, int64_t(l.line) - int64_t(line));
+        offset = l.offset;
+        line = l.line;
+    }
+
+    putUnsigned(out, marks.size());
+    offset = 0;
+    for (auto& m : marks) {
+        putUnsigned(out, m.first - offset);
+        putString(out, m.second);
+        offset = m.first;
+    }
+
+    putUnsigned(out, names.size());
+    for (auto& n : names) {
+        putSigned(out, n.first);
+        putString(out, n.second);
+    }
+    return out;
+}
+
+DebugInfoPtr DebugInfo::decode(const byte* data, size_t size) {
+    if (size < sizeof(DEBUG_INFO_MAGIC) or memcmp(data, DEBUG_INFO_MAGIC, sizeof(DEBUG_INFO_MAGIC)) != 0) {
+        return DebugInfoPtr();
+    }
+    Reader in(data + sizeof(DEBUG_INFO_MAGIC), size - sizeof(DEBUG_INFO_MAGIC));
+    if (in.getUnsigned() != DEBUG_INFO_VERSION) { throw "invalid debug information: unsupported version"; }
+
+    shared_ptr<DebugInfo> info(new DebugInfo());
+    info->file = in.getString();
+
+    uint64_t count = in.count();
+    info->lines.reserve(count);
+    uint64_t offset = 0;
+    int64_t line = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        offset += in.getUnsigned();
+        line += in.getSigned();
+        if (offset > UINT32_MAX or line <= 0 or line > UINT32_MAX) { throw "invalid debug information: line table out of range"; }
+        if (i and offset <= info->lines.back().offset) { throw "invalid debug information: line table is not sorted"; }
+        info->lines.push_back(Line{uint32_t(offset), unsigned(line)});
+    }
+
+    count = in.count();
+    offset = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        offset += in.getUnsigned();
+        if (offset > UINT32_MAX) { throw "invalid debug information: mark out of range"; }
+        info->marks.push_back(make_pair(uint32_t(offset), in.getString()));
+    }
+
+    count = in.count();
+    for (uint64_t i = 0; i < count; ++i) {
+        int64_t reg = in.getSigned();
+        info->names.push_back(make_pair(int(reg), in.getString()));
+    }
+    return info;
+}
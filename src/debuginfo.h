@@ -0,0 +1,75 @@
+#ifndef WUDOO_DEBUGINFO_H
+#define WUDOO_DEBUGINFO_H
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "bytecode/bytetypedef.h"
+
+
+class DebugInfo;
+typedef std::shared_ptr<const DebugInfo> DebugInfoPtr;
+
+
+/*  Debug section of compiled programs (`wudoo-asm -g`).
+ *
+ *  Written after the bytecode, so programs assembled without it are exactly what they were
+ *  (and readers that do not know about it skip it).
+ *  The section begins with DEBUG_INFO_MAGIC and a version, followed by
+ *  the name of the source file, the line table, marks and register names.
+ *  Numbers are stored as LEB128 varints; the line table stores for every instruction
+ *  the distance from the previous instruction and the difference between their lines (which is negative when
+ *  the optimiser or the layout moved code), so a typical entry takes two bytes.
+ */
+const char DEBUG_INFO_MAGIC[8] = { 'W', 'U', 'D', 'O', 'O', 'D', 'B', 'G' };
+const uint32_t DEBUG_INFO_VERSION = 1;
+
+
+class DebugInfo {
+    public:
+        struct Line {
+            uint32_t offset;
+            unsigned line;
+        };
+
+        // source file the program was assembled from
+        std::string file;
+
+        // source line of every instruction, sorted by bytecode offset
+        std::vector<Line> lines;
+
+        // bytecode offset -> mark (`.mark:` directives), sorted by offset
+        std::vector<std::pair<uint32_t, std::string> > marks;
+
+        // register -> name (`.name:` directives), sorted by register
+        std::vector<std::pair<int, std::string> > names;
+
+        /*  Source line of the instruction at given offset (0 if it is not known), and
+         *  its location as "<file>:<line>" (empty if it is not known).
+         */
+        unsigned line(uint32_t offset) const;
+        std::string location(uint32_t offset) const;
+
+        /*  Mark at given offset, and the last mark at or before it (i.e. the part of the program the offset is in).
+         *  Empty if there is none.
+         */
+        std::string mark(uint32_t offset) const;
+        std::string enclosing(uint32_t offset) const;
+
+        // names of a register, separated by slashes if it has more than one (empty if it has none)
+        std::string name(int reg) const;
+
+        std::vector<byte> encode() const;
+
+        /*  Decode a section.
+         *  Returns null if the data does not begin with a debug section, and throws if it is malformed.
+         */
+        static DebugInfoPtr decode(const byte* data, size_t size);
+};
+
+
+#endif
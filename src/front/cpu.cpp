@@ -1,12 +1,28 @@
 #include <cstdlib>
 #include <cstdint>
+#include <condition_variable>
 #include <iostream>
 #include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include "../version.h"
 #include "../support/string.h"
+#include "../support/exception.h"
+#include "../support/threadpool.h"
+#include "../support/perf.h"
+#include "../cpu/image.h"
 #include "../cpu/cpu.h"
+#include "../cpu/scheduler.h"
+#include "../cpu/sampler.h"
+#include "../cpu/tracer.h"
+#include "../cpu/allocations.h"
 #include "../program.h"
 using namespace std;
 
@@ -20,6 +36,195 @@ enum RunMode {
 };
 
 
+CodeImagePtr loadImage(const string& filename, ostream& errors) {
+    /*  Load compiled program from a file.
+     *  Reports errors to given stream and returns null image on failure.
+     */
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in) {
+        errors << "fatal: file could not be opened" << endl;
+        return CodeImagePtr();
+    }
+    vector<byte> contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    in.close();
+
+    try {
+        return CodeImage::load((contents.size() ? &contents[0] : 0), contents.size());
+    } catch (const char* e) {
+        errors << "fatal: an error occued during bytecode loading: " << e << endl;
+        if (str::endswith(filename, ".asm")) { errors << NOTE_LOADED_ASM << endl; }
+    }
+    return CodeImagePtr();
+}
+
+
+bool writeSnapshot(const CPU& cpu, const string& filename) {
+    /*  Save state of a CPU to a file.
+     *  Reports errors to standard output and returns false on failure.
+     */
+    vector<byte> data;
+    try {
+        data = cpu.snapshot();
+    } catch (const string& e) {
+        cout << "fatal: " << e << endl;
+        return false;
+    } catch (const char* e) {
+        cout << "fatal: " << e << endl;
+        return false;
+    }
+    ofstream out(filename, ios::out | ios::binary);
+    out.write((const char*)&data[0], data.size());
+    if (!out) {
+        cout << "fatal: snapshot could not be written" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool readSnapshot(CPU& cpu, const string& filename) {
+    /*  Restore state of a CPU from a file.
+     *  Reports errors to standard output and returns false on failure.
+     */
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in) {
+        cout << "fatal: snapshot could not be opened" << endl;
+        return false;
+    }
+    vector<byte> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    try {
+        cpu.restore((data.size() ? &data[0] : 0), data.size());
+    } catch (const string& e) {
+        cout << "fatal: " << e << endl;
+        return false;
+    } catch (const char* e) {
+        cout << "fatal: " << e << endl;
+        return false;
+    }
+    return true;
+}
+
+int runInPhases(CPU& cpu, PerfCounters& perf, const CodeImage& image) {
+    /*  Run a program measuring every phase of it separately.
+     *  Phases are separated by `yield` instructions (which do nothing else in programs that do not spawn processes), and
+     *  named after the marks they begin in if the program has debug information.
+     *  Programs that never yield have a single phase, which is not reported apart from the whole run.
+     */
+    const DebugInfo* info = image.debuginfo();
+    unsigned phase = 0;
+    CPU::Slice slice;
+    // instructions following a `yield` in its block are paid for with the block, but executed in the next phase
+    uint64_t ahead = 0;
+    do {
+        ++phase;
+        string name = "phase " + to_string(phase);
+        string mark = (info ? info->enclosing(cpu.position()) : "");
+        if (mark.size()) { name += " (:" + mark + ")"; }
+
+        uint64_t executed = cpu.instructions() - ahead;
+        PerfCounters::Reading begin = perf.read();
+        slice = cpu.resume();
+        PerfCounters::Reading end = perf.read();
+        ahead = (slice == CPU::YIELDED ? image.cost(cpu.position()) : 0);
+        if (phase > 1 or slice == CPU::YIELDED) { perf.record(name, begin, end, cpu.instructions() - ahead - executed); }
+    } while (slice == CPU::YIELDED);
+    return (slice == CPU::EXHAUSTED ? cpu.trap() : cpu.exitcode());
+}
+
+
+struct BatchResult {
+    string output;
+    int exit_code;
+    bool done;
+
+    BatchResult(): exit_code(0), done(false) {}
+};
+
+int runBatch(const vector<string>& filenames, unsigned jobs, bool debug, uint64_t max_instructions) {
+    /*  Run many programs on a pool of worker threads.
+     *
+     *  Every file is loaded once (files listed several times share one image) and
+     *  every program runs in its own CPU with output captured in its own buffer.
+     *  Outputs are written in the order the files were given, as soon as all programs before them are finished, and
+     *  are followed by a summary of exit codes (on standard error):
+     *
+     *      <exit code> <file>
+     *      ...
+     *      programs: <number>, failed: <number>
+     *
+     *  Returns 0 if every program exited with 0, and 1 otherwise.
+     */
+    map<string, CodeImagePtr> images;
+    map<string, string> errors;
+    for (const string& filename : filenames) {
+        if (images.count(filename)) { continue; }
+        ostringstream error;
+        images[filename] = loadImage(filename, error);
+        errors[filename] = error.str();
+    }
+
+    vector<BatchResult> results(filenames.size());
+    mutex lock;
+    condition_variable finished;
+    {
+        ThreadPool pool(jobs ? jobs : thread::hardware_concurrency());
+        for (unsigned i = 0; i < filenames.size(); ++i) {
+            CodeImagePtr image = images[filenames[i]];
+            BatchResult& result = results[i];
+            if (not image) {
+                result.output = errors[filenames[i]];
+                result.exit_code = 1;
+                result.done = true;
+                continue;
+            }
+            pool.submit([image, &result, &lock, &finished, debug, max_instructions] () {
+                stringbuf buffer;
+                int exit_code = 1;
+                if (image->spawns()) {
+                    // processes of one program in a batch share a single worker
+                    ostream out(&buffer);
+                    Scheduler scheduler(image, 1, out);
+                    scheduler.debug = debug;
+                    scheduler.max_instructions = max_instructions;
+                    exit_code = scheduler.run();
+                } else {
+                    CPU cpu;
+                    cpu.debug = debug;
+                    cpu.limit(max_instructions);
+                    cpu.out.rdbuf(&buffer);
+                    try {
+                        exit_code = cpu.load(image).run();
+                    } catch (...) {
+                        cpu.out << "exception: " << exceptionMessage() << endl;
+                    }
+                }
+                unique_lock<mutex> guard(lock);
+                result.output = buffer.str();
+                result.exit_code = exit_code;
+                result.done = true;
+                finished.notify_all();
+            });
+        }
+
+        for (BatchResult& result : results) {
+            {
+                unique_lock<mutex> guard(lock);
+                finished.wait(guard, [&result] { return result.done; });
+            }
+            cout << result.output << flush;
+            string().swap(result.output);
+        }
+    }
+
+    unsigned failed = 0;
+    for (unsigned i = 0; i < filenames.size(); ++i) {
+        cerr << results[i].exit_code << ' ' << filenames[i] << '\n';
+        if (results[i].exit_code != 0) { ++failed; }
+    }
+    cerr << "programs: " << filenames.size() << ", failed: " << failed << endl;
+    return (failed ? 1 : 0);
+}
+
+
 int main(int argc, char* argv[]) {
     // setup command line arguments vector
     vector<string> args;
@@ -30,74 +235,402 @@ int main(int argc, char* argv[]) {
     // run code
     if (argc > 1 and args[1] != "--help") {
         bool debug = false;
-        string filename;
-        if (args[1] == "--debug") {
-            debug = true;
-            if (argc >= 3) {
-                filename = args[2];
+        string profile_filename;
+        string execution_profile_filename;
+        string samples_filename;
+        unsigned sample_rate = SamplingProfiler::DEFAULT_RATE;
+        string trace_filename;
+        string allocations_filename;
+        string coverage_filename;
+        string lcov_filename;
+        bool perf_counters = false;
+        string snapshot_filename;
+        string restore_filename;
+        unsigned jobs = 0;
+        unsigned workers = 0;
+        uint64_t max_instructions = 0;
+        bool batch = false;
+        vector<string> filenames;
+
+        /*  Options come before file names.
+         */
+        int i = 1;
+        for (; i < argc; ++i) {
+            if (args[i] == "--debug") {
+                debug = true;
+            } else if (args[i] == "--branch-profile") {
+                if (i+1 >= argc) {
+                    cout << "fatal: --branch-profile requires a file name" << endl;
+                    return 1;
+                }
+                profile_filename = args[++i];
+            } else if (args[i] == "--profile") {
+                if (i+1 >= argc) {
+                    cout << "fatal: --profile requires a file name" << endl;
+                    return 1;
+                }
+                execution_profile_filename = args[++i];
+            } else if (args[i] == "--sample") {
+                if (i+1 >= argc) {
+                    cout << "fatal: --sample requires a file name" << endl;
+                    return 1;
+                }
+                samples_filename = args[++i];
+            } else if (args[i] == "--sample-rate") {
+                if (i+1 >= argc or (sample_rate = atoi(args[i+1].c_str())) == 0) {
+                    cout << "fatal: --sample-rate requires a positive number" << endl;
+                    return 1;
+                }
+                ++i;
+            } else if (args[i] == "--trace") {
+                if (i+1 >= argc) {
+                    cout << "fatal: --trace requires a file name" << endl;
+                    return 1;
+                }
+                trace_filename = args[++i];
+            } else if (args[i] == "--alloc-stats") {
+                if (i+1 >= argc) {
+                    cout << "fatal: --alloc-stats requires a file name" << endl;
+                    return 1;
+                }
+                allocations_filename = args[++i];
+            } else if (args[i] == "--perf-counters") {
+                perf_counters = true;
+            } else if (args[i] == "--coverage" or args[i] == "--lcov") {
+                if (i+1 >= argc) {
+                    cout << "fatal: " << args[i] << " requires a file name" << endl;
+                    return 1;
+                }
+                (args[i] == "--coverage" ? coverage_filename : lcov_filename) = args[i+1];
+                ++i;
+            } else if (args[i] == "--snapshot" or args[i] == "--restore") {
+                if (i+1 >= argc) {
+                    cout << "fatal: " << args[i] << " requires a file name" << endl;
+                    return 1;
+                }
+                (args[i] == "--snapshot" ? snapshot_filename : restore_filename) = args[i+1];
+                ++i;
+            } else if (args[i] == "--jobs") {
+                if (i+1 >= argc or (jobs = atoi(args[i+1].c_str())) == 0) {
+                    cout << "fatal: --jobs requires a positive number" << endl;
+                    return 1;
+                }
+                ++i;
+                batch = true;
+            } else if (args[i] == "--workers") {
+                if (i+1 >= argc or (workers = atoi(args[i+1].c_str())) == 0) {
+                    cout << "fatal: --workers requires a positive number" << endl;
+                    return 1;
+                }
+                ++i;
+            } else if (args[i] == "--max-instructions") {
+                /*  Programs executing more instructions are stopped with FUEL_EXHAUSTED_EXIT_CODE
+                 *  (the limit applies to every process of programs that spawn them).
+                 */
+                if (i+1 >= argc or (max_instructions = strtoull(args[i+1].c_str(), 0, 10)) == 0) {
+                    cout << "fatal: --max-instructions requires a positive number" << endl;
+                    return 1;
+                }
+                ++i;
+            } else if (args[i] == "--manifest") {
+                /*  Manifest lists files to run, one per line.
+                 *  Empty lines and lines beginning with '#' are skipped.
+                 */
+                if (i+1 >= argc) {
+                    cout << "fatal: --manifest requires a file name" << endl;
+                    return 1;
+                }
+                ifstream manifest(args[++i]);
+                if (!manifest) {
+                    cout << "fatal: manifest could not be opened" << endl;
+                    return 1;
+                }
+                string line;
+                while (getline(manifest, line)) {
+                    if (line.size() and line[0] != '#') { filenames.push_back(line); }
+                }
+                batch = true;
             } else {
-                cout << "fatal: no file to run" << endl;
+                break;
+            }
+        }
+        for (; i < argc; ++i) { filenames.push_back(args[i]); }
+
+        /*  Options that instrument, or save and restore, a single CPU running a single program.
+         *  Returns the first of them that was given (empty if none was).
+         */
+        auto single_cpu_option = [&]() -> string {
+            const pair<const char*, bool> options[] = {
+                { "--branch-profile", profile_filename.size() > 0 },
+                { "--profile", execution_profile_filename.size() > 0 },
+                { "--sample", samples_filename.size() > 0 },
+                { "--trace", trace_filename.size() > 0 },
+                { "--alloc-stats", allocations_filename.size() > 0 },
+                { "--coverage", coverage_filename.size() > 0 },
+                { "--lcov", lcov_filename.size() > 0 },
+                { "--perf-counters", perf_counters },
+                { "--snapshot", snapshot_filename.size() > 0 },
+                { "--restore", restore_filename.size() > 0 },
+            };
+            for (auto& option : options) {
+                if (option.second) { return option.first; }
+            }
+            return "";
+        };
+
+        if (filenames.size() > 1) { batch = true; }
+        if (batch) {
+            string option = single_cpu_option();
+            if (option.size()) {
+                cout << "fatal: " << option << " can be used only with a single program" << endl;
                 return 1;
             }
-        } else {
-            filename = args[1];
+            return runBatch(filenames, jobs, debug, max_instructions);
         }
 
-        if (!filename.size()) {
+        if (filenames.empty() or !filenames[0].size()) {
             cout << "fatal: no file to run" << endl;
             return 1;
         }
 
-        ifstream in(filename, ios::in | ios::binary);
-
-        if (!in) {
-            cout << "fatal: file could not be opened" << endl;
+        if (execution_profile_filename.size() and samples_filename.size()) {
+            cout << "fatal: --profile and --sample can not be used together" << endl;
             return 1;
         }
-
-        uint16_t bytes;
-        uint16_t starting_instruction;
-        char buffer[16];
-
-        in.read(buffer, 16);
-        if (!in) {
-            cout << "fatal: an error occued during bytecode loading: cannot read size" << endl;
-            if (str::endswith(filename, ".asm")) { cout << NOTE_LOADED_ASM << endl; }
+        if (trace_filename.size() and (execution_profile_filename.size() or samples_filename.size())) {
+            cout << "fatal: --trace can not be used together with --profile or --sample" << endl;
             return 1;
-        } else {
-            bytes = *((uint16_t*)buffer);
         }
-
-        in.read(buffer, 16);
-        if (!in) {
-            cout << "fatal: an error occued during bytecode loading: cannot read executable offset" << endl;
-            if (str::endswith(filename, ".asm")) { cout << NOTE_LOADED_ASM << endl; }
+        if (allocations_filename.size() and (execution_profile_filename.size() or samples_filename.size() or trace_filename.size())) {
+            cout << "fatal: --alloc-stats can not be used together with --profile, --sample or --trace" << endl;
             return 1;
-        } else {
-            starting_instruction = *((uint16_t*)buffer);
         }
 
-        byte* bytecode = new byte[bytes];
-        in.read((char*)bytecode, bytes);
+        /*  Counters measure loading of the program and its run (and phases of the run) separately.
+         */
+        unique_ptr<PerfCounters> perf;
+        PerfCounters::Reading loading;
+        if (perf_counters) {
+            perf.reset(new PerfCounters());
+            loading = perf->read();
+        }
 
-        if (!in) {
-            cout << "fatal: an error occued during bytecode loading: cannot read instructions" << endl;
-            if (str::endswith(filename, ".asm")) { cout << NOTE_LOADED_ASM << endl; }
+        CodeImagePtr image = loadImage(filenames[0], cout);
+        if (not image) { return 1; }
+        if (perf) { perf->record("load", loading, perf->read()); }
+        if (lcov_filename.size() and not image->debuginfo()) {
+            cout << "fatal: --lcov requires a program assembled with debug information (wudoo-asm -g)" << endl;
             return 1;
-        } else {
-            starting_instruction = *((uint16_t*)buffer);
         }
-        in.close();
+
+        /*  Programs that spawn processes are run by a scheduler,
+         *  with one worker thread per hardware thread unless told otherwise.
+         */
+        if (image->spawns()) {
+            string option = single_cpu_option();
+            if (option.size()) {
+                cout << "fatal: " << option << " can not be used with programs that spawn processes" << endl;
+                return 1;
+            }
+            Scheduler scheduler(image, (workers ? workers : thread::hardware_concurrency()));
+            scheduler.debug = debug;
+            scheduler.max_instructions = max_instructions;
+            return scheduler.run();
+        }
 
         // run the bytecode
+        BranchProfile profile;
+        ExecutionProfile execution_profile;
+        AllocationStats allocation_stats;
         CPU cpu;
         cpu.debug = debug;
-        ret_code = cpu.load(bytecode).bytes(bytes).eoffset(starting_instruction).run();
+        cpu.limit(max_instructions);
+        if (profile_filename.size()) { cpu.branch_profile = &profile; }
+        if (execution_profile_filename.size()) { cpu.profile = &execution_profile; }
+        if (allocations_filename.size()) { cpu.allocation_stats = &allocation_stats; }
+        unique_ptr<BlockCoverage> coverage;
+        if (coverage_filename.size() or lcov_filename.size()) {
+            coverage.reset(new BlockCoverage(image));
+            cpu.coverage = coverage.get();
+        }
+        cpu.load(image);
+
+        unique_ptr<Tracer> tracer;
+        if (trace_filename.size()) {
+            try {
+                tracer.reset(new Tracer(trace_filename, image));
+            } catch (const char* e) {
+                cout << "fatal: " << e << endl;
+                return 1;
+            }
+            cpu.tracer = tracer.get();
+        }
+
+        SamplingProfiler sampler(image, sample_rate);
+        if (samples_filename.size()) {
+            try {
+                sampler.start(cpu);
+            } catch (const char* e) {
+                cout << "fatal: " << e << endl;
+                return 1;
+            }
+        }
+
+        /*  A restored program continues from where its snapshot was taken (skipping its initialisation), and
+         *  a program being snapshotted runs until it yields (or halts) and is stopped there.
+         */
+        if (restore_filename.size() and not readSnapshot(cpu, restore_filename)) { return 1; }
+        PerfCounters::Reading running;
+        if (perf) { running = perf->read(); }
+        if (restore_filename.size() or snapshot_filename.size()) {
+            CPU::Slice slice;
+            while ((slice = cpu.resume()) == CPU::YIELDED and snapshot_filename.empty()) {}
+            if (slice == CPU::EXHAUSTED) { return cpu.trap(); }
+            if (snapshot_filename.size() and not writeSnapshot(cpu, snapshot_filename)) { return 1; }
+            ret_code = cpu.exitcode();
+        } else if (perf) {
+            ret_code = runInPhases(cpu, *perf, *image);
+        } else {
+            ret_code = cpu.run();
+        }
+        if (perf) {
+            perf->record("run", running, perf->read(), cpu.instructions());
+            perf->report(cerr);
+        }
+
+        sampler.stop();
+
+        /*  Trace is summarised on standard error; it is decoded by wudoo-trace.
+         */
+        if (tracer) {
+            cpu.tracer = 0;
+            if (not tracer->stop()) {
+                cout << "fatal: trace could not be written" << endl;
+                return 1;
+            }
+            cerr << "trace: " << tracer->records() << " instructions (buffer was full " << tracer->stalls() << " times)" << endl;
+        }
+
+        /*  Branch profile is a text file with size of the bytecode it was collected for, and
+         *  a line for every executed jump and branch:
+         *
+         *      jump <offset> <times taken>
+         *      branch <offset> <times true target taken> <times false target taken>
+         *
+         *  It is read by the assembler (`--profile-use`) to lay out the program.
+         */
+        if (profile_filename.size()) {
+            ofstream out(profile_filename);
+            if (!out) {
+                cout << "fatal: branch profile could not be written" << endl;
+                return 1;
+            }
+            out << "wudoo branch profile" << '\n';
+            out << "bytes " << image->bytes() << '\n';
+            for (auto entry : profile) {
+                if (entry.second.conditional) {
+                    out << "branch " << entry.first << ' ' << entry.second.taken[0] << ' ' << entry.second.taken[1] << '\n';
+                } else {
+                    out << "jump " << entry.first << ' ' << entry.second.taken[0] << '\n';
+                }
+            }
+        }
+
+        /*  Execution profile is reported on standard error (so it does not mix with output of the program), and
+         *  written to the file as JSON.
+         */
+        if (execution_profile_filename.size()) {
+            const byte* bytecode = image->bytecode();
+            execution_profile.report(cerr, bytecode, 20, image->debuginfo());
+            ofstream out(execution_profile_filename);
+            execution_profile.json(out, bytecode, image->debuginfo());
+            if (!out) {
+                cout << "fatal: profile could not be written" << endl;
+                return 1;
+            }
+        }
+
+        /*  Allocation statistics are reported on standard error and written to the file as JSON, together with
+         *  a census of objects the program left in registers.
+         */
+        if (allocations_filename.size()) {
+            cpu.census(allocation_stats);
+            const byte* bytecode = image->bytecode();
+            allocation_stats.report(cerr, bytecode);
+            ofstream out(allocations_filename);
+            allocation_stats.json(out, bytecode);
+            if (!out) {
+                cout << "fatal: allocation statistics could not be written" << endl;
+                return 1;
+            }
+        }
+
+        /*  Block coverage is summarised on standard error, and written to the files as JSON and/or
+         *  as an lcov tracefile of the source the program was assembled from.
+         */
+        if (coverage) { coverage->report(cerr); }
+        if (coverage_filename.size()) {
+            ofstream out(coverage_filename);
+            coverage->json(out);
+            if (!out) {
+                cout << "fatal: coverage could not be written" << endl;
+                return 1;
+            }
+        }
+        if (lcov_filename.size()) {
+            ofstream out(lcov_filename);
+            coverage->lcov(out);
+            if (!out) {
+                cout << "fatal: coverage could not be written" << endl;
+                return 1;
+            }
+        }
+
+        /*  Samples are written as folded stacks rooted at the name of the program, and
+         *  summarised on standard error.
+         */
+        if (samples_filename.size()) {
+            cerr << "samples: " << sampler.samples() << " at " << sample_rate << " per second (" << sampler.missed() << " outside of the program)" << endl;
+            ofstream out(samples_filename);
+            sampler.folded(out, filenames[0]);
+            if (!out) {
+                cout << "fatal: samples could not be written" << endl;
+                return 1;
+            }
+        }
     } else {
         cout << "wudoo VM, version " << VERSION << endl;
         if (argc > 1 and args[1] == "--help") {
-            cout << args[0] << " [--debug] <infile>         - to run a program" << endl;
+            cout << args[0] << " [--debug] [--branch-profile <file>] <infile>" << endl;
+            cout << "        - to run a program (and write counts of taken jumps and branches to <file>)" << endl;
+            cout << args[0] << " [--debug] [--profile <file>] <infile>" << endl;
+            cout << "        - to run a program, report time spent in every opcode and the most often executed instructions" << endl;
+            cout << "          (on standard error), and write counts and times to <file> as JSON" << endl;
+            cout << args[0] << " [--debug] [--sample <file>] [--sample-rate <n>] <infile>" << endl;
+            cout << "        - to run a program sampling the running instruction <n> times per second of CPU time (default: " << SamplingProfiler::DEFAULT_RATE << ")," << endl;
+            cout << "          and write the samples to <file> as folded stacks (for flame graphs)" << endl;
+            cout << args[0] << " [--alloc-stats <file>] <infile>" << endl;
+            cout << "        - to run a program, report objects it allocated (by type, opcode and instruction), their lifetimes and" << endl;
+            cout << "          objects left in registers (on standard error), and write them to <file> as JSON" << endl;
+            cout << args[0] << " [--coverage <file>] [--lcov <file>] <infile>" << endl;
+            cout << "        - to run a program counting executions of its basic blocks, and write them to <file> as JSON and/or" << endl;
+            cout << "          as an lcov tracefile of its source (which requires a program assembled with -g)" << endl;
+            cout << args[0] << " [--perf-counters] <infile>" << endl;
+            cout << "        - to run a program reading the processor's performance counters (cycles, instructions, branch and cache misses)" << endl;
+            cout << "          while it is loaded, runs, and in phases of the run separated by `yield`, and report them per VM instruction" << endl;
+            cout << args[0] << " [--trace <file>] <infile>" << endl;
+            cout << "        - to run a program recording every executed instruction in <file> (decode it with wudoo-trace)" << endl;
+            cout << args[0] << " [--debug] [--restore <snapshot>] [--snapshot <snapshot>] <infile>" << endl;
+            cout << "        - to run a program from the state saved in a snapshot (instead of from the beginning), and/or" << endl;
+            cout << "          to run it until it yields, and save its state" << endl;
+            cout << args[0] << " [--debug] [--jobs <n>] [--manifest <file>] <infile>..." << endl;
+            cout << "        - to run many programs on <n> threads (files are listed after options and/or in the manifest);" << endl;
+            cout << "          outputs are written in order, followed by exit codes on standard error" << endl;
+            cout << args[0] << " [--debug] [--workers <n>] <infile>" << endl;
+            cout << "        - to run a program that spawns processes on <n> worker threads" << endl;
             cout << args[0] << " [--help]                   - to display this message" << endl;
+            cout << "options accepted in all modes:" << endl;
+            cout << "    --max-instructions <n>  - stop programs (with exit code " << FUEL_EXHAUSTED_EXIT_CODE << ") that execute more than <n> instructions" << endl;
         }
     }
 
@@ -0,0 +1,285 @@
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "../version.h"
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "../support/string.h"
+#include "../cpu/image.h"
+#include "../cpu/cpu.h"
+#include "../cpu/tracer.h"
+#include "../cpu/debugger.h"
+using namespace std;
+
+
+string describe(const Debugger& debugger, const CodeImage& image, uint32_t offset) {
+    /*  Offset, source location (with debug information) and the instruction, e.g.
+     *
+     *      byte 107 (power_of.asm:33, in :loop): ilt 5 2 4
+     */
+    ostringstream out;
+    out << "byte " << offset;
+    const DebugInfo* info = image.debuginfo();
+    if (info) {
+        string location = info->location(offset);
+        string mark = info->enclosing(offset);
+        if (location.size() or mark.size()) {
+            out << " (" << location << (location.size() and mark.size() ? ", " : "") << (mark.size() ? "in :" + mark : "") << ')';
+        }
+    }
+    if (offset >= image.bytes()) { return out.str(); }
+
+    const byte* instruction = debugger.instruction(offset);
+    auto name = OP_NAMES.find(OPCODE(*instruction));
+    out << ": " << (name != OP_NAMES.end() ? name->second : "<unknown>");
+    Tracer::Operand operands[Tracer::MAX_OPERANDS];
+    unsigned count = Tracer::operands(instruction, operands);
+    for (unsigned i = 0; i < count; ++i) {
+        out << ((operands[i].ref and operands[i].kind != Tracer::Operand::TARGET) ? " @" : " ") << operands[i].value;
+    }
+    return out.str();
+}
+
+uint32_t location(const string& where, const CodeImage& image) {
+    /*  Breakpoints are set at bytecode offsets (`107`), marks (`:loop`) or
+     *  source lines (`<file>:<line>`, the first instruction assembled from the line); the last two need debug information.
+     */
+    const DebugInfo* info = image.debuginfo();
+    if (where.size() and where[0] == ':') {
+        if (not info) { throw "marks are known only in programs assembled with -g"; }
+        for (auto& mark : info->marks) {
+            if (mark.second == where.substr(1)) { return mark.first; }
+        }
+        throw ("no mark " + where);
+    }
+    size_t colon = where.rfind(':');
+    if (colon != string::npos) {
+        if (not info) { throw "source lines are known only in programs assembled with -g"; }
+        string file = where.substr(0, colon);
+        unsigned line = atoi(where.substr(colon+1).c_str());
+        if (not (file == info->file or str::endswith(info->file, "/" + file))) { throw ("program was assembled from " + info->file); }
+        for (auto& entry : info->lines) {
+            if (entry.line == line) { return entry.offset; }
+        }
+        throw ("no instruction at line " + to_string(line));
+    }
+    if (not str::isnum(where)) { throw ("invalid location: " + where); }
+    return strtoul(where.c_str(), 0, 10);
+}
+
+int reg(const string& name, const CodeImage& image) {
+    /*  Registers are given by index, or by name in programs assembled with -g.
+     */
+    if (str::isnum(name)) { return atoi(name.c_str()); }
+    const DebugInfo* info = image.debuginfo();
+    if (info) {
+        for (auto& entry : info->names) {
+            if (entry.second == name) { return entry.first; }
+        }
+    }
+    throw ("unknown register: " + name);
+}
+
+Debugger::Condition condition(istream& words, const CodeImage& image) {
+    /*  if <register> <comparison> <integer>
+     */
+    string keyword, r, comparison, value;
+    if (not (words >> keyword)) { return Debugger::Condition(); }
+    if (keyword != "if" or not (words >> r >> comparison >> value)) { throw "condition must be: if <register> <comparison> <integer>"; }
+
+    Debugger::Condition::Comparison c;
+    if (comparison == "==") {
+        c = Debugger::Condition::EQ;
+    } else if (comparison == "!=") {
+        c = Debugger::Condition::NE;
+    } else if (comparison == "<") {
+        c = Debugger::Condition::LT;
+    } else if (comparison == "<=") {
+        c = Debugger::Condition::LTE;
+    } else if (comparison == ">") {
+        c = Debugger::Condition::GT;
+    } else if (comparison == ">=") {
+        c = Debugger::Condition::GTE;
+    } else {
+        throw ("invalid comparison: " + comparison);
+    }
+    if (not str::isnum(value[0] == '-' ? value.substr(1) : value)) { throw ("invalid number: " + value); }
+    return Debugger::Condition(reg(r, image), c, strtoll(value.c_str(), 0, 10));
+}
+
+string value(const CPU& cpu, int index, const CodeImage& image) {
+    Object* object = cpu.peek(index);
+    string name = (image.debuginfo() ? image.debuginfo()->name(index) : "");
+    ostringstream out;
+    out << index << (name.size() ? " (" + name + ")" : "") << " = ";
+    if (object) {
+        out << object->str() << " (" << object->type() << ')';
+    } else {
+        out << "<empty>";
+    }
+    return out.str();
+}
+
+void report(Debugger::Stop stop, const Debugger& debugger, const CPU& cpu, const CodeImage& image) {
+    if (stop == Debugger::FINISHED) {
+        cout << "program finished with exit code " << cpu.exitcode() << endl;
+    } else if (stop == Debugger::BREAKPOINT) {
+        cout << "breakpoint " << debugger.current()->id << " at " << describe(debugger, image, debugger.position()) << endl;
+    } else {
+        cout << "at " << describe(debugger, image, debugger.position()) << endl;
+    }
+}
+
+bool command(const string& line, Debugger& debugger, const CPU& cpu, const CodeImage& image) {
+    /*  Execute a command of the debugger.
+     *  Returns false when the debugger should quit.
+     */
+    istringstream words(line);
+    string name;
+    if (not (words >> name) or name[0] == '#') { return true; }
+
+    if (name == "quit" or name == "q") {
+        return false;
+    } else if (name == "break" or name == "b") {
+        string where;
+        if (not (words >> where)) { throw "break requires a location"; }
+        uint32_t offset = location(where, image);
+        Debugger::Condition c = condition(words, image);
+        unsigned id = debugger.add(offset, c);
+        cout << "breakpoint " << id << " at " << describe(debugger, image, offset) << endl;
+    } else if (name == "delete" or name == "d") {
+        unsigned id = 0;
+        if (not (words >> id)) { throw "delete requires a breakpoint number"; }
+        debugger.remove(id);
+    } else if (name == "continue" or name == "c" or name == "run" or name == "r") {
+        if (debugger.finished()) { throw "program has finished"; }
+        report(debugger.resume(), debugger, cpu, image);
+    } else if (name == "step" or name == "s") {
+        unsigned count = 1;
+        words >> count;
+        Debugger::Stop stop = Debugger::STEPPED;
+        for (unsigned i = 0; i < count and stop == Debugger::STEPPED; ++i) {
+            if (debugger.finished()) { throw "program has finished"; }
+            stop = debugger.step();
+        }
+        report(stop, debugger, cpu, image);
+    } else if (name == "print" or name == "p") {
+        string r;
+        if (not (words >> r)) { throw "print requires a register"; }
+        cout << value(cpu, reg(r, image), image) << endl;
+    } else if (name == "registers") {
+        for (int i = 0; i < DEFAULT_REGISTER_SIZE; ++i) {
+            if (cpu.peek(i)) { cout << value(cpu, i, image) << endl; }
+        }
+    } else if (name == "where" or name == "w") {
+        if (debugger.finished()) {
+            cout << "program has finished" << endl;
+        } else {
+            cout << "at " << describe(debugger, image, debugger.position()) << endl;
+        }
+    } else if (name == "breakpoints") {
+        for (auto& point : debugger.breakpoints()) {
+            cout << point.id << ": " << describe(debugger, image, point.offset);
+            if (point.condition.comparison != Debugger::Condition::NONE) { cout << " (conditional)"; }
+            cout << ", hit " << point.hits << " times" << endl;
+        }
+    } else {
+        throw ("unknown command: " + name);
+    }
+    return true;
+}
+
+
+int main(int argc, char* argv[]) {
+    vector<string> args;
+    for (int i = 0; i < argc; ++i) { args.push_back(argv[i]); }
+
+    if (argc < 2 or args[1] == "--help") {
+        cout << "wudoo VM debugger, version " << VERSION << endl;
+        cout << args[0] << " [--script <file>] <program>" << endl;
+        cout << endl;
+        cout << "    runs a program under control of commands read from standard input (or the script):" << endl;
+        cout << "    break <offset>|:<mark>|<file>:<line> [if <register> ==|!=|<|<=|>|>= <integer>]" << endl;
+        cout << "                        - set a (conditional) breakpoint; marks, lines and register names need a program assembled with -g" << endl;
+        cout << "    delete <n>          - delete a breakpoint" << endl;
+        cout << "    continue            - run until a breakpoint or the end of the program" << endl;
+        cout << "    step [<n>]          - execute <n> instructions (1 by default)" << endl;
+        cout << "    print <register>    - show contents of a register" << endl;
+        cout << "    registers           - show contents of all registers" << endl;
+        cout << "    where               - show the next instruction" << endl;
+        cout << "    breakpoints         - list breakpoints" << endl;
+        cout << "    quit" << endl;
+        return (argc < 2 ? 1 : 0);
+    }
+
+    string script;
+    int i = 1;
+    if (args[i] == "--script") {
+        if (i+1 >= argc) {
+            cout << "fatal: --script requires a file name" << endl;
+            return 1;
+        }
+        script = args[i+1];
+        i += 2;
+    }
+    if (i+1 != argc) {
+        cout << "fatal: a single program is required" << endl;
+        return 1;
+    }
+
+    ifstream program(args[i], ios::in | ios::binary);
+    if (!program) {
+        cout << "fatal: program could not be opened" << endl;
+        return 1;
+    }
+    vector<byte> contents((istreambuf_iterator<char>(program)), istreambuf_iterator<char>());
+    CodeImagePtr image;
+    try {
+        image = CodeImage::load((contents.size() ? &contents[0] : 0), contents.size());
+    } catch (const char* e) {
+        cout << "fatal: an error occued during bytecode loading: " << e << endl;
+        return 1;
+    }
+
+    ifstream file;
+    if (script.size()) {
+        file.open(script);
+        if (!file) {
+            cout << "fatal: script could not be opened" << endl;
+            return 1;
+        }
+    }
+    istream& in = (script.size() ? file : cin);
+    bool interactive = (script.empty() and isatty(0));
+
+    CPU cpu;
+    unique_ptr<Debugger> debugger;
+    try {
+        debugger.reset(new Debugger(cpu, image));
+    } catch (const char* e) {
+        cout << "fatal: " << e << endl;
+        return 1;
+    }
+
+    string line;
+    while (true) {
+        if (interactive) { cout << "(wudoo-dbg) " << flush; }
+        if (not getline(in, line)) { break; }
+        try {
+            if (not command(line, *debugger, cpu, *image)) { break; }
+        } catch (const char* e) {
+            cout << "error: " << e << endl;
+        } catch (const string& e) {
+            cout << "error: " << e << endl;
+        }
+    }
+
+    return (debugger->finished() ? cpu.exitcode() : 0);
+}
@@ -0,0 +1,157 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "../version.h"
+#include "../bytecode/bytetypedef.h"
+#include "../bytecode/opcodes.h"
+#include "../bytecode/maps.h"
+#include "../cpu/image.h"
+#include "../cpu/tracer.h"
+using namespace std;
+
+
+/*  Records are read (and rendered) in batches of this many.
+ */
+const size_t BATCH_SIZE = 4096;
+
+
+void render(ostream& out, const Tracer::Record& record, const CodeImage& image, uint64_t base) {
+    /*  Rendered lines are the ones `wudoo-run --debug` prints for the instruction.
+     *  Operands are read from the bytecode, and
+     *  references resolved while tracing are listed after the instruction.
+     */
+    const byte* instruction = image.bytecode() + record.offset;
+    out << "CPU: bytecode " << record.offset << " at 0x" << hex << (base + record.offset) << dec;
+    const DebugInfo* info = image.debuginfo();
+    if (info) {
+        string location = info->location(record.offset);
+        string mark = info->enclosing(record.offset);
+        if (location.empty()) { location = "byte " + to_string(record.offset); }
+        out << " (" << location << (mark.size() ? ", in :" + mark : "") << ')';
+    }
+    auto name = OP_NAMES.find(OPCODE(record.opcode));
+    out << ": " << (name != OP_NAMES.end() ? name->second : "<unknown>");
+
+    Tracer::Operand operands[Tracer::MAX_OPERANDS];
+    unsigned count = Tracer::operands(instruction, operands);
+    for (unsigned i = 0; i < count; ++i) {
+        const Tracer::Operand& operand = operands[i];
+        switch (operand.kind) {
+            case Tracer::Operand::REGISTER:
+                out << (operand.ref ? " @" : " ") << operand.value;
+                break;
+            case Tracer::Operand::BYTE:
+                out << (operand.ref ? " @" : " ");
+                if (operand.value >= 32 and operand.value <= 127) {
+                    out << '"' << char(operand.value) << '"';
+                } else {
+                    out << operand.value;
+                }
+                break;
+            case Tracer::Operand::TARGET:
+                out << ' ' << operand.value;
+                break;
+            case Tracer::Operand::ADDRESS:
+                out << ' ' << operand.value << "::0x" << hex << (base + operand.value) << dec;
+                break;
+        }
+    }
+    bool listed = false;
+    for (unsigned i = 0; i < count; ++i) {
+        if (not (record.resolved & (1 << i))) { continue; }
+        out << (listed ? ", " : " ; ") << '@' << operands[i].value << " = " << record.operands[i];
+        listed = true;
+    }
+    out << '\n';
+}
+
+
+int main(int argc, char* argv[]) {
+    vector<string> args;
+    for (int i = 0; i < argc; ++i) { args.push_back(argv[i]); }
+
+    if (argc < 2 or args[1] == "--help") {
+        cout << "wudoo VM trace decoder, version " << VERSION << endl;
+        cout << args[0] << " [--timestamps] <trace> <program>" << endl;
+        cout << endl;
+        cout << "    renders a trace written by `wudoo-run --trace <trace> <program>` in the format of `wudoo-run --debug`" << endl;
+        cout << "    --timestamps   - prefix every instruction with the time since the first one" << endl;
+        return (argc < 2 ? 1 : 0);
+    }
+
+    bool timestamps = false;
+    int i = 1;
+    for (; i < argc; ++i) {
+        if (args[i] == "--timestamps") {
+            timestamps = true;
+        } else {
+            break;
+        }
+    }
+    if (i+2 != argc) {
+        cout << "fatal: a trace and the program it was recorded for are required" << endl;
+        return 1;
+    }
+
+    ifstream program(args[i+1], ios::in | ios::binary);
+    if (!program) {
+        cout << "fatal: program could not be opened" << endl;
+        return 1;
+    }
+    vector<byte> contents((istreambuf_iterator<char>(program)), istreambuf_iterator<char>());
+    CodeImagePtr image;
+    try {
+        image = CodeImage::load((contents.size() ? &contents[0] : 0), contents.size());
+    } catch (const char* e) {
+        cout << "fatal: an error occued during bytecode loading: " << e << endl;
+        return 1;
+    }
+
+    ifstream in(args[i], ios::in | ios::binary);
+    if (!in) {
+        cout << "fatal: trace could not be opened" << endl;
+        return 1;
+    }
+    Tracer::Header header;
+    if (not in.read((char*)&header, sizeof(header)) or memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        cout << "fatal: not a trace" << endl;
+        return 1;
+    }
+    if (header.version != TRACE_VERSION or header.record_size != sizeof(Tracer::Record)) {
+        cout << "fatal: unsupported trace version" << endl;
+        return 1;
+    }
+    if (header.fingerprint != image->fingerprint()) {
+        cout << "fatal: trace was recorded for a different program" << endl;
+        return 1;
+    }
+    string unit(header.unit, strnlen(header.unit, sizeof(header.unit)));
+
+    ios::sync_with_stdio(false);
+    vector<Tracer::Record> records(BATCH_SIZE);
+    bool first = true;
+    uint64_t start = 0;
+    while (in) {
+        in.read((char*)records.data(), BATCH_SIZE * sizeof(Tracer::Record));
+        size_t count = in.gcount() / sizeof(Tracer::Record);
+        if (in.gcount() % sizeof(Tracer::Record)) {
+            cerr << "warning: trace ends with an incomplete record" << endl;
+        }
+        for (size_t r = 0; r < count; ++r) {
+            const Tracer::Record& record = records[r];
+            if (record.offset >= image->bytes() or opsize(image->bytecode()[record.offset]) == 0) {
+                cout << "fatal: trace refers to an instruction outside of the program (byte " << record.offset << ")" << endl;
+                return 1;
+            }
+            if (first) { start = record.time; first = false; }
+            if (timestamps) { cout << "[+" << (record.time - start) << ' ' << unit << "] "; }
+            render(cout, record, *image, header.base);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../bytecode/bytetypedef.h"
+#include "../support/exception.h"
+#include "../types/object.h"
+#include "../types/integer.h"
+#include "../types/boolean.h"
+#include "../types/byte.h"
+#include "../cpu/image.h"
+#include "../cpu/cpu.h"
+#include "../program.h"
+#include "../assembler/assembler.h"
+#include "wudoo.h"
+using namespace std;
+
+
+static_assert(WUDOO_EXIT_OUT_OF_FUEL == FUEL_EXHAUSTED_EXIT_CODE, "exit code of programs out of fuel differs between the library and the CPU");
+
+
+struct wudoo_image {
+    /*  Handle to a shared image.
+     *  CPUs created from it hold their own references, so the handle may be freed before them.
+     */
+    CodeImagePtr code;
+};
+
+
+class CallbackBuffer : public std::streambuf {
+    /*  Stream buffer passing everything written to it to a callback.
+     */
+    wudoo_output_fn callback;
+    void* context;
+
+    protected:
+        int overflow(int c) {
+            if (c != traits_type::eof() and callback) {
+                char ch = c;
+                callback(&ch, 1, context);
+            }
+            return traits_type::not_eof(c);
+        }
+        streamsize xsputn(const char* s, streamsize n) {
+            if (callback) { callback(s, n, context); }
+            return n;
+        }
+
+    public:
+        CallbackBuffer(wudoo_output_fn f = 0, void* c = 0): callback(f), context(c) {}
+};
+
+
+struct wudoo_cpu {
+    CPU cpu;
+    CodeImagePtr code;
+    int exit_code;
+
+    // allocation statistics, once they are collected
+    unique_ptr<AllocationStats> allocations;
+
+    CallbackBuffer callback;
+    stringbuf buffer;
+    string captured;
+
+    wudoo_cpu(): exit_code(0) {}
+};
+
+
+static void report(char** error, const string& message) {
+    if (not error) { return; }
+    *error = (char*)malloc(message.size() + 1);
+    if (*error) { memcpy(*error, message.c_str(), message.size() + 1); }
+}
+
+
+extern "C" {
+
+void wudoo_free(void* pointer) {
+    free(pointer);
+}
+
+
+int wudoo_assemble(const char* source, size_t size, int flags, wudoo_image** image, char** error) {
+    /*  Assembles the source the same way wudoo-asm does (using one thread).
+     */
+    const string filename = "<source>";
+    Program program;
+    try {
+        assembler::Scan scanned = assembler::scan(source, size, filename);
+        program.reserve(scanned.bytes);
+        assembler::assemble(program, scanned, filename, false, (flags & WUDOO_OPTIMISE));
+        program.calculateBranches();
+    } catch (...) {
+        report(error, exceptionMessage());
+        return WUDOO_ERROR;
+    }
+
+    wudoo_image* result = new wudoo_image();
+    uint32_t bytes = program.size();
+    result->code = CodeImage::adopt(program.release(), bytes, 0);
+    *image = result;
+    return WUDOO_OK;
+}
+
+int wudoo_image_load(const void* data, size_t size, wudoo_image** image, char** error) {
+    CodeImagePtr code;
+    try {
+        code = CodeImage::load((const byte*)data, size);
+    } catch (const char* e) {
+        report(error, e);
+        return WUDOO_ERROR;
+    }
+    if (code->bytes() == 0 or code->eoffset() >= code->bytes()) {
+        report(error, "executable offset out of bounds");
+        return WUDOO_ERROR;
+    }
+
+    wudoo_image* result = new wudoo_image();
+    result->code = code;
+    *image = result;
+    return WUDOO_OK;
+}
+
+const void* wudoo_image_data(const wudoo_image* image, size_t* size) {
+    if (size) { *size = image->code->size(); }
+    return image->code->data();
+}
+
+int wudoo_image_verify(const wudoo_image* image, char** error) {
+    if (image->code->verified()) { return WUDOO_OK; }
+    report(error, image->code->problem());
+    return WUDOO_ERROR;
+}
+
+void wudoo_image_free(wudoo_image* image) {
+    delete image;
+}
+
+
+wudoo_cpu* wudoo_cpu_new(const wudoo_image* image) {
+    /*  CPU shares the image: only its registers are its own.
+     */
+    wudoo_cpu* cpu = new wudoo_cpu();
+    cpu->cpu.load(image->code);
+    cpu->code = image->code;
+    return cpu;
+}
+
+void wudoo_cpu_free(wudoo_cpu* cpu) {
+    delete cpu;
+}
+
+wudoo_cpu* wudoo_cpu_clone(wudoo_cpu* cpu) {
+    wudoo_cpu* copy = new wudoo_cpu();
+    cpu->cpu.clone(copy->cpu);
+    copy->code = cpu->code;
+    copy->exit_code = cpu->exit_code;
+    copy->callback = cpu->callback;
+    if (cpu->cpu.out.rdbuf() == &cpu->callback) {
+        copy->cpu.out.rdbuf(&copy->callback);
+    } else if (cpu->cpu.out.rdbuf() == &cpu->buffer) {
+        copy->cpu.out.rdbuf(&copy->buffer);
+    }
+    return copy;
+}
+
+void wudoo_cpu_set_output(wudoo_cpu* cpu, wudoo_output_fn callback, void* context) {
+    cpu->callback = CallbackBuffer(callback, context);
+    cpu->cpu.out.rdbuf(&cpu->callback);
+}
+
+void wudoo_cpu_capture_output(wudoo_cpu* cpu) {
+    cpu->buffer.str("");
+    cpu->cpu.out.rdbuf(&cpu->buffer);
+}
+
+const char* wudoo_cpu_output(wudoo_cpu* cpu, size_t* size) {
+    cpu->captured = cpu->buffer.str();
+    if (size) { *size = cpu->captured.size(); }
+    return cpu->captured.c_str();
+}
+
+int wudoo_cpu_run(wudoo_cpu* cpu) {
+    /*  CPU reports errors in running programs itself (and sets the exit code to 1),
+     *  anything else that escapes it is reported the same way.
+     */
+    try {
+        cpu->exit_code = cpu->cpu.run();
+    } catch (...) {
+        cpu->cpu.out << "exception: " << exceptionMessage() << endl;
+        cpu->exit_code = 1;
+    }
+    return cpu->exit_code;
+}
+
+void wudoo_cpu_set_fuel(wudoo_cpu* cpu, unsigned long long instructions) {
+    cpu->cpu.limit(instructions);
+}
+
+unsigned long long wudoo_cpu_fuel(const wudoo_cpu* cpu) {
+    return cpu->cpu.remaining();
+}
+
+void wudoo_cpu_collect_allocations(wudoo_cpu* cpu) {
+    if (cpu->allocations) { return; }
+    cpu->allocations.reset(new AllocationStats());
+    cpu->cpu.allocation_stats = cpu->allocations.get();
+}
+
+char* wudoo_cpu_allocations(const wudoo_cpu* cpu) {
+    /*  Census is taken anew every time, so it describes registers of the CPU as they are now.
+     */
+    if (not cpu->allocations) { return 0; }
+    cpu->allocations->census.clear();
+    cpu->cpu.census(*cpu->allocations);
+    ostringstream json;
+    cpu->allocations->json(json, cpu->code->bytecode());
+    char* result = 0;
+    report(&result, json.str());
+    return result;
+}
+
+int wudoo_cpu_resume(wudoo_cpu* cpu) {
+    try {
+        CPU::Slice slice = cpu->cpu.resume();
+        if (slice == CPU::YIELDED) { return WUDOO_YIELDED; }
+        if (slice == CPU::EXHAUSTED) { return WUDOO_OUT_OF_FUEL; }
+        cpu->exit_code = cpu->cpu.exitcode();
+    } catch (...) {
+        cpu->cpu.out << "exception: " << exceptionMessage() << endl;
+        cpu->exit_code = 1;
+    }
+    return WUDOO_FINISHED;
+}
+
+int wudoo_cpu_exit_code(const wudoo_cpu* cpu) {
+    return cpu->exit_code;
+}
+
+int wudoo_cpu_register(const wudoo_cpu* cpu, int index, wudoo_value* value) {
+    if (index < 0 or index >= DEFAULT_REGISTER_SIZE) { return WUDOO_ERROR; }
+    Object* object = cpu->cpu.peek(index);
+    value->type = WUDOO_EMPTY;
+    value->integer = 0;
+    if (not object) { return WUDOO_OK; }
+
+    string type = object->type();
+    if (type == "Integer") {
+        value->type = WUDOO_INTEGER;
+        value->integer = static_cast<Integer*>(object)->value();
+    } else if (type == "Boolean") {
+        value->type = WUDOO_BOOLEAN;
+        value->integer = static_cast<Boolean*>(object)->value();
+    } else if (type == "Byte") {
+        value->type = WUDOO_BYTE;
+        value->integer = static_cast<Byte*>(object)->value();
+    } else {
+        value->type = WUDOO_OBJECT;
+    }
+    return WUDOO_OK;
+}
+
+int wudoo_cpu_set_register(wudoo_cpu* cpu, int index, const wudoo_value* value) {
+    if (index < 0 or index >= DEFAULT_REGISTER_SIZE) { return WUDOO_ERROR; }
+    Object* object = 0;
+    switch (value->type) {
+        case WUDOO_INTEGER:
+            object = new Integer(value->integer);
+            break;
+        case WUDOO_BOOLEAN:
+            object = new Boolean(value->integer);
+            break;
+        case WUDOO_BYTE:
+            object = new Byte(value->integer);
+            break;
+        default:
+            return WUDOO_ERROR;
+    }
+    cpu->cpu.put(index, object);
+    return WUDOO_OK;
+}
+
+}
@@ -0,0 +1,178 @@
+#ifndef WUDOO_LIB_WUDOO_H
+#define WUDOO_LIB_WUDOO_H
+
+#pragma once
+
+/*  C API of libwudoo - Wudoo assembler and CPU embeddable in other programs.
+ *
+ *  Typical use:
+ *
+ *      wudoo_image* image = 0;
+ *      char* error = 0;
+ *      if (wudoo_assemble(source, strlen(source), 0, &image, &error) != WUDOO_OK) { ...; wudoo_free(error); }
+ *
+ *      wudoo_cpu* cpu = wudoo_cpu_new(image);
+ *      wudoo_cpu_capture_output(cpu);
+ *      int exit_code = wudoo_cpu_run(cpu);
+ *      const char* output = wudoo_cpu_output(cpu, &size);
+ *      wudoo_cpu_free(cpu);
+ *      wudoo_image_free(image);
+ *
+ *  Library keeps no global mutable state: every CPU is independent, so
+ *  different threads can drive different CPUs at the same time.
+ *  A single CPU must not be used by more than one thread at a time.
+ *  Images are never modified after they are created and may be shared by any number of CPUs and threads;
+ *  CPUs do not copy images they run, but keep references to them, so
+ *  an image may be freed while CPUs created from it are still in use.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*  Status codes returned by functions that may fail.
+ */
+#define WUDOO_OK            0
+#define WUDOO_ERROR         1
+
+/*  Results of wudoo_cpu_resume().
+ */
+#define WUDOO_FINISHED      0
+#define WUDOO_YIELDED       1
+#define WUDOO_OUT_OF_FUEL   2
+
+/*  Exit code of programs stopped because they exceeded their limit of instructions.
+ */
+#define WUDOO_EXIT_OUT_OF_FUEL  124
+
+/*  Flags for wudoo_assemble().
+ */
+#define WUDOO_OPTIMISE      1
+
+/*  Types of values held in registers.
+ */
+#define WUDOO_EMPTY         0
+#define WUDOO_INTEGER       1
+#define WUDOO_BOOLEAN       2
+#define WUDOO_BYTE          3
+#define WUDOO_OBJECT        4
+
+typedef struct wudoo_image wudoo_image;
+typedef struct wudoo_cpu wudoo_cpu;
+
+typedef struct wudoo_value {
+    int type;
+    long long integer;      /* value of integers, booleans (0 or 1) and bytes */
+} wudoo_value;
+
+/*  Receives output of a CPU as it is written (data is not NUL-terminated).
+ */
+typedef void (*wudoo_output_fn)(const char* data, size_t size, void* context);
+
+
+/*  Frees memory returned by the library (e.g. error messages).
+ */
+void wudoo_free(void* pointer);
+
+
+/*  Assembles source code into an image.
+ *  On error returns WUDOO_ERROR and, if error is not null, stores a message in it (free it with wudoo_free()).
+ */
+int wudoo_assemble(const char* source, size_t size, int flags, wudoo_image** image, char** error);
+
+/*  Creates an image from contents of a compiled program (as written by wudoo-asm).
+ *  Data is copied.
+ */
+int wudoo_image_load(const void* data, size_t size, wudoo_image** image, char** error);
+
+/*  Returns contents of an image in the same format wudoo-asm writes to files.
+ *  Returned memory belongs to the image.
+ */
+const void* wudoo_image_data(const wudoo_image* image, size_t* size);
+
+/*  Checks that bytecode of an image is a sequence of valid instructions and that
+ *  all jumps lead to instructions (images are verified once, when they are created).
+ *  Unverified images can still be run - errors are reported when the CPU reaches them.
+ */
+int wudoo_image_verify(const wudoo_image* image, char** error);
+
+void wudoo_image_free(wudoo_image* image);
+
+
+/*  Creates a CPU with the program from an image loaded.
+ *  Output of the CPU goes to standard output until it is redirected.
+ */
+wudoo_cpu* wudoo_cpu_new(const wudoo_image* image);
+void wudoo_cpu_free(wudoo_cpu* cpu);
+
+/*  Creates a CPU continuing from the point the given CPU stopped at (e.g. after it yielded), with the same
+ *  registers, fuel and output destination (a clone of a CPU capturing its output captures its own).
+ *  Values in registers are shared by the CPUs and copied only when one of them changes them, so
+ *  creating many clones of a CPU which prepared its state once is cheap.
+ */
+wudoo_cpu* wudoo_cpu_clone(wudoo_cpu* cpu);
+
+/*  Redirects output of the CPU to a callback (or discards it if the callback is null).
+ */
+void wudoo_cpu_set_output(wudoo_cpu* cpu, wudoo_output_fn callback, void* context);
+
+/*  Redirects output of the CPU to a buffer which can be read with wudoo_cpu_output().
+ *  Returned memory belongs to the CPU and is valid until the next call on the CPU.
+ */
+void wudoo_cpu_capture_output(wudoo_cpu* cpu);
+const char* wudoo_cpu_output(wudoo_cpu* cpu, size_t* size);
+
+/*  Runs program loaded into the CPU and returns its exit code.
+ */
+int wudoo_cpu_run(wudoo_cpu* cpu);
+
+/*  Limits number of instructions the program may still execute (0 removes the limit).
+ *  Instructions are counted a basic block at a time: a program stops before entering a block
+ *  it does not have enough fuel for.
+ */
+void wudoo_cpu_set_fuel(wudoo_cpu* cpu, unsigned long long instructions);
+
+/*  Number of instructions the program may still execute (0 also when the CPU is not limited).
+ */
+unsigned long long wudoo_cpu_fuel(const wudoo_cpu* cpu);
+
+/*  Collects statistics of objects the CPU allocates from now on: counts and bytes by type, opcode and
+ *  bytecode offset, peak of live objects and a histogram of their lifetimes (the same as `wudoo-run --alloc-stats`).
+ *  Collecting them slows the CPU down; CPUs which do not collect them do not pay for it.
+ *  wudoo_cpu_allocations() returns the statistics (with a census of objects the CPU's registers hold now) as JSON,
+ *  or null if the CPU does not collect them; free the string with wudoo_free().
+ *  Clones of a CPU do not inherit its statistics.
+ */
+void wudoo_cpu_collect_allocations(wudoo_cpu* cpu);
+char* wudoo_cpu_allocations(const wudoo_cpu* cpu);
+
+/*  Runs program loaded into the CPU from where it stopped (from its beginning the first time) until
+ *  it finishes (WUDOO_FINISHED, exit code is available from wudoo_cpu_exit_code()),
+ *  executes a `yield` instruction (WUDOO_YIELDED), or
+ *  runs out of fuel (WUDOO_OUT_OF_FUEL; it continues after wudoo_cpu_set_fuel() when resumed again).
+ *  wudoo_cpu_run() instead stops programs that run out of fuel with WUDOO_EXIT_OUT_OF_FUEL exit code.
+ */
+int wudoo_cpu_resume(wudoo_cpu* cpu);
+
+/*  Exit code of the last run.
+ */
+int wudoo_cpu_exit_code(const wudoo_cpu* cpu);
+
+/*  Reads a register.
+ *  Returns WUDOO_ERROR if the index is out of bounds.
+ */
+int wudoo_cpu_register(const wudoo_cpu* cpu, int index, wudoo_value* value);
+
+/*  Writes an integer, boolean or byte to a register (e.g. to give clones of a CPU different inputs).
+ *  Returns WUDOO_ERROR if the index is out of bounds or the type is not one of these.
+ */
+int wudoo_cpu_set_register(wudoo_cpu* cpu, int index, const wudoo_value* value);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif
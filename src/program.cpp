@@ -1,6 +1,8 @@
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <vector>
 #include "bytecode/bytetypedef.h"
 #include "bytecode/opcodes.h"
 #include "bytecode/maps.h"
@@ -13,17 +15,101 @@ typedef std::tuple<bool, int> int_op;
 typedef std::tuple<bool, byte> byte_op;
 
 
+const int INTEGER_OPERAND_SIZE = sizeof(bool) + sizeof(int);
+const int BYTE_OPERAND_SIZE = sizeof(bool) + sizeof(byte);
+
+
+void Program::ensure(int n) {
+    /** Makes sure that at least n more bytes can be written at addr_ptr.
+     *
+     *  Buffer grows geometrically (its capacity is at least doubled) so
+     *  inserting instructions one by one has amortised constant cost.
+     *  Instruction pointer is rebased onto the new buffer.
+     */
+    int used = (addr_ptr - program);
+    if (used + n <= capacity) { return; }
+
+    int grown = (capacity ? capacity * 2 : 64);
+    while (grown < used + n) { grown *= 2; }
+
+    byte* tmp = new byte[grown];
+    for (int i = 0; i < used; ++i) { tmp[i] = program[i]; }
+    /* Filling bytecode with zeroes (which are interpreted by CPU as NOP instructions) is a safe way
+     * to prevent many hiccups.
+     */
+    for (int i = used; i < grown; ++i) { tmp[i] = byte(0); }
+
+    delete[] program;
+    program = tmp;
+    capacity = grown;
+    addr_ptr = program + used;
+}
+
+Program& Program::reserve(int n) {
+    /** Reserves capacity for a program of at least n bytes.
+     *  This is only a hint - programs grow as needed - but it avoids reallocations
+     *  when the size is known (or can be estimated) in advance.
+     */
+    if (n > capacity) { ensure(n - (addr_ptr - program)); }
+    return (*this);
+}
+
+
 byte* Program::bytecode() {
     /*  Returns pointer bo a copy of the bytecode.
      *  Each call produces new copy.
      *
      *  Calling code is responsible for dectruction of the allocated memory.
+     *  Use data() to look at the bytecode, or release() to take it, without copying.
      */
+    int bytes = size();
     byte* tmp = new byte[bytes];
     for (int i = 0; i < bytes; ++i) { tmp[i] = program[i]; }
     return tmp;
 }
 
+const byte* Program::data() const {
+    /*  Returns pointer to the bytecode owned by the program.
+     *  Pointer is valid until next instruction is inserted or the program is destroyed.
+     */
+    return program;
+}
+
+byte* Program::release() {
+    /*  Hands the bytecode over to the caller without copying it.
+     *  Calling code becomes responsible for dectruction of the memory (with delete[]), so
+     *  the pointer can be given straight to CodeImage::adopt().
+     *
+     *  Size must be read with size() *before* calling this function -
+     *  after the hand-off the program is empty.
+     */
+    byte* tmp = program;
+    program = 0;
+    addr_ptr = 0;
+    capacity = 0;
+    branches.clear();
+    return tmp;
+}
+
+
+Program& Program::append(const Program& other) {
+    /** Appends bytecode of another program at the end of this one.
+     *
+     *  Jump and branch targets of the other program are carried over as they are, so
+     *  they must already be instruction indexes in the combined program.
+     *  Their locations are rebased so calculateBranches() can backpatch them.
+     */
+    int base = size();
+    int n = other.size();
+    ensure(n);
+    memcpy(addr_ptr, other.program, n);
+    addr_ptr += n;
+    for (unsigned i = 0; i < other.branches.size(); ++i) {
+        branches.push_back(base + other.branches[i]);
+    }
+    return (*this);
+}
+
 
 Program& Program::setdebug(bool d) {
     /** Sets debugging status.
@@ -33,10 +119,10 @@ Program& Program::setdebug(bool d) {
 }
 
 
-int Program::size() {
+int Program::size() const {
     /*  Returns program size in bytes.
      */
-    return bytes;
+    return (addr_ptr - program);
 }
 
 int Program::instructionCount() {
@@ -44,91 +130,76 @@ int Program::instructionCount() {
      *  Should be called only after the program is constructed as it is calculated by
      *  bytecode analysis.
      */
-    int counter = 0;
-    for (int i = 0; i < bytes; ++i) {
-        switch (program[i]) {
-            case IADD:
-            case ISUB:
-            case IMUL:
-            case IDIV:
-            case ILT:
-            case ILTE:
-            case IGT:
-            case IGTE:
-            case IEQ:
-            case BRANCH:
-                i += 3 * sizeof(int);
-                break;
-            case ISTORE:
-                i += 2 * sizeof(int);
-                break;
-            case IINC:
-            case IDEC:
-            case PRINT:
-            case JUMP:
-            case RET:
-                i += sizeof(int);
-                break;
-        }
-        ++counter;
-    }
-    return counter;
+    return instructionOffsets().size();
 }
 
 
-int Program::getInstructionBytecodeOffset(int instr, int count) {
-    /** Returns bytecode offset for given instruction index.
-     *  The "count" parameter is there to pass assumed instruction count to
-     *  avoid recalculating it on every call.
+vector<int> Program::instructionOffsets() {
+    /** Returns a table mapping instruction indexes to their bytecode offsets.
+     *
+     *  The table is built with a single walk over the bytecode, so
+     *  translating any number of instruction indexes costs one lookup each.
      */
-
-    // check if instruction count was passed, and calculate it if not
-    count = (count >= 0 ? count : instructionCount());
-
+    vector<int> offsets;
+    int bytes = size();
     int offset = 0;
-    int inc;
-    for (int i = 0; i < (instr >= 0 ? instr : count+instr); ++i) {
-        /*  This loop iterates over so many instructions as needed to find bytecode offset for requested instruction.
-         *
-         *  Each time, the offset is increased by `inc` - which is equal to *1 plus size of operands of instructions at current index*.
-         */
-        string opcode_name = OP_NAMES.at(OPCODE(program[offset]));
-        inc = OP_SIZES.at(opcode_name);
-        if (debug) {
-            cout << "increasing instruction offset (" << i+1 << '/';
-            cout << (instr >= 0 ? instr : count+instr) << "): " << opcode_name;
-            cout << ": " << inc << endl;
-        }
-        offset += inc;
-        if (offset+1 > bytes) {
-            throw "instruction offset out of bounds: check your branches";
+    while (offset < bytes) {
+        offsets.push_back(offset);
+        if (opsize(program[offset]) == 0) {
+            throw "invalid opcode in bytecode: cannot calculate instruction offsets";
         }
+        offset += opsize(program[offset]);
+    }
+    return offsets;
+}
+
+int getInstructionBytecodeOffset(const vector<int>& offsets, int instr) {
+    /** Returns bytecode offset for given instruction index.
+     *  Negative indexes are counted from the end of the program.
+     */
+    int index = (instr >= 0 ? instr : int(offsets.size())+instr);
+    if (index < 0 or index >= int(offsets.size())) {
+        throw "instruction offset out of bounds: check your branches";
     }
-    return offset;
+    return offsets[index];
 }
 
 Program& Program::calculateBranches() {
     /*  This function should be called after program is constructed
      *  to calculate correct bytecode offsets for BRANCH instructions.
+     *
+     *  Jump targets are stored as instruction indexes when instructions are inserted, so
+     *  forward jumps can be inserted before their targets exist; here they are backpatched
+     *  with offsets taken from the instruction offset table.
      */
-    int instruction_count = instructionCount();
+    vector<int> offsets = instructionOffsets();
     int* ptr;
+    byte* branch_ptr;
     for (unsigned i = 0; i < branches.size(); ++i) {
-        ptr = (int*)(branches[i]+1);
-        switch (*(branches[i])) {
+        branch_ptr = program + branches[i];
+        ptr = (int*)(branch_ptr+1);
+        switch (*branch_ptr) {
             case JUMP:
-                (*ptr) = getInstructionBytecodeOffset(*ptr, instruction_count);
+                if (debug) { cout << "calculating jump: " << *ptr << endl; }
+                (*ptr) = getInstructionBytecodeOffset(offsets, *ptr);
+                if (debug) { cout << "calculated jump:  " << *ptr << endl; }
                 break;
             case BRANCH:
                 pointer::inc<bool, int>(ptr);
                 if (debug) { cout << "calculating branch:  true: " << *(ptr+1) << endl; }
-                (*(ptr+1)) = getInstructionBytecodeOffset(*(ptr+1), instruction_count);
+                (*(ptr+1)) = getInstructionBytecodeOffset(offsets, *(ptr+1));
                 if (debug) { cout << "calculated branch:   true: " << *(ptr+1) << endl; }
 
                 if (debug) { cout << "calculating branch: false: " << *(ptr+2) << endl; }
-                (*(ptr+2)) = getInstructionBytecodeOffset(*(ptr+2), instruction_count);
+                (*(ptr+2)) = getInstructionBytecodeOffset(offsets, *(ptr+2));
                 if (debug) { cout << "calculated branch:  false: " << *(ptr+2) << endl; }
                 break;
+            case SPAWN:
+                pointer::inc<bool, int>(ptr);
+                if (debug) { cout << "calculating spawn: " << *(ptr+1) << endl; }
+                (*(ptr+1)) = getInstructionBytecodeOffset(offsets, *(ptr+1));
+                if (debug) { cout << "calculated spawn:  " << *(ptr+1) << endl; }
+                break;
         }
     }
 
@@ -184,6 +255,7 @@ Program& Program::istore(int_op regno, int_op i) {
      *  regno:int - register number
      *  i:int     - value to store
      */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
     addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, ISTORE, regno, i);
     return (*this);
 }
@@ -197,6 +269,7 @@ Program& Program::iadd(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, IADD, rega, regb, regr);
     return (*this);
 }
@@ -210,6 +283,7 @@ Program& Program::isub(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, ISUB, rega, regb, regr);
     return (*this);
 }
@@ -223,6 +297,7 @@ Program& Program::imul(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, IMUL, rega, regb, regr);
     return (*this);
 }
@@ -236,6 +311,7 @@ Program& Program::idiv(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, IDIV, rega, regb, regr);
     return (*this);
 }
@@ -243,6 +319,7 @@ Program& Program::idiv(int_op rega, int_op regb, int_op regr) {
 Program& Program::iinc(int_op regno) {
     /*  Inserts iinc instuction.
      */
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE);
     *(addr_ptr++) = IINC;
     addr_ptr = insertIntegerOperand(addr_ptr, regno);
     return (*this);
@@ -251,6 +328,7 @@ Program& Program::iinc(int_op regno) {
 Program& Program::idec(int_op regno) {
     /*  Inserts idec instuction.
      */
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE);
     *(addr_ptr++) = IDEC;
     addr_ptr = insertIntegerOperand(addr_ptr, regno);
     return (*this);
@@ -265,6 +343,7 @@ Program& Program::ilt(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, ILT, rega, regb, regr);
     return (*this);
 }
@@ -278,6 +357,7 @@ Program& Program::ilte(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, ILTE, rega, regb, regr);
     return (*this);
 }
@@ -291,6 +371,7 @@ Program& Program::igt(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, IGT, rega, regb, regr);
     return (*this);
 }
@@ -304,6 +385,7 @@ Program& Program::igte(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, IGTE, rega, regb, regr);
     return (*this);
 }
@@ -317,6 +399,7 @@ Program& Program::ieq(int_op rega, int_op regb, int_op regr) {
      *  regb    - register index of second operand
      *  regr    - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, IEQ, rega, regb, regr);
     return (*this);
 }
@@ -334,6 +417,7 @@ Program& Program::bstore(int_op regno, byte_op b) {
 
     tie(b_ref, bt) = b;
 
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE + BYTE_OPERAND_SIZE);
     *(addr_ptr++) = BSTORE;
     addr_ptr = insertIntegerOperand(addr_ptr, regno);
     *((bool*)addr_ptr) = b_ref;
@@ -347,6 +431,7 @@ Program& Program::bstore(int_op regno, byte_op b) {
 Program& Program::lognot(int_op reg) {
     /*  Inserts not instuction.
      */
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE);
     *(addr_ptr++) = NOT;
     addr_ptr = insertIntegerOperand(addr_ptr, reg);
     return (*this);
@@ -361,6 +446,7 @@ Program& Program::logand(int_op rega, int_op regb, int_op regr) {
      *  regb   - register index of second operand
      *  regr   - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, AND, rega, regb, regr);
     return (*this);
 }
@@ -374,6 +460,7 @@ Program& Program::logor(int_op rega, int_op regb, int_op regr) {
      *  regb   - register index of second operand
      *  regr   - register index in which to store the result
      */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
     addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, OR, rega, regb, regr);
     return (*this);
 }
@@ -386,6 +473,7 @@ Program& Program::move(int_op a, int_op b) {
      *  a - register number (move from...)
      *  b - register number (move to...)
      */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
     addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, MOVE, a, b);
     return (*this);
 }
@@ -398,6 +486,7 @@ Program& Program::copy(int_op a, int_op b) {
      *  a - register number (copy from...)
      *  b - register number (copy to...)
      */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
     addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, COPY, a, b);
     return (*this);
 }
@@ -410,6 +499,7 @@ Program& Program::ref(int_op a, int_op b) {
      *  a - register number
      *  b - register number
      */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
     addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, REF, a, b);
     return (*this);
 }
@@ -422,6 +512,7 @@ Program& Program::swap(int_op a, int_op b) {
      *  a - register number
      *  b - register number
      */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
     addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, SWAP, a, b);
     return (*this);
 }
@@ -429,6 +520,7 @@ Program& Program::swap(int_op a, int_op b) {
 Program& Program::print(int_op reg) {
     /*  Inserts print instuction.
      */
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE);
     *(addr_ptr++) = PRINT;
     addr_ptr = insertIntegerOperand(addr_ptr, reg);
     return (*this);
@@ -437,6 +529,7 @@ Program& Program::print(int_op reg) {
 Program& Program::echo(int_op reg) {
     /*  Inserts echo instuction.
      */
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE);
     *(addr_ptr++) = ECHO;
     addr_ptr = insertIntegerOperand(addr_ptr, reg);
     return (*this);
@@ -451,7 +544,8 @@ Program& Program::jump(int addr) {
      *  addr:int    - index of the instruction to which to branch
      */
     // save branch instruction index for later evaluation
-    branches.push_back(addr_ptr);
+    ensure(sizeof(byte) + sizeof(int));
+    branches.push_back(addr_ptr - program);
 
     *(addr_ptr++) = JUMP;
 
@@ -472,7 +566,8 @@ Program& Program::branch(int_op regc, int addr_truth, int addr_false) {
      *  addr_false:int      - instruction index to go if condition is false
      */
     // save branch instruction index for later evaluation
-    branches.push_back(addr_ptr);
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE + 2*sizeof(int));
+    branches.push_back(addr_ptr - program);
 
     *(addr_ptr++) = BRANCH;
     addr_ptr = insertIntegerOperand(addr_ptr, regc);
@@ -492,6 +587,7 @@ Program& Program::ret(int_op reg) {
      *
      *  reg - index of the register which will be stored as return value
      */
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE);
     *(addr_ptr++) = RET;
     addr_ptr = insertIntegerOperand(addr_ptr, reg);
     return (*this);
@@ -500,6 +596,7 @@ Program& Program::ret(int_op reg) {
 Program& Program::pass() {
     /*  Inserts pass instruction.
      */
+    ensure(sizeof(byte));
     *(addr_ptr++) = PASS;
     return (*this);
 }
@@ -507,6 +604,88 @@ Program& Program::pass() {
 Program& Program::halt() {
     /*  Inserts halt instruction.
      */
+    ensure(sizeof(byte));
     *(addr_ptr++) = HALT;
     return (*this);
 }
+
+Program& Program::spawn(int_op reg, int addr) {
+    /*  Inserts spawn instruction.
+     *  Byte offset of the instruction the new process starts at is calculated automatically.
+     *
+     *  :params:
+     *
+     *  reg:int_op  - register whose value is copied to the new process (to register with the same index)
+     *  addr:int    - index of the instruction at which the new process starts
+     */
+    ensure(sizeof(byte) + INTEGER_OPERAND_SIZE + sizeof(int));
+    branches.push_back(addr_ptr - program);
+
+    *(addr_ptr++) = SPAWN;
+    addr_ptr = insertIntegerOperand(addr_ptr, reg);
+    *((int*)addr_ptr) = addr;
+    pointer::inc<int, byte>(addr_ptr);
+
+    return (*this);
+}
+
+Program& Program::yield() {
+    /*  Inserts yield instruction.
+     */
+    ensure(sizeof(byte));
+    *(addr_ptr++) = YIELD;
+    return (*this);
+}
+
+Program& Program::chan(int_op reg, int_op capacity) {
+    /*  Inserts chan instruction.
+     *
+     *  :params:
+     *
+     *  reg:int_op      - register to put the new channel in
+     *  capacity:int_op - number of objects the channel can hold
+     */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
+    addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, CHAN, reg, capacity);
+    return (*this);
+}
+
+Program& Program::send(int_op channel, int_op reg) {
+    /*  Inserts send instruction.
+     *
+     *  :params:
+     *
+     *  channel:int_op  - register with the channel
+     *  reg:int_op      - register with the object to send
+     */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
+    addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, SEND, channel, reg);
+    return (*this);
+}
+
+Program& Program::recv(int_op channel, int_op reg) {
+    /*  Inserts recv instruction.
+     *
+     *  :params:
+     *
+     *  channel:int_op  - register with the channel
+     *  reg:int_op      - register to put received object in
+     */
+    ensure(sizeof(byte) + 2*INTEGER_OPERAND_SIZE);
+    addr_ptr = insertTwoIntegerOpsInstruction(addr_ptr, RECV, channel, reg);
+    return (*this);
+}
+
+Program& Program::tryrecv(int_op channel, int_op reg, int_op flag) {
+    /*  Inserts tryrecv instruction.
+     *
+     *  :params:
+     *
+     *  channel:int_op  - register with the channel
+     *  reg:int_op      - register to put received object in
+     *  flag:int_op     - register to put a Boolean in (true if an object was received)
+     */
+    ensure(sizeof(byte) + 3*INTEGER_OPERAND_SIZE);
+    addr_ptr = insertThreeIntegerOpsInstruction(addr_ptr, TRYRECV, channel, reg, flag);
+    return (*this);
+}
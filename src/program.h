@@ -10,16 +10,21 @@ typedef std::tuple<bool, int> int_op;
 typedef std::tuple<bool, byte> byte_op;
 
 class Program {
+    /*  Bytecode is kept in a growable buffer.
+     *  Capacity is the size of the buffer, address pointer marks the end of
+     *  bytecode inserted so far (and the place where next instruction will be inserted).
+     */
     byte* program;
-    int bytes;
+    int capacity;
 
     byte* addr_ptr;
 
-    std::vector<byte*> branches;
+    // bytecode offsets of jump, branch and spawn instructions
+    std::vector<int> branches;
 
     bool debug;
 
-    int getInstructionBytecodeOffset(int, int count = -1);
+    void ensure(int);
 
     public:
     // instructions interface
@@ -61,26 +66,41 @@ class Program {
     Program& pass       ();
     Program& halt       ();
 
+    Program& spawn      (int_op, int);
+    Program& yield      ();
+
+    Program& chan       (int_op, int_op);
+    Program& send       (int_op, int_op);
+    Program& recv       (int_op, int_op);
+    Program& tryrecv    (int_op, int_op, int_op);
+
     Program& calculateBranches();
+    Program& append(const Program&);
 
 
     // representations
     byte* bytecode();
+    const byte* data() const;
+    byte* release();
 
     Program& setdebug(bool d = true);
+    Program& reserve(int);
 
-    int size();
+    int size() const;
     int instructionCount();
 
+    // bytecode offsets of instructions, indexed by instruction
+    std::vector<int> instructionOffsets();
+
 
-    Program(int bts = 2): bytes(bts), debug(false) {
-        program = new byte[bytes];
-        /* Filling bytecode with zeroes (which are interpreted by CPU as NOP instructions) is a safe way
-         * to prevent many hiccups.
+    Program(int bts = 0): program(0), capacity(0), addr_ptr(0), debug(false) {
+        /*  The size passed to constructor is a capacity hint.
+         *  Program grows as instructions are inserted so it does not have to be exact.
          */
-        for (int i = 0; i < bytes; ++i) { program[i] = byte(0); }
-        addr_ptr = program;
+        reserve(bts);
     }
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
     ~Program() {
         delete[] program;
     }
@@ -0,0 +1,51 @@
+#ifndef SUPPORT_CYCLES_H
+#define SUPPORT_CYCLES_H
+
+#pragma once
+
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+
+namespace cycles {
+    /*  Low-overhead counter for timing short pieces of code.
+     *
+     *  On x86 it reads the time-stamp counter (which ticks at a constant rate on current processors, so
+     *  its "cycles" are reference cycles, not cycles of the core), elsewhere it falls back to a steady clock in nanoseconds.
+     *  Reading is not serialising: measurements of single instructions are approximate and
+     *  are meant to be compared with each other, not taken as absolute.
+     */
+#if defined(__x86_64__) || defined(__i386__)
+    const char* const UNIT = "cycles";
+
+    inline uint64_t now() {
+        return __rdtsc();
+    }
+#else
+    const char* const UNIT = "ns";
+
+    inline uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+#endif
+
+    inline uint64_t overhead() {
+        /*  Cost of reading the counter (the smallest difference between two readings), to be
+         *  subtracted from measurements.
+         */
+        uint64_t least = UINT64_MAX;
+        for (int i = 0; i < 1000; ++i) {
+            uint64_t begin = now();
+            uint64_t taken = now() - begin;
+            if (taken < least) { least = taken; }
+        }
+        return least;
+    }
+}
+
+
+#endif
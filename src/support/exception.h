@@ -0,0 +1,29 @@
+#ifndef SUPPORT_EXCEPTION_H
+#define SUPPORT_EXCEPTION_H
+
+#pragma once
+
+#include <exception>
+#include <string>
+
+
+inline std::string exceptionMessage() {
+    /*  Message of the exception being handled (call it only from a catch block).
+     *
+     *  CPU and assembler throw strings, C strings and standard exceptions; all of them are
+     *  reported the same way, so callers catch everything and ask for the message here.
+     *  Exceptions of other types are thrown again.
+     */
+    try {
+        throw;
+    } catch (const std::string& e) {
+        return e;
+    } catch (const char* e) {
+        return e;
+    } catch (const std::exception& e) {
+        return e.what();
+    }
+}
+
+
+#endif
@@ -0,0 +1,172 @@
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "perf.h"
+using namespace std;
+
+
+#ifdef __linux__
+struct Event {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+static const Event HARDWARE_EVENTS[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+};
+static const Event SOFTWARE_EVENTS[] = {
+    { "task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+};
+
+static int openEvent(const Event& event, int group) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // only the leader starts disabled; the whole group is enabled at once
+    attr.disabled = (group == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+
+PerfCounters::Reading::Reading() {
+    for (unsigned i = 0; i < MAX_EVENTS; ++i) { values[i] = 0; }
+}
+
+
+PerfCounters::PerfCounters(): leader(-1), processor(false) {
+#ifdef __linux__
+    if (open(true)) {
+        processor = true;
+    } else {
+        int error = errno;
+        string reason = strerror(error);
+        if (error == ENOENT or error == EOPNOTSUPP) {
+            reason += " (the processor's counters are not exposed, e.g. in a virtual machine)";
+        } else if (error == EACCES or error == EPERM) {
+            reason += " (see /proc/sys/kernel/perf_event_paranoid)";
+        }
+        if (open(false)) {
+            trouble = "hardware counters are unavailable: " + reason + "; counting software events instead";
+        } else {
+            trouble = "counters are unavailable: " + reason + "; software events: " + strerror(errno);
+        }
+    }
+#else
+    trouble = "performance counters are available only on Linux";
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+bool PerfCounters::open(bool hardware) {
+    /*  The first event leads the group and must open; others are skipped if the processor does not count them.
+     */
+#ifdef __linux__
+    const Event* events = (hardware ? HARDWARE_EVENTS : SOFTWARE_EVENTS);
+    unsigned count = (hardware ? sizeof(HARDWARE_EVENTS) : sizeof(SOFTWARE_EVENTS)) / sizeof(Event);
+    leader = openEvent(events[0], -1);
+    if (leader == -1) { return false; }
+    descriptors.push_back(leader);
+    names.push_back(events[0].name);
+    for (unsigned i = 1; i < count; ++i) {
+        int fd = openEvent(events[i], leader);
+        if (fd == -1) { continue; }
+        descriptors.push_back(fd);
+        names.push_back(events[i].name);
+    }
+    ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PerfCounters::close() {
+#ifdef __linux__
+    for (int fd : descriptors) { ::close(fd); }
+#endif
+    descriptors.clear();
+    names.clear();
+    leader = -1;
+}
+
+PerfCounters::Reading PerfCounters::read() const {
+    /*  Group is read as: number of events, time the group was enabled, time it was running, and a value per event.
+     */
+    Reading reading;
+#ifdef __linux__
+    if (leader == -1) { return reading; }
+    uint64_t data[3 + MAX_EVENTS];
+    ssize_t size = ::read(leader, data, sizeof(data));
+    if (size < ssize_t(3 * sizeof(uint64_t))) { return reading; }
+    uint64_t enabled = data[1], running = data[2];
+    for (unsigned i = 0; i < data[0] and i < MAX_EVENTS; ++i) {
+        uint64_t value = data[3+i];
+        if (running and running < enabled) { value = uint64_t(double(value) * enabled / running); }
+        reading.values[i] = value;
+    }
+#endif
+    return reading;
+}
+
+void PerfCounters::record(const string& region, const Reading& begin, const Reading& end, uint64_t vm_instructions) {
+    Region* found = 0;
+    for (Region& r : regions) {
+        if (r.name == region) { found = &r; }
+    }
+    if (not found) {
+        regions.push_back(Region{region, Reading(), 0});
+        found = &regions.back();
+    }
+    for (unsigned i = 0; i < MAX_EVENTS; ++i) {
+        found->counts.values[i] += (end.values[i] > begin.values[i] ? end.values[i] - begin.values[i] : 0);
+    }
+    found->instructions += vm_instructions;
+}
+
+void PerfCounters::report(ostream& out) const {
+    if (trouble.size()) { out << "perf counters: " << trouble << endl; }
+    if (names.empty()) { return; }
+
+    for (const Region& region : regions) {
+        out << "perf counters: " << region.name;
+        if (region.instructions) { out << " (" << region.instructions << " VM instructions)"; }
+        out << endl;
+        for (unsigned i = 0; i < names.size(); ++i) {
+            out << "    " << left << setw(18) << names[i] << right << setw(16) << region.counts.values[i];
+            if (region.instructions) {
+                out << setw(14) << fixed << setprecision(2) << double(region.counts.values[i]) / region.instructions << " per VM instruction";
+            }
+            out << endl;
+        }
+        // instructions per cycle (the first two hardware events)
+        if (processor and names.size() > 1 and names[1] == "instructions" and region.counts.values[0]) {
+            out << "    " << left << setw(18) << "IPC" << right << setw(16) << fixed << setprecision(2) << double(region.counts.values[1]) / region.counts.values[0] << endl;
+        }
+    }
+    out.unsetf(ios::floatfield);
+}
@@ -0,0 +1,75 @@
+#ifndef SUPPORT_PERF_H
+#define SUPPORT_PERF_H
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+class PerfCounters {
+    /*  Counters of the processor (cycles, instructions, branch and cache misses) of the calling thread,
+     *  read with Linux perf_event_open(2).
+     *
+     *  Counters are opened as a single group, so they are scheduled onto the processor together and
+     *  all of them are read with one read(2); the group runs from construction to destruction and
+     *  regions of code are measured as differences between two readings.
+     *  Where the processor's counters are not available (virtual machines and containers often do not expose them,
+     *  and perf_event_paranoid may forbid them) software counters of the kernel (task clock, page faults and
+     *  context switches) are counted instead, and where even those are not, nothing is counted.
+     *  Reasons are reported by problem().
+     */
+    public:
+        static const unsigned MAX_EVENTS = 4;
+
+        struct Reading {
+            uint64_t values[MAX_EVENTS];
+            Reading();
+        };
+
+        PerfCounters();
+        ~PerfCounters();
+        PerfCounters(const PerfCounters&) = delete;
+
+        // number of counted events (0 if nothing could be opened), and whether they are the processor's
+        unsigned events() const { return names.size(); }
+        bool hardware() const { return processor; }
+        const std::string& problem() const { return trouble; }
+
+        /*  Current values of all counters, scaled up when the kernel had to multiplex them.
+         */
+        Reading read() const;
+
+        /*  Add the difference between two readings to a named region, together with
+         *  the number of VM instructions executed in it (0 if it executes none).
+         *  Regions are reported in the order they were first recorded.
+         */
+        void record(const std::string& region, const Reading& begin, const Reading& end, uint64_t vm_instructions = 0);
+
+        /*  Every region with its counts and, for regions that executed VM instructions,
+         *  counts per VM instruction (e.g. cycles it took to dispatch and execute one).
+         */
+        void report(std::ostream& out) const;
+
+    private:
+        int leader;
+        std::vector<int> descriptors;
+        std::vector<std::string> names;
+        bool processor;
+        std::string trouble;
+
+        struct Region {
+            std::string name;
+            Reading counts;
+            uint64_t instructions;
+        };
+        std::vector<Region> regions;
+
+        bool open(bool hardware);
+        void close();
+};
+
+
+#endif
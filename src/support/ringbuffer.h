@@ -0,0 +1,106 @@
+#ifndef SUPPORT_RINGBUFFER_H
+#define SUPPORT_RINGBUFFER_H
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+
+template<class T> class RingBuffer {
+    /** Bounded lock-free queue.
+     *
+     *  Any number of threads may push and pop at the same time (so it serves as
+     *  a multi-producer single-consumer and single-producer single-consumer queue alike).
+     *  Every cell carries a sequence number which tells whether it is ready to be written (it equals
+     *  the position of the writer) or to be read (it equals the position of the reader plus one), so
+     *  producers and consumers only contend on their own position counters.
+     *
+     *  Capacity is rounded up to a power of two, and is at least two (with a single cell
+     *  sequence numbers of a full and an empty queue would be the same).
+     */
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+
+    // positions are kept apart so producers and consumers do not share a cache line
+    std::atomic<size_t> write_position;
+    char padding[64];
+    std::atomic<size_t> read_position;
+
+    public:
+        bool push(const T& value) {
+            /*  Returns false if the queue is full.
+             */
+            size_t position = write_position.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = cells[position & mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                long difference = long(sequence) - long(position);
+                if (difference == 0) {
+                    if (write_position.compare_exchange_weak(position, position+1, std::memory_order_relaxed)) {
+                        cell.data = value;
+                        cell.sequence.store(position+1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = write_position.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool pop(T& value) {
+            /*  Returns false if the queue is empty.
+             */
+            size_t position = read_position.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = cells[position & mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                long difference = long(sequence) - long(position+1);
+                if (difference == 0) {
+                    if (read_position.compare_exchange_weak(position, position+1, std::memory_order_relaxed)) {
+                        value = cell.data;
+                        cell.sequence.store(position+mask+1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = read_position.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /*  Whether a push or a pop would succeed now (the answer may be stale as soon as it is given).
+         */
+        bool empty() const {
+            size_t position = read_position.load(std::memory_order_relaxed);
+            return cells[position & mask].sequence.load(std::memory_order_acquire) != position+1;
+        }
+        bool full() const {
+            size_t position = write_position.load(std::memory_order_relaxed);
+            return cells[position & mask].sequence.load(std::memory_order_acquire) != position;
+        }
+
+        size_t capacity() const { return mask+1; }
+
+        RingBuffer(size_t n): mask(0), write_position(0), read_position(0) {
+            size_t size = 2;
+            while (size < n) { size *= 2; }
+            cells.reset(new Cell[size]);
+            for (size_t i = 0; i < size; ++i) { cells[i].sequence.store(i, std::memory_order_relaxed); }
+            mask = size-1;
+        }
+        RingBuffer(const RingBuffer&) = delete;
+        RingBuffer& operator=(const RingBuffer&) = delete;
+};
+
+
+#endif
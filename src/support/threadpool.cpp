@@ -0,0 +1,71 @@
+#include "threadpool.h"
+using namespace std;
+
+
+ThreadPool::ThreadPool(unsigned n): pending(0), stopping(false) {
+    /*  Starts n worker threads (at least one).
+     */
+    if (n == 0) { n = 1; }
+    for (unsigned i = 0; i < n; ++i) {
+        workers.push_back(thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    /*  Lets workers finish tasks already submitted and joins them.
+     */
+    {
+        unique_lock<mutex> guard(lock);
+        stopping = true;
+    }
+    available.notify_all();
+    for (unsigned i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+
+void ThreadPool::work() {
+    /*  Main loop of a worker thread.
+     */
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> guard(lock);
+            available.wait(guard, [this] { return stopping or !tasks.empty(); });
+            if (tasks.empty()) { return; }
+            task = move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+
+        {
+            unique_lock<mutex> guard(lock);
+            if (--pending == 0) { finished.notify_all(); }
+        }
+    }
+}
+
+
+void ThreadPool::submit(function<void()> task) {
+    /*  Queues a task for execution by one of the workers.
+     */
+    {
+        unique_lock<mutex> guard(lock);
+        tasks.push_back(move(task));
+        ++pending;
+    }
+    available.notify_one();
+}
+
+void ThreadPool::wait() {
+    /*  Blocks until all submitted tasks are finished.
+     */
+    unique_lock<mutex> guard(lock);
+    finished.wait(guard, [this] { return pending == 0; });
+}
+
+unsigned ThreadPool::size() const {
+    return workers.size();
+}
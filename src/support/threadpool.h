@@ -0,0 +1,46 @@
+#ifndef SUPPORT_THREADPOOL_H
+#define SUPPORT_THREADPOOL_H
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class ThreadPool {
+    /** Fixed-size pool of worker threads executing submitted tasks.
+     *
+     *  Tasks are executed in submission order (but may finish in any order).
+     *  Tasks must not throw - catch exceptions inside the task and report them
+     *  some other way.
+     */
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+
+    std::mutex lock;
+    std::condition_variable available;
+    std::condition_variable finished;
+
+    unsigned pending;
+    bool stopping;
+
+    void work();
+
+    public:
+        void submit(std::function<void()>);
+        void wait();
+
+        unsigned size() const;
+
+        ThreadPool(unsigned n = std::thread::hardware_concurrency());
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool();
+};
+
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef WUDOO_TYPES_CHANNEL_H
+#define WUDOO_TYPES_CHANNEL_H
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "../support/ringbuffer.h"
+#include "object.h"
+
+
+class ChannelState {
+    /** Shared state of a channel: a bounded queue of objects and processes waiting for it.
+     *
+     *  Sending and receiving never take a lock.
+     *  A process that can not send (the queue is full) or receive (the queue is empty) is parked:
+     *  it leaves a wake-up function and is woken by the next receive or send.
+     *  After parking the queue is checked again, so a message (or room for one) that arrived in the meantime
+     *  is not missed.
+     */
+    RingBuffer<Object*> buffer;
+
+    std::mutex lock;
+    std::deque<std::function<void()> > parked_receivers;
+    std::deque<std::function<void()> > parked_senders;
+    std::atomic<unsigned> receivers_waiting;
+    std::atomic<unsigned> senders_waiting;
+
+    void wake(std::deque<std::function<void()> >& parked, std::atomic<unsigned>& waiting) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load() == 0) { return; }
+        std::function<void()> wakeup;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            if (parked.empty()) { return; }
+            wakeup = parked.front();
+            parked.pop_front();
+            --waiting;
+        }
+        wakeup();
+    }
+
+    public:
+        bool send(Object* object) {
+            /*  Returns false if the channel is full (the object then still belongs to the caller).
+             */
+            if (not buffer.push(object)) { return false; }
+            wake(parked_receivers, receivers_waiting);
+            return true;
+        }
+        bool receive(Object*& object) {
+            /*  Returns false if the channel is empty.
+             */
+            if (not buffer.pop(object)) { return false; }
+            wake(parked_senders, senders_waiting);
+            return true;
+        }
+
+        void park(bool sending, const std::function<void()>& wakeup) {
+            /*  Park a sender or a receiver.
+             *  The wake-up function may be called on any thread, also before this function returns.
+             */
+            std::deque<std::function<void()> >& parked = (sending ? parked_senders : parked_receivers);
+            std::atomic<unsigned>& waiting = (sending ? senders_waiting : receivers_waiting);
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                parked.push_back(wakeup);
+                ++waiting;
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sending ? not buffer.full() : not buffer.empty()) { wake(parked, waiting); }
+        }
+
+        size_t capacity() const { return buffer.capacity(); }
+
+        ChannelState(size_t n): buffer(n), receivers_waiting(0), senders_waiting(0) {}
+        ~ChannelState() {
+            Object* object;
+            while (buffer.pop(object)) { delete object; }
+        }
+};
+
+
+class Channel : public Object {
+    /** Channel object.
+     *
+     *  Registers hold handles to channels: copies of a channel (e.g. passed to spawned processes or
+     *  sent through other channels) refer to the same queue.
+     */
+    std::shared_ptr<ChannelState> channel;
+
+    public:
+        std::string type() const {
+            return "Channel";
+        }
+        bool boolean() const {
+            return true;
+        }
+
+        const std::shared_ptr<ChannelState>& state() const { return channel; }
+
+        Object* copy() const {
+            return new Channel(channel);
+        }
+
+        Channel(size_t capacity): channel(new ChannelState(capacity)) {}
+        Channel(const std::shared_ptr<ChannelState>& c): channel(c) {}
+};
+
+
+#endif
@@ -3,10 +3,24 @@
 
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <sstream>
 
 
+class Object;
+
+class AllocationObserver {
+    /*  Receives every allocation and deallocation of objects made on the thread it is installed on
+     *  (see Object::observer).
+     */
+    public:
+        virtual void allocated(const Object* object, std::size_t size) = 0;
+        virtual void freed(const Object* object, std::size_t size) = 0;
+        virtual ~AllocationObserver() {}
+};
+
+
 class Object {
     /** Base class for all derived types.
      *  Wudoo uses an Object-based Hierarchy to allow easier storage in registers and
@@ -47,6 +61,15 @@ class Object {
             return new Object();
         }*/
 
+        /*  Objects are allocated with plain new and delete, which
+         *  report to the observer installed on the current thread (if there is one), e.g. allocation statistics of a CPU.
+         *  Both are defined out of line (in cpu/allocations.cpp), so the compiler always pairs them with each other.
+         */
+        static thread_local AllocationObserver* observer;
+
+        static void* operator new(std::size_t size);
+        static void operator delete(void* memory, std::size_t size);
+
         // We need to construct and desory our basic object.
         Object() {}
         virtual ~Object() {}
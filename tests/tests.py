@@ -12,9 +12,14 @@ Each unit passes if:
 Returning correct may mean raising an exception in some cases.
 """
 
+import ctypes
+import json
 import os
+import re
 import subprocess
+import struct
 import sys
+import threading
 import unittest
 
 
@@ -37,23 +42,25 @@ class WudooCPUError(WudooError):
     pass
 
 
-def assemble(asm, out):
+def assemble(asm, out, flags=()):
     """Assemble path given as `asm` and put binary in `out`.
     Raises exception if compilation is not successful.
+    Returns output of the assembler.
     """
-    p = subprocess.Popen(('./bin/vm/asm', asm, out), stdout=subprocess.PIPE)
+    p = subprocess.Popen(('./bin/vm/asm',) + tuple(flags) + (asm, out), stdout=subprocess.PIPE)
     output, error = p.communicate()
     exit_code = p.wait()
     if exit_code != 0:
         raise WudooAssemblerError('{0}: {1}'.format(asm, output.decode('utf-8').strip()))
+    return output.decode('utf-8')
 
-def run(path, expected_exit_code=0):
+def run(path, expected_exit_code=0, flags=()):
     """Run given file with Wudoo CPU and return its output.
     """
-    p = subprocess.Popen(('./bin/vm/cpu', path), stdout=subprocess.PIPE)
+    p = subprocess.Popen(('./bin/vm/cpu',) + tuple(flags) + (path,), stdout=subprocess.PIPE)
     output, error = p.communicate()
     exit_code = p.wait()
-    if exit_code not in (expected_exit_code if type(expected_exit_code) in [list, tuple] else (expected_exit_code,)):
+    if exit_code not in (expected_exit_code if type(expected_exit_code) in [list, tuple, range] else (expected_exit_code,)):
         raise WudooCPUError('{0}: {1}'.format(path, output.decode('utf-8').strip()))
     return (exit_code, output.decode('utf-8'))
 
@@ -283,5 +290,782 @@ class SampleProgramsTests(unittest.TestCase):
         self.assertEqual(0, excode)
 
 
+class AssemblerTests(unittest.TestCase):
+    """Tests for assembler features that are not tied to a single instruction.
+    """
+    def testProgramLargerThan64KiB(self):
+        name = 'large_program.asm'
+        assembly_path = os.path.join(COMPILED_SAMPLES_PATH, name)
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        with open(assembly_path, 'w') as ofstream:
+            ofstream.write('jump :end\n')
+            for i in range(8000):
+                ofstream.write('istore 1 {0}\n'.format(i))
+            ofstream.write('.mark: end\nistore 1 42\nprint 1\nhalt\n')
+        assemble(assembly_path, compiled_path)
+        self.assertGreater(os.path.getsize(compiled_path), 65536)
+        excode, output = run(compiled_path)
+        self.assertEqual('42', output.strip())
+        self.assertEqual(0, excode)
+
+
+    def testErrorsReportLineAndColumn(self):
+        name = 'undeclared_name.asm'
+        assembly_path = os.path.join(COMPILED_SAMPLES_PATH, name)
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        with open(assembly_path, 'w') as ofstream:
+            ofstream.write('; comment\n\nistore 1 2\n    print  nothing\nhalt\n')
+        with self.assertRaises(WudooAssemblerError) as context:
+            assemble(assembly_path, compiled_path)
+        self.assertIn('{0}:4:12: undeclared name: nothing'.format(assembly_path), str(context.exception))
+
+
+    def testParallelAssemblyIsByteIdentical(self):
+        name = 'parallel.asm'
+        assembly_path = os.path.join(COMPILED_SAMPLES_PATH, name)
+        sequential_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.seq.bin'))
+        parallel_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        with open(assembly_path, 'w') as ofstream:
+            # enough code for several chunks, with marks and names used across chunk boundaries
+            ofstream.write('.name: 1 counter\n')
+            for i in range(12000):
+                ofstream.write('.mark: block{0}\n'.format(i))
+                ofstream.write('istore counter {0}\n'.format(i))
+                ofstream.write('ilt counter last condition\n')
+                ofstream.write('branch condition :block{0} :end\n'.format(i+1))
+            ofstream.write('.mark: block12000\n.mark: end\n.name: 2 last\n.name: 3 condition\nprint counter\nhalt\n')
+        assemble(assembly_path, sequential_path)
+        assemble(assembly_path, parallel_path, ('--jobs', '4'))
+        with open(sequential_path, 'rb') as a, open(parallel_path, 'rb') as b:
+            self.assertEqual(a.read(), b.read())
+
+
+def executed(path, mnemonic=None):
+    """Run given file with Wudoo CPU in debug mode and return number of instructions it executed
+    (only instructions with given mnemonic are counted if it is given).
+    """
+    p = subprocess.Popen(('./bin/vm/cpu', '--debug', path), stdout=subprocess.PIPE)
+    output, error = p.communicate()
+    p.wait()
+    lines = [line for line in output.decode('utf-8').splitlines() if line.startswith('CPU: bytecode')]
+    if mnemonic is not None:
+        lines = [line for line in lines if line.split(': ', 2)[2].split(' ')[0] == mnemonic]
+    return len(lines)
+
+
+class OptimiserTests(unittest.TestCase):
+    """Tests for optimised assembly (`-O` option).
+    """
+    PATH = './sample/asm'
+
+    def testOptimisedSamplesBehaveTheSame(self):
+        for directory, subdirectories, files in os.walk(OptimiserTests.PATH):
+            for name in sorted(files):
+                if not name.endswith('.asm'): continue
+                assembly_path = os.path.join(directory, name)
+                compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.O0.bin'))
+                optimised_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.O.bin'))
+                assemble(assembly_path, compiled_path)
+                assemble(assembly_path, optimised_path, ('-O',))
+                self.assertEqual(run(compiled_path, range(256)), run(optimised_path, range(256)), assembly_path)
+                # loop optimisations trade size for speed, so executed instructions are compared instead of size
+                self.assertLessEqual(executed(optimised_path), executed(compiled_path), assembly_path)
+
+    def testOptimiserReducesExecutedInstructions(self):
+        name = 'power_of.asm'
+        assembly_path = os.path.join(OptimiserTests.PATH, name)
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        optimised_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.O.bin'))
+        assemble(assembly_path, compiled_path)
+        assemble(assembly_path, optimised_path, ('-O',))
+        self.assertLess(executed(optimised_path), executed(compiled_path))
+        excode, output = run(optimised_path)
+        self.assertEqual('64', output.strip())
+        self.assertEqual(0, excode)
+
+    def testOptimiserTransformsLoops(self):
+        name = 'sum_of_multiples.asm'
+        assembly_path = os.path.join(OptimiserTests.PATH, name)
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        optimised_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.O.bin'))
+        assemble(assembly_path, compiled_path)
+        debug_output = assemble(assembly_path, optimised_path, ('-O', '--debug'))
+        self.assertIn('1 hoisted, 1 strength-reduced, rotated', debug_output)
+        self.assertLess(executed(optimised_path), executed(compiled_path))
+        excode, output = run(optimised_path)
+        self.assertEqual('1315', output.strip())
+        self.assertEqual(0, excode)
+
+    def testOptimiserRenamesRegisters(self):
+        name = 'power_of.asm'
+        assembly_path = os.path.join(OptimiserTests.PATH, name)
+        optimised_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.O.bin'))
+        debug_output = assemble(assembly_path, optimised_path, ('-O', '--debug'))
+        self.assertIn('register: 6 `result` -> 4', debug_output)
+        excode, output = run(optimised_path)
+        self.assertEqual('64', output.strip())
+        self.assertEqual(0, excode)
+
+
+class ProfileGuidedLayoutTests(unittest.TestCase):
+    """Tests for branch profiles (`--branch-profile` option of CPU) and
+    profile-guided layout (`--profile-use` option of assembler).
+    """
+    PATH = './sample/asm'
+
+    def testLayoutReducesExecutedJumps(self):
+        name = 'looping.asm'
+        assembly_path = os.path.join(ProfileGuidedLayoutTests.PATH, name)
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        profile_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.profile'))
+        laid_out_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.layout.bin'))
+        assemble(assembly_path, compiled_path)
+        profiled = run(compiled_path, flags=('--branch-profile', profile_path))
+        assemble(assembly_path, laid_out_path, ('--profile-use', profile_path))
+        self.assertEqual(profiled, run(laid_out_path))
+        self.assertLess(executed(laid_out_path, 'jump'), executed(compiled_path, 'jump'))
+
+    def testProfileOfDifferentProgramIsRejected(self):
+        profile_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.profile')
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.layout.bin')
+        assemble(os.path.join(ProfileGuidedLayoutTests.PATH, 'looping.asm'), os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin'))
+        run(os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin'), flags=('--branch-profile', profile_path))
+        with self.assertRaises(WudooAssemblerError):
+            assemble(os.path.join(ProfileGuidedLayoutTests.PATH, 'power_of.asm'), compiled_path, ('--profile-use', profile_path))
+
+
+class BatchRunnerTests(unittest.TestCase):
+    """Tests for running many programs in one CPU process (`--jobs` and `--manifest` options).
+    """
+    PATH = './sample/asm'
+    SAMPLES = ('looping.asm', 'power_of.asm', 'regmod/ret.asm', 'sum_of_multiples.asm')
+
+    def compiledSamples(self):
+        paths = []
+        for name in BatchRunnerTests.SAMPLES:
+            compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (os.path.basename(name) + '.bin'))
+            assemble(os.path.join(BatchRunnerTests.PATH, name), compiled_path)
+            paths.append(compiled_path)
+        return paths
+
+    def runBatch(self, flags):
+        p = subprocess.Popen(('./bin/vm/cpu',) + tuple(flags), stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        output, summary = p.communicate()
+        return (p.wait(), output.decode('utf-8'), summary.decode('utf-8').splitlines())
+
+    def testOutputsAreWrittenInOrder(self):
+        paths = self.compiledSamples() * 3
+        expected = [run(path, range(256)) for path in paths]
+        exit_code, output, summary = self.runBatch(['--jobs', '4'] + paths)
+        self.assertEqual(''.join(out for code, out in expected), output)
+        self.assertEqual(['{0} {1}'.format(code, path) for (code, out), path in zip(expected, paths)], summary[:-1])
+        self.assertEqual('programs: 12, failed: 3', summary[-1])
+        self.assertEqual(1, exit_code)
+
+    def testManifest(self):
+        paths = self.compiledSamples()
+        paths.remove(os.path.join(COMPILED_SAMPLES_PATH, 'ret.asm.bin'))
+        manifest_path = os.path.join(COMPILED_SAMPLES_PATH, 'batch.manifest')
+        with open(manifest_path, 'w') as ofstream:
+            ofstream.write('# samples\n\n' + '\n'.join(paths) + '\n')
+        exit_code, output, summary = self.runBatch(['--jobs', '2', '--manifest', manifest_path])
+        self.assertEqual(''.join(run(path)[1] for path in paths), output)
+        self.assertEqual('programs: 3, failed: 0', summary[-1])
+        self.assertEqual(0, exit_code)
+
+    def testUnreadableFilesFailAlone(self):
+        paths = self.compiledSamples()[:1] + [os.path.join(COMPILED_SAMPLES_PATH, 'no_such_file.bin')]
+        exit_code, output, summary = self.runBatch(paths)
+        self.assertEqual(run(paths[0])[1] + 'fatal: file could not be opened\n', output)
+        self.assertEqual(['0 ' + paths[0], '1 ' + paths[1], 'programs: 2, failed: 1'], summary)
+        self.assertEqual(1, exit_code)
+
+
+class ProcessTests(unittest.TestCase):
+    """Tests for processes (`spawn` and `yield` instructions) run by the scheduler.
+    """
+    PATH = './sample/asm/processes'
+
+    def compiled(self, name):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        assemble(os.path.join(ProcessTests.PATH, name), compiled_path)
+        return compiled_path
+
+    def testSpawn(self):
+        compiled_path = self.compiled('spawn.asm')
+        self.assertEqual('1\n4\n9\n16\n', run(compiled_path, flags=('--workers', '1'))[1])
+        self.assertEqual(['1', '16', '4', '9'], sorted(run(compiled_path, flags=('--workers', '4'))[1].split()))
+
+    def testYield(self):
+        compiled_path = self.compiled('yield.asm')
+        self.assertEqual(['20', '10', '21', '11', '22', '12'], run(compiled_path, flags=('--workers', '1'))[1].split())
+
+    def testSpawningProgramsAreNotOptimised(self):
+        output = assemble(os.path.join(ProcessTests.PATH, 'spawn.asm'), os.path.join(COMPILED_SAMPLES_PATH, 'spawn.asm.O.bin'), ('-O', '--debug'))
+        self.assertIn('optimising: skipped (program spawns processes)', output)
+        self.assertEqual(run(self.compiled('spawn.asm'), flags=('--workers', '1')), run(os.path.join(COMPILED_SAMPLES_PATH, 'spawn.asm.O.bin'), flags=('--workers', '1')))
+
+    def testSpawnInBatch(self):
+        paths = [self.compiled('spawn.asm'), self.compiled('yield.asm')]
+        p = subprocess.Popen(('./bin/vm/cpu', '--jobs', '2') + tuple(paths), stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        output, summary = p.communicate()
+        self.assertEqual(0, p.wait())
+        self.assertEqual('1\n4\n9\n16\n20\n10\n21\n11\n22\n12\n', output.decode('utf-8'))
+
+
+class ChannelTests(unittest.TestCase):
+    """Tests for channels (`chan`, `send`, `recv` and `tryrecv` instructions).
+    """
+    PATH = './sample/asm/channels'
+
+    def compiled(self, name):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        assemble(os.path.join(ChannelTests.PATH, name), compiled_path)
+        return compiled_path
+
+    def testPipeline(self):
+        compiled_path = self.compiled('pipeline.asm')
+        for workers in ('1', '4'):
+            self.assertEqual('1\n4\n9\n16\n25\n', run(compiled_path, flags=('--workers', workers))[1])
+
+    def testSendMovesAndTryrecvDoesNotWait(self):
+        self.assertEqual('true\n42\nfalse\n42\n', run(self.compiled('tryrecv.asm'))[1])
+
+    def testDeadlock(self):
+        exit_code, output = run(self.compiled('deadlock.asm'), expected_exit_code=1, flags=('--workers', '2'))
+        self.assertEqual(['exception: deadlock: all processes are waiting on channels'] * 2, output.splitlines())
+
+    def testReceivingFromEmptyChannelWithoutScheduler(self):
+        source_path = os.path.join(COMPILED_SAMPLES_PATH, 'recv_empty.asm')
+        with open(source_path, 'w') as ofstream:
+            ofstream.write('chan 1 1\nrecv 1 2\nhalt\n')
+        compiled_path = source_path + '.bin'
+        assemble(source_path, compiled_path)
+        exit_code, output = run(compiled_path, expected_exit_code=1)
+        self.assertEqual('exception: recv: channel is empty and no other process can send to it (deadlock)\n', output)
+
+
+class InstructionLimitTests(unittest.TestCase):
+    """Tests for limiting number of instructions programs may execute (`--max-instructions` option).
+    """
+    def testRunawayLoopIsStopped(self):
+        source_path = os.path.join(COMPILED_SAMPLES_PATH, 'runaway.asm')
+        with open(source_path, 'w') as ofstream:
+            ofstream.write('istore 1 0\n.mark: loop\niinc 1\njump :loop\n')
+        compiled_path = source_path + '.bin'
+        assemble(source_path, compiled_path)
+        exit_code, output = run(compiled_path, expected_exit_code=124, flags=('--max-instructions', '100000'))
+        self.assertEqual('CPU: stopped: instruction limit exceeded\n', output)
+
+    def testLimitIsExact(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'add.asm.bin')
+        assemble('./sample/asm/int/add.asm', compiled_path)
+        self.assertEqual((0, '1\n'), run(compiled_path, flags=('--max-instructions', '7')))
+        self.assertEqual(124, run(compiled_path, expected_exit_code=124, flags=('--max-instructions', '6'))[0])
+
+    def testLimitAppliesToProcesses(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'spawn.asm.bin')
+        assemble('./sample/asm/processes/spawn.asm', compiled_path)
+        self.assertEqual(124, run(compiled_path, expected_exit_code=124, flags=('--workers', '1', '--max-instructions', '10'))[0])
+        self.assertEqual(0, run(compiled_path, flags=('--workers', '1', '--max-instructions', '100'))[0])
+
+
+class SnapshotTests(unittest.TestCase):
+    """Tests for saving and restoring state of the CPU (`--snapshot` and `--restore` options).
+    """
+    PATH = './sample/asm/snapshot'
+
+    def snapshot(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'warm.asm.bin')
+        snapshot_path = os.path.join(COMPILED_SAMPLES_PATH, 'warm.asm.snap')
+        assemble(os.path.join(SnapshotTests.PATH, 'warm.asm'), compiled_path)
+        self.assertEqual((0, ''), run(compiled_path, flags=('--snapshot', snapshot_path)))
+        return (compiled_path, snapshot_path)
+
+    def testRestoredProgramSkipsInitialisation(self):
+        compiled_path, snapshot_path = self.snapshot()
+        self.assertEqual('500500\n500501\n', run(compiled_path)[1])
+        # references between registers survive the snapshot, and only instructions after `yield` are executed
+        self.assertEqual('500500\n500501\n', run(compiled_path, flags=('--restore', snapshot_path, '--max-instructions', '5'))[1])
+        self.assertEqual(124, run(compiled_path, expected_exit_code=124, flags=('--max-instructions', '5'))[0])
+
+    def testSnapshotOfDifferentProgramIsRejected(self):
+        compiled_path, snapshot_path = self.snapshot()
+        other_path = os.path.join(COMPILED_SAMPLES_PATH, 'add.asm.bin')
+        assemble('./sample/asm/int/add.asm', other_path)
+        self.assertEqual('fatal: restore: snapshot was made for a different program\n', run(other_path, expected_exit_code=1, flags=('--restore', snapshot_path))[1])
+        with open(snapshot_path, 'rb') as ifstream:
+            data = ifstream.read()
+        with open(snapshot_path, 'wb') as ofstream:
+            ofstream.write(data[:-1])
+        self.assertEqual('fatal: restore: snapshot is truncated\n', run(compiled_path, expected_exit_code=1, flags=('--restore', snapshot_path))[1])
+
+    def testObjectsThatCanNotBeSavedAreReported(self):
+        source_path = os.path.join(COMPILED_SAMPLES_PATH, 'channel_snapshot.asm')
+        with open(source_path, 'w') as ofstream:
+            ofstream.write('chan 1 2\nyield\nhalt\n')
+        compiled_path = source_path + '.bin'
+        assemble(source_path, compiled_path)
+        output = run(compiled_path, expected_exit_code=1, flags=('--snapshot', compiled_path + '.snap'))[1]
+        self.assertEqual('fatal: snapshot: register 1 holds an object of type Channel which can not be saved\n', output)
+
+
+class ExecutionProfileTests(unittest.TestCase):
+    """Tests for the execution profiler (`--profile` option).
+    """
+    def testInstructionsAreCountedPerOpcodeAndOffset(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        profile_path = compiled_path + '.profile.json'
+        assemble('./sample/asm/looping.asm', compiled_path)
+        # program output is not mixed with the report
+        self.assertEqual([str(i) for i in range(11)], run(compiled_path, flags=('--profile', profile_path))[1].split())
+        with open(profile_path) as ifstream:
+            profile = json.load(ifstream)
+        self.assertEqual(67, profile['instructions'])
+        counts = {entry['opcode']: entry['count'] for entry in profile['opcodes']}
+        self.assertEqual({'istore': 2, 'ilt': 11, 'not': 11, 'branch': 11, 'print': 11, 'iinc': 10, 'jump': 10, 'halt': 1}, counts)
+        self.assertEqual(sorted(entry['time'] for entry in profile['opcodes'])[::-1], [entry['time'] for entry in profile['opcodes']])
+        self.assertEqual(profile['instructions'], sum(entry['count'] for entry in profile['offsets']))
+        self.assertEqual([('print', 10), ('print', 1)], [(entry['opcode'], entry['count']) for entry in profile['offsets'] if entry['opcode'] == 'print'])
+
+    def testProfilingIsRefusedInBatchMode(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        assemble('./sample/asm/looping.asm', compiled_path)
+        output = run(compiled_path, expected_exit_code=1, flags=('--profile', compiled_path + '.profile.json', compiled_path))[1]
+        self.assertEqual('fatal: --profile can be used only with a single program\n', output)
+
+
+class SamplingProfilerTests(unittest.TestCase):
+    """Tests for the sampling profiler (`--sample` option).
+    """
+    def testSamplesAreWrittenAsFoldedStacks(self):
+        source_path = os.path.join(COMPILED_SAMPLES_PATH, 'sampled_loop.asm')
+        with open(source_path, 'w') as ofstream:
+            ofstream.write('istore 1 0\nistore 2 1000000\n.mark: loop\niinc 1\nilt 1 2 3\nbranch 3 :loop :end\n.mark: end\nhalt\n')
+        compiled_path = source_path + '.bin'
+        samples_path = compiled_path + '.folded'
+        assemble(source_path, compiled_path)
+        self.assertEqual((0, ''), run(compiled_path, flags=('--sample', samples_path, '--sample-rate', '2000')))
+        with open(samples_path) as ifstream:
+            lines = ifstream.read().splitlines()
+        self.assertTrue(lines)
+        samples = {}
+        for line in lines:
+            match = re.match(r'^(.*);block@(\d+);(\w+)@(\d+) (\d+)$', line)
+            self.assertTrue(match, line)
+            self.assertEqual(compiled_path, match.group(1))
+            samples[(int(match.group(2)), match.group(3))] = int(match.group(5))
+        # the program spends practically all of its time in the loop
+        in_loop = sum(samples.get((22, opcode), 0) for opcode in ('iinc', 'ilt', 'branch'))
+        self.assertGreater(in_loop, 0.9 * sum(samples.values()))
+
+    def testProfilersCanNotBeCombined(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        assemble('./sample/asm/looping.asm', compiled_path)
+        output = run(compiled_path, expected_exit_code=1, flags=('--profile', compiled_path + '.profile.json', '--sample', compiled_path + '.folded'))[1]
+        self.assertEqual('fatal: --profile and --sample can not be used together\n', output)
+
+
+class TracerTests(unittest.TestCase):
+    """Tests for the binary execution tracer (`--trace` option) and its decoder.
+    """
+    def decode(self, trace_path, compiled_path, expected_exit_code=0):
+        p = subprocess.Popen(('./bin/vm/trace', trace_path, compiled_path), stdout=subprocess.PIPE)
+        output, error = p.communicate()
+        self.assertEqual(expected_exit_code, p.wait())
+        return output.decode('utf-8')
+
+    def testDecodedTraceMatchesDebugOutput(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        trace_path = compiled_path + '.trace'
+        assemble('./sample/asm/looping.asm', compiled_path)
+        self.assertEqual([str(i) for i in range(11)], run(compiled_path, flags=('--trace', trace_path))[1].split())
+        # bytecode is loaded at a different address in every run
+        debug = [re.sub('0x[0-9a-f]+', '0x', line) for line in run(compiled_path, flags=('--debug',))[1].splitlines() if line.startswith('CPU: bytecode')]
+        decoded = [re.sub('0x[0-9a-f]+', '0x', line) for line in self.decode(trace_path, compiled_path).splitlines()]
+        self.assertEqual(67, len(decoded))
+        self.assertEqual(debug, decoded)
+
+    def testReferencesAreResolvedAndProgramIsChecked(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.bin')
+        trace_path = compiled_path + '.trace'
+        assemble('./sample/asm/power_of.asm', compiled_path)
+        run(compiled_path, flags=('--trace', trace_path))
+        self.assertIn(': istore 6 @1 ; @1 = 4', self.decode(trace_path, compiled_path))
+        other_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        assemble('./sample/asm/looping.asm', other_path)
+        self.assertEqual('fatal: trace was recorded for a different program\n', self.decode(trace_path, other_path, expected_exit_code=1))
+
+
+class AllocationStatsTests(unittest.TestCase):
+    """Tests for allocation statistics (`--alloc-stats` option).
+    """
+    def testAllocationsAreAttributedToInstructions(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        stats_path = compiled_path + '.alloc.json'
+        assemble('./sample/asm/looping.asm', compiled_path)
+        self.assertEqual([str(i) for i in range(11)], run(compiled_path, flags=('--alloc-stats', stats_path))[1].split())
+        with open(stats_path) as ifstream:
+            stats = json.load(ifstream)
+        self.assertEqual(24, stats['allocations']['objects'])
+        self.assertEqual({'Boolean': 22, 'Integer': 2}, {entry['type']: entry['objects'] for entry in stats['types']})
+        self.assertEqual({'ilt': 11, 'not': 11, 'istore': 2}, {entry['opcode']: entry['objects'] for entry in stats['opcodes']})
+        self.assertEqual(4, stats['peak']['objects'])
+        self.assertEqual(stats['frees']['objects'], sum(entry['objects'] for entry in stats['lifetimes']))
+        self.assertEqual(stats['allocations']['objects'] - stats['frees']['objects'], stats['live']['objects'])
+
+    def testCensusCountsObjectsInRegisters(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.bin')
+        stats_path = compiled_path + '.alloc.json'
+        assemble('./sample/asm/power_of.asm', compiled_path)
+        run(compiled_path, flags=('--alloc-stats', stats_path))
+        with open(stats_path) as ifstream:
+            stats = json.load(ifstream)
+        # base, exponent, zero, counter, result and the inverted comparison
+        self.assertEqual({'Integer': 5, 'Boolean': 1}, {entry['type']: entry['objects'] for entry in stats['census']})
+        self.assertEqual(0, stats['outside']['objects'])
+
+
+class CoverageTests(unittest.TestCase):
+    """Tests for basic block coverage (`--coverage` and `--lcov` options).
+    """
+    def testBlocksAreCountedByOffset(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.bin')
+        coverage_path = compiled_path + '.coverage.json'
+        assemble('./sample/asm/power_of.asm', compiled_path)
+        self.assertEqual('64', run(compiled_path, flags=('--coverage', coverage_path))[1].strip())
+        with open(coverage_path) as ifstream:
+            coverage = json.load(ifstream)
+        # the block storing 1 as the result for zero exponent never runs, and the loop condition is checked once more than its body runs
+        self.assertEqual([1, 0, 1, 3, 2, 1], [block['count'] for block in coverage['counts']])
+        self.assertEqual((6, 5), (coverage['blocks'], coverage['executed']))
+        self.assertEqual(coverage['instructions'], sum(block['instructions'] for block in coverage['counts']))
+        self.assertNotIn('mark', coverage['counts'][0])
+
+    def testLcovReportsSourceLines(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.g.bin')
+        lcov_path = compiled_path + '.info'
+        assemble('./sample/asm/looping.asm', compiled_path, flags=('-g',))
+        run(compiled_path, flags=('--lcov', lcov_path))
+        with open(lcov_path) as ifstream:
+            lines = ifstream.read().splitlines()
+        self.assertEqual('SF:./sample/asm/looping.asm', lines[1])
+        self.assertIn('FNDA:11,loop', lines)
+        self.assertIn('DA:13,10', lines)
+        self.assertIn('DA:17,1', lines)
+        self.assertEqual('end_of_record', lines[-1])
+        plain_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        assemble('./sample/asm/looping.asm', plain_path)
+        self.assertEqual('fatal: --lcov requires a program assembled with debug information (wudoo-asm -g)', run(plain_path, expected_exit_code=1, flags=('--lcov', lcov_path))[1].strip())
+
+
+class PerfCountersTests(unittest.TestCase):
+    """Tests for performance counters (`--perf-counters` option).
+    Counters may not be available where tests run, so only what does not depend on them is checked.
+    """
+    def counted(self, compiled_path):
+        p = subprocess.Popen(('./bin/vm/cpu', '--perf-counters', compiled_path), stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        output, error = p.communicate()
+        self.assertEqual(0, p.wait())
+        regions = re.findall(r'^perf counters: (.+?)(?: \((\d+) VM instructions\))?$', error.decode('utf-8'), re.MULTILINE)
+        return (output.decode('utf-8'), error.decode('utf-8'), regions)
+
+    def testRunIsMeasuredPerVMInstruction(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.bin')
+        assemble('./sample/asm/looping.asm', compiled_path)
+        output, error, regions = self.counted(compiled_path)
+        self.assertEqual([str(i) for i in range(11)], output.split())
+        if 'counters are unavailable:' in error and 'software events instead' not in error:
+            return
+        self.assertIn(('run', '67'), regions)
+        self.assertIn(('load', ''), regions)
+        self.assertIn('per VM instruction', error)
+
+    def testPhasesAreSeparatedByYield(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'warm.asm.g.bin')
+        assemble('./sample/asm/snapshot/warm.asm', compiled_path, flags=('-g',))
+        output, error, regions = self.counted(compiled_path)
+        self.assertEqual(['500500', '500501'], output.split())
+        if 'counters are unavailable:' in error and 'software events instead' not in error:
+            return
+        # instructions after the `yield` belong to the second phase
+        self.assertEqual([('phase 1', '4005'), ('phase 2 (:initialised)', '4'), ('run', '4009')], regions[-3:])
+
+
+class DebugInfoTests(unittest.TestCase):
+    """Tests for debug information (`-g` option of the assembler).
+    """
+    def testDebugSectionFollowsUnchangedBytecode(self):
+        plain_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.bin')
+        debug_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.g.bin')
+        assemble('./sample/asm/power_of.asm', plain_path)
+        assemble('./sample/asm/power_of.asm', debug_path, flags=('-g',))
+        with open(plain_path, 'rb') as ifstream:
+            plain = ifstream.read()
+        with open(debug_path, 'rb') as ifstream:
+            debug = ifstream.read()
+        self.assertEqual(plain, debug[:len(plain)])
+        self.assertTrue(debug[len(plain):].startswith(b'WUDOODBG'))
+        self.assertEqual(run(plain_path), run(debug_path))
+        # parallel assembly describes the program the same way
+        parallel_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.parallel.g.bin')
+        assemble('./sample/asm/power_of.asm', parallel_path, flags=('-g', '--jobs', '4'))
+        with open(parallel_path, 'rb') as ifstream:
+            self.assertEqual(debug, ifstream.read())
+
+    def testErrorsAndProfilesAreLocatedInSource(self):
+        source_path = os.path.join(COMPILED_SAMPLES_PATH, 'located_error.asm')
+        with open(source_path, 'w') as ofstream:
+            ofstream.write('istore 1 1\n\n.mark: failing\nprint 100000\nhalt\n')
+        compiled_path = source_path + '.g.bin'
+        assemble(source_path, compiled_path, flags=('-g',))
+        output = run(compiled_path, expected_exit_code=1)[1].splitlines()
+        self.assertEqual('    at {0}:4, in :failing'.format(source_path), output[-1])
+
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.g.bin')
+        profile_path = compiled_path + '.profile.json'
+        assemble('./sample/asm/looping.asm', compiled_path, flags=('-g',))
+        run(compiled_path, flags=('--profile', profile_path))
+        with open(profile_path) as ifstream:
+            profile = json.load(ifstream)
+        prints = [(entry['line'], entry.get('mark'), entry['count']) for entry in profile['offsets'] if entry['opcode'] == 'print']
+        self.assertEqual([(13, 'loop', 10), (17, 'final_print', 1)], prints)
+
+
+class DebuggerTests(unittest.TestCase):
+    """Tests for the debugger (`wudoo-dbg`).
+    """
+    def debug(self, compiled_path, commands, expected_exit_code=0):
+        p = subprocess.Popen(('./bin/vm/dbg', compiled_path), stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+        output, error = p.communicate('\n'.join(commands).encode('utf-8'))
+        self.assertEqual(expected_exit_code, p.wait())
+        return output.decode('utf-8').splitlines()
+
+    def testBreakpointsAndSteps(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'power_of.asm.g.bin')
+        assemble('./sample/asm/power_of.asm', compiled_path, flags=('-g',))
+        output = self.debug(compiled_path, ('break :loop', 'break 108', 'continue', 'print counter', 'step', 'step 2', 'delete 1', 'continue'))
+        self.assertEqual([
+            'breakpoint 1 at byte 107 (./sample/asm/power_of.asm:33, in :loop): ilt 5 2 4',
+            'error: breakpoint must be set at an instruction: byte 108',
+            'breakpoint 1 at byte 107 (./sample/asm/power_of.asm:33, in :loop): ilt 5 2 4',
+            '5 (counter) = 1 (Integer)',
+            'at byte 123 (./sample/asm/power_of.asm:34, in :loop): branch 4 137 165',
+            'at byte 153 (./sample/asm/power_of.asm:37, in :loop): pass',
+            '64',
+            'program finished with exit code 0',
+        ], output)
+
+    def testConditionalBreakpointDoesNotChangeProgram(self):
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, 'looping.asm.g.bin')
+        assemble('./sample/asm/looping.asm', compiled_path, flags=('-g',))
+        output = self.debug(compiled_path, ('break :loop if 1 == 7', 'continue', 'print 1', 'continue', 'breakpoints'))
+        self.assertEqual([str(i) for i in range(7)], output[1:8])
+        self.assertEqual('1 = 7 (Integer)', output[9])
+        self.assertEqual([str(i) for i in range(7, 11)], output[10:14])
+        self.assertEqual('program finished with exit code 0', output[14])
+        self.assertTrue(output[15].endswith('(conditional), hit 11 times'))
+
+
+class WudooValue(ctypes.Structure):
+    _fields_ = [('type', ctypes.c_int), ('integer', ctypes.c_longlong)]
+
+WUDOO_OUTPUT_FN = ctypes.CFUNCTYPE(None, ctypes.POINTER(ctypes.c_char), ctypes.c_size_t, ctypes.c_void_p)
+
+def libwudoo():
+    """Load libwudoo shared library and declare types of its functions.
+    """
+    lib = ctypes.CDLL('./bin/lib/libwudoo.so')
+    lib.wudoo_assemble.argtypes = (ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int, ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p))
+    lib.wudoo_image_load.argtypes = (ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_void_p), ctypes.POINTER(ctypes.c_void_p))
+    lib.wudoo_image_data.argtypes = (ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t))
+    lib.wudoo_image_data.restype = ctypes.c_void_p
+    lib.wudoo_image_verify.argtypes = (ctypes.c_void_p, ctypes.POINTER(ctypes.c_void_p))
+    lib.wudoo_image_free.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_free.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_new.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_new.restype = ctypes.c_void_p
+    lib.wudoo_cpu_free.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_set_output.argtypes = (ctypes.c_void_p, WUDOO_OUTPUT_FN, ctypes.c_void_p)
+    lib.wudoo_cpu_capture_output.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_output.argtypes = (ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t))
+    lib.wudoo_cpu_output.restype = ctypes.c_void_p
+    lib.wudoo_cpu_run.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_exit_code.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_register.argtypes = (ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(WudooValue))
+    lib.wudoo_cpu_set_fuel.argtypes = (ctypes.c_void_p, ctypes.c_ulonglong)
+    lib.wudoo_cpu_fuel.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_fuel.restype = ctypes.c_ulonglong
+    lib.wudoo_cpu_resume.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_clone.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_clone.restype = ctypes.c_void_p
+    lib.wudoo_cpu_set_register.argtypes = (ctypes.c_void_p, ctypes.c_int, ctypes.POINTER(WudooValue))
+    lib.wudoo_cpu_collect_allocations.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_allocations.argtypes = (ctypes.c_void_p,)
+    lib.wudoo_cpu_allocations.restype = ctypes.c_void_p
+    return lib
+
+
+class LibraryTests(unittest.TestCase):
+    """Tests for the C API of libwudoo.
+    """
+    PATH = './sample/asm'
+
+    def setUp(self):
+        self.lib = libwudoo()
+
+    def assembleImage(self, source, flags=0):
+        image, error = ctypes.c_void_p(), ctypes.c_void_p()
+        status = self.lib.wudoo_assemble(source, len(source), flags, ctypes.byref(image), ctypes.byref(error))
+        self.assertEqual(0, status, ctypes.string_at(error).decode('utf-8') if error.value else '')
+        return image
+
+    def capturedOutput(self, cpu):
+        size = ctypes.c_size_t()
+        data = self.lib.wudoo_cpu_output(cpu, ctypes.byref(size))
+        return ctypes.string_at(data, size.value).decode('utf-8')
+
+    def testAssemblingAndRunning(self):
+        with open(os.path.join(LibraryTests.PATH, 'looping.asm'), 'rb') as ifstream:
+            image = self.assembleImage(ifstream.read())
+        cpu = self.lib.wudoo_cpu_new(image)
+        self.lib.wudoo_cpu_capture_output(cpu)
+        self.assertEqual(0, self.lib.wudoo_cpu_run(cpu))
+        self.assertEqual([str(i) for i in range(11)], self.capturedOutput(cpu).split())
+        value = WudooValue()
+        self.assertEqual(0, self.lib.wudoo_cpu_register(cpu, 1, ctypes.byref(value)))
+        self.assertEqual((1, 10), (value.type, value.integer))
+        self.assertEqual(0, self.lib.wudoo_cpu_register(cpu, 3, ctypes.byref(value)))
+        self.assertEqual((2, 1), (value.type, value.integer))
+        self.assertEqual(0, self.lib.wudoo_cpu_register(cpu, 4, ctypes.byref(value)))
+        self.assertEqual(0, value.type)
+        self.assertEqual(1, self.lib.wudoo_cpu_register(cpu, -1, ctypes.byref(value)))
+        self.lib.wudoo_cpu_free(cpu)
+        self.lib.wudoo_image_free(image)
+
+    def testLoadingCompiledProgramAndReadingExitCode(self):
+        name = 'ret.asm'
+        compiled_path = os.path.join(COMPILED_SAMPLES_PATH, (name + '.bin'))
+        assemble(os.path.join(LibraryTests.PATH, 'regmod', name), compiled_path)
+        with open(compiled_path, 'rb') as ifstream:
+            data = ifstream.read()
+        image, error = ctypes.c_void_p(), ctypes.c_void_p()
+        self.assertEqual(0, self.lib.wudoo_image_load(data, len(data), ctypes.byref(image), ctypes.byref(error)))
+        size = ctypes.c_size_t()
+        self.assertEqual(data, ctypes.string_at(self.lib.wudoo_image_data(image, ctypes.byref(size)), len(data)))
+        cpu = self.lib.wudoo_cpu_new(image)
+        self.assertEqual(4, self.lib.wudoo_cpu_run(cpu))
+        self.assertEqual(4, self.lib.wudoo_cpu_exit_code(cpu))
+        self.lib.wudoo_cpu_free(cpu)
+        self.lib.wudoo_image_free(image)
+
+    def testAssemblerErrorsAreReported(self):
+        image, error = ctypes.c_void_p(), ctypes.c_void_p()
+        source = b'istore 1 1\nfoo 1\nhalt\n'
+        self.assertEqual(1, self.lib.wudoo_assemble(source, len(source), 0, ctypes.byref(image), ctypes.byref(error)))
+        self.assertIn('foo', ctypes.string_at(error).decode('utf-8'))
+        self.lib.wudoo_free(error)
+
+    def testOutputCallback(self):
+        image = self.assembleImage(b'istore 1 42\nprint 1\nhalt\n')
+        received = []
+        callback = WUDOO_OUTPUT_FN(lambda data, size, context: received.append(ctypes.string_at(data, size).decode('utf-8')))
+        cpu = self.lib.wudoo_cpu_new(image)
+        self.lib.wudoo_cpu_set_output(cpu, callback, None)
+        self.assertEqual(0, self.lib.wudoo_cpu_run(cpu))
+        self.assertEqual('42\n', ''.join(received))
+        self.lib.wudoo_cpu_free(cpu)
+        self.lib.wudoo_image_free(image)
+
+    def testCPUsRunInSeparateThreads(self):
+        with open(os.path.join(LibraryTests.PATH, 'power_of.asm'), 'rb') as ifstream:
+            image = self.assembleImage(ifstream.read(), 1)
+        cpus = [self.lib.wudoo_cpu_new(image) for i in range(8)]
+        for cpu in cpus: self.lib.wudoo_cpu_capture_output(cpu)
+        threads = [threading.Thread(target=self.lib.wudoo_cpu_run, args=(cpu,)) for cpu in cpus]
+        for thread in threads: thread.start()
+        for thread in threads: thread.join()
+        for cpu in cpus:
+            self.assertEqual('64', self.capturedOutput(cpu).strip())
+            self.lib.wudoo_cpu_free(cpu)
+        self.lib.wudoo_image_free(image)
+
+    def testCPUsShareImage(self):
+        with open(os.path.join(LibraryTests.PATH, 'looping.asm'), 'rb') as ifstream:
+            image = self.assembleImage(ifstream.read())
+        self.assertEqual(0, self.lib.wudoo_image_verify(image, None))
+        cpus = [self.lib.wudoo_cpu_new(image) for i in range(1000)]
+        # CPUs keep the image alive
+        self.lib.wudoo_image_free(image)
+        for cpu in cpus:
+            self.lib.wudoo_cpu_capture_output(cpu)
+            self.assertEqual(0, self.lib.wudoo_cpu_run(cpu))
+            self.assertEqual([str(i) for i in range(11)], self.capturedOutput(cpu).split())
+            self.lib.wudoo_cpu_free(cpu)
+
+    def testInvalidBytecodeIsNotVerified(self):
+        data = struct.pack('<I12xI12xB', 1, 0, 255)
+        image, error = ctypes.c_void_p(), ctypes.c_void_p()
+        self.assertEqual(0, self.lib.wudoo_image_load(data, len(data), ctypes.byref(image), ctypes.byref(error)))
+        self.assertEqual(1, self.lib.wudoo_image_verify(image, ctypes.byref(error)))
+        self.assertIn('invalid opcode', ctypes.string_at(error).decode('utf-8'))
+        self.lib.wudoo_free(error)
+        self.lib.wudoo_image_free(image)
+
+    def testFuelAndResuming(self):
+        image = self.assembleImage(b'istore 1 0\n.mark: loop\niinc 1\nyield\njump :loop\n')
+        cpu = self.lib.wudoo_cpu_new(image)
+        value = WudooValue()
+        self.assertEqual(1, self.lib.wudoo_cpu_resume(cpu))
+        self.lib.wudoo_cpu_set_fuel(cpu, 100)
+        while self.lib.wudoo_cpu_resume(cpu) == 1: pass
+        self.assertEqual(0, self.lib.wudoo_cpu_register(cpu, 1, ctypes.byref(value)))
+        counted = value.integer
+        self.lib.wudoo_cpu_set_fuel(cpu, 30)
+        while self.lib.wudoo_cpu_resume(cpu) == 1: pass
+        self.assertEqual(0, self.lib.wudoo_cpu_register(cpu, 1, ctypes.byref(value)))
+        self.assertEqual(counted + 10, value.integer)
+        self.lib.wudoo_cpu_capture_output(cpu)
+        self.assertEqual(124, self.lib.wudoo_cpu_run(cpu))
+        self.assertEqual('CPU: stopped: instruction limit exceeded\n', self.capturedOutput(cpu))
+        self.lib.wudoo_cpu_free(cpu)
+        self.lib.wudoo_image_free(image)
+
+    def testClonesShareRegistersUntilTheyWriteToThem(self):
+        with open(os.path.join(LibraryTests.PATH, 'snapshot', 'warm.asm'), 'rb') as ifstream:
+            image = self.assembleImage(ifstream.read())
+        parent = self.lib.wudoo_cpu_new(image)
+        self.lib.wudoo_cpu_capture_output(parent)
+        self.assertEqual(1, self.lib.wudoo_cpu_resume(parent))
+        clones = [self.lib.wudoo_cpu_clone(parent) for i in range(3)]
+        self.lib.wudoo_cpu_set_register(clones[1], 1, ctypes.byref(WudooValue(1, 7)))
+        self.assertEqual(1, self.lib.wudoo_cpu_set_register(clones[1], 1, ctypes.byref(WudooValue(4, 0))))
+        # objects of the parent live as long as any of its clones
+        self.assertEqual(0, self.lib.wudoo_cpu_resume(parent))
+        self.assertEqual(['500500', '500501'], self.capturedOutput(parent).split())
+        self.lib.wudoo_cpu_free(parent)
+        self.lib.wudoo_image_free(image)
+        for i, expected in enumerate((['500500', '500501'], ['7', '8'], ['500500', '500501'])):
+            self.assertEqual(0, self.lib.wudoo_cpu_resume(clones[i]))
+            self.assertEqual(expected, self.capturedOutput(clones[i]).split())
+            self.lib.wudoo_cpu_free(clones[i])
+
+    def testAllocationStatistics(self):
+        with open(os.path.join(LibraryTests.PATH, 'looping.asm'), 'rb') as ifstream:
+            image = self.assembleImage(ifstream.read())
+        cpu = self.lib.wudoo_cpu_new(image)
+        self.lib.wudoo_cpu_capture_output(cpu)
+        self.assertEqual(None, self.lib.wudoo_cpu_allocations(cpu))
+        self.lib.wudoo_cpu_collect_allocations(cpu)
+        self.assertEqual(0, self.lib.wudoo_cpu_run(cpu))
+        data = self.lib.wudoo_cpu_allocations(cpu)
+        stats = json.loads(ctypes.string_at(data).decode('utf-8'))
+        self.lib.wudoo_free(data)
+        self.assertEqual(24, stats['allocations']['objects'])
+        self.assertEqual(3, sum(entry['objects'] for entry in stats['census']))
+        self.lib.wudoo_cpu_free(cpu)
+        self.lib.wudoo_image_free(image)
+
+
 if __name__ == '__main__':
     unittest.main()